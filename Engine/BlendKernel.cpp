@@ -0,0 +1,681 @@
+/*
+    BlendKernel.cpp
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#include "Engine/ZixelPCH.h"
+#include "Engine/BlendKernel.h"
+#include "Engine/CPU.h"
+
+#ifdef ZIXEL_SIMD_X86
+	#include <immintrin.h>
+#endif
+
+namespace Zixel {
+
+	static inline void BlendKernel_addResult(BlendSpanResult& _result, s32* _columnCounts, s32 _index, u8 _prevAlpha, u8 _alpha) {
+
+		if (_prevAlpha == 0 && _alpha > 0) {
+
+			++_result.pixelCountDelta;
+			if (_columnCounts != nullptr) ++_columnCounts[_index];
+
+			if (_result.firstAddedIndex == -1) _result.firstAddedIndex = _index;
+			_result.lastAddedIndex = _index;
+
+		}
+		else if (_prevAlpha > 0 && _alpha == 0) {
+
+			--_result.pixelCountDelta;
+			if (_columnCounts != nullptr) --_columnCounts[_index];
+
+			_result.removedPixels = true;
+
+		}
+
+	}
+
+	static inline void BlendKernel_addResultMask(BlendSpanResult& _result, s32* _columnCounts, s32 _index, s32 _addedMask, s32 _removedMask) {
+
+		if (_addedMask != 0) {
+
+			s32 first = 0;
+			while (((_addedMask >> first) & 1) == 0) ++first;
+
+			s32 last = 31;
+			while (((_addedMask >> last) & 1) == 0) --last;
+
+			if (_result.firstAddedIndex == -1) _result.firstAddedIndex = _index + first;
+			_result.lastAddedIndex = _index + last;
+
+			for (s32 i = _addedMask; i != 0; i &= (i - 1)) ++_result.pixelCountDelta;
+
+			if (_columnCounts != nullptr) {
+
+				for (s32 i = first; i <= last; ++i) {
+					if ((_addedMask >> i) & 1) ++_columnCounts[_index + i];
+				}
+
+			}
+
+		}
+
+		if (_removedMask != 0) {
+
+			_result.removedPixels = true;
+
+			for (s32 i = 0; i < 8; ++i) {
+
+				if (((_removedMask >> i) & 1) == 0) continue;
+
+				--_result.pixelCountDelta;
+				if (_columnCounts != nullptr) --_columnCounts[_index + i];
+
+			}
+
+		}
+
+	}
+
+	static void BlendKernel_blendScalar(u8* _dest, const u8* _source, s32 _start, s32 _count, BlendMode _blendMode, const u8* _opacityTable, bool _makeEmptyPixelsBlack, BlendSpanResult& _result, s32* _columnCounts) {
+
+		for (s32 i = _start; i < _count; ++i) {
+
+			const u8* src = _source + ((size_t)i * 4);
+			u8* dst = _dest + ((size_t)i * 4);
+
+			Color4 source = { src[0], src[1], src[2], (_opacityTable != nullptr) ? _opacityTable[src[3]] : src[3] };
+			Color4 dest = { dst[0], dst[1], dst[2], dst[3] };
+
+			Color4 blended = Color::blendColor(source, dest, _blendMode);
+			if (Color::match(dest, blended)) continue;
+
+			_result.modified = true;
+
+			if (_makeEmptyPixelsBlack && blended.a == 0) blended = { 0, 0, 0, 0 };
+
+			dst[0] = blended.r;
+			dst[1] = blended.g;
+			dst[2] = blended.b;
+			dst[3] = blended.a;
+
+			BlendKernel_addResult(_result, _columnCounts, i, dest.a, blended.a);
+
+		}
+
+	}
+
+	static void BlendKernel_blendPremultipliedScalar(u8* _dest, const u8* _source, s32 _start, s32 _count, BlendMode _blendMode, const u8* _opacityTable, BlendSpanResult& _result, s32* _columnCounts) {
+
+		for (s32 i = _start; i < _count; ++i) {
+
+			const u8* src = _source + ((size_t)i * 4);
+			u8* dst = _dest + ((size_t)i * 4);
+
+			Color4 source = { src[0], src[1], src[2], src[3] };
+			if (_opacityTable != nullptr) source = { _opacityTable[src[0]], _opacityTable[src[1]], _opacityTable[src[2]], _opacityTable[src[3]] };
+
+			Color4 dest = { dst[0], dst[1], dst[2], dst[3] };
+
+			Color4 blended = Color::blendColorPremultiplied(source, dest, _blendMode);
+			if (Color::match(dest, blended)) continue;
+
+			_result.modified = true;
+
+			dst[0] = blended.r;
+			dst[1] = blended.g;
+			dst[2] = blended.b;
+			dst[3] = blended.a;
+
+			BlendKernel_addResult(_result, _columnCounts, i, dest.a, blended.a);
+
+		}
+
+	}
+
+	#ifdef ZIXEL_SIMD_X86
+
+	//Four pixels at a time. Pixels are kept packed as 32-bit lanes and split into one float vector per channel.
+	static s32 BlendKernel_blendSSE2(u8* _dest, const u8* _source, s32 _start, s32 _count, BlendMode _blendMode, const u8* _opacityTable, bool _makeEmptyPixelsBlack, BlendSpanResult& _result, s32* _columnCounts) {
+
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 scale = _mm_set1_ps(255.0f);
+		const __m128i channelMask = _mm_set1_epi32(0xFF);
+		const __m128i zeroInt = _mm_setzero_si128();
+
+		s32 i = _start;
+		for (; i + 4 <= _count; i += 4) {
+
+			u8* dst = _dest + ((size_t)i * 4);
+			const u8* src = _source + ((size_t)i * 4);
+
+			__m128i s;
+
+			if (_opacityTable != nullptr) {
+
+				alignas(16) u8 temp[16];
+				memcpy(temp, src, 16);
+
+				temp[3] = _opacityTable[temp[3]];
+				temp[7] = _opacityTable[temp[7]];
+				temp[11] = _opacityTable[temp[11]];
+				temp[15] = _opacityTable[temp[15]];
+
+				s = _mm_load_si128((const __m128i*)temp);
+
+			}
+			else {
+				s = _mm_loadu_si128((const __m128i*)src);
+			}
+
+			__m128i d = _mm_loadu_si128((const __m128i*)dst);
+
+			__m128i sAlphaInt = _mm_srli_epi32(s, 24);
+			__m128i dAlphaInt = _mm_srli_epi32(d, 24);
+
+			__m128i sTransparent = _mm_cmpeq_epi32(sAlphaInt, zeroInt);
+			__m128i dTransparent = _mm_cmpeq_epi32(dAlphaInt, zeroInt);
+
+			__m128i blended;
+
+			if (_blendMode == BlendMode::Overwrite) {
+				blended = s;
+			}
+			else {
+
+				s32 sTransparentBits = _mm_movemask_ps(_mm_castsi128_ps(sTransparent));
+				if (sTransparentBits == 0xF) continue;
+
+				if (_mm_movemask_ps(_mm_castsi128_ps(dTransparent)) == 0xF) {
+
+					//(x / 255.0f) * 255.0f truncates back to x for every 8-bit value, so blending onto empty pixels just yields the source.
+					blended = s;
+
+				}
+				else {
+
+					__m128 sRed = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(s, channelMask)), scale);
+					__m128 sGreen = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(s, 8), channelMask)), scale);
+					__m128 sBlue = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(s, 16), channelMask)), scale);
+					__m128 sAlpha = _mm_div_ps(_mm_cvtepi32_ps(sAlphaInt), scale);
+
+					__m128 dRed = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(d, channelMask)), scale);
+					__m128 dGreen = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(d, 8), channelMask)), scale);
+					__m128 dBlue = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(d, 16), channelMask)), scale);
+					__m128 dAlpha = _mm_div_ps(_mm_cvtepi32_ps(dAlphaInt), scale);
+
+					__m128 bRed = sRed, bGreen = sGreen, bBlue = sBlue;
+
+					switch (_blendMode) {
+
+					case BlendMode::Multiply: {
+
+						__m128 invDAlpha = _mm_sub_ps(one, dAlpha);
+
+						bRed = _mm_mul_ps(bRed, _mm_add_ps(dRed, _mm_mul_ps(_mm_sub_ps(one, dRed), invDAlpha)));
+						bGreen = _mm_mul_ps(bGreen, _mm_add_ps(dGreen, _mm_mul_ps(_mm_sub_ps(one, dGreen), invDAlpha)));
+						bBlue = _mm_mul_ps(bBlue, _mm_add_ps(dBlue, _mm_mul_ps(_mm_sub_ps(one, dBlue), invDAlpha)));
+
+						break;
+
+					}
+
+					case BlendMode::Additive:
+
+						bRed = _mm_min_ps(_mm_add_ps(bRed, _mm_mul_ps(dRed, dAlpha)), one);
+						bGreen = _mm_min_ps(_mm_add_ps(bGreen, _mm_mul_ps(dGreen, dAlpha)), one);
+						bBlue = _mm_min_ps(_mm_add_ps(bBlue, _mm_mul_ps(dBlue, dAlpha)), one);
+
+						break;
+
+					case BlendMode::Subtractive:
+
+						bRed = _mm_max_ps(_mm_sub_ps(bRed, _mm_mul_ps(dRed, dAlpha)), zero);
+						bGreen = _mm_max_ps(_mm_sub_ps(bGreen, _mm_mul_ps(dGreen, dAlpha)), zero);
+						bBlue = _mm_max_ps(_mm_sub_ps(bBlue, _mm_mul_ps(dBlue, dAlpha)), zero);
+
+						break;
+
+					default:
+						break;
+
+					}
+
+					__m128 invSAlpha = _mm_sub_ps(one, sAlpha);
+					__m128 denom = _mm_add_ps(sAlpha, _mm_mul_ps(dAlpha, invSAlpha));
+
+					bRed = _mm_div_ps(_mm_add_ps(_mm_mul_ps(bRed, sAlpha), _mm_mul_ps(_mm_mul_ps(dRed, dAlpha), invSAlpha)), denom);
+					bGreen = _mm_div_ps(_mm_add_ps(_mm_mul_ps(bGreen, sAlpha), _mm_mul_ps(_mm_mul_ps(dGreen, dAlpha), invSAlpha)), denom);
+					bBlue = _mm_div_ps(_mm_add_ps(_mm_mul_ps(bBlue, sAlpha), _mm_mul_ps(_mm_mul_ps(dBlue, dAlpha), invSAlpha)), denom);
+
+					//Color::blendColor only mixes with the destination if it's visible.
+					__m128 dVisible = _mm_castsi128_ps(_mm_andnot_si128(dTransparent, _mm_set1_epi32(-1)));
+
+					bRed = _mm_or_ps(_mm_and_ps(dVisible, bRed), _mm_andnot_ps(dVisible, sRed));
+					bGreen = _mm_or_ps(_mm_and_ps(dVisible, bGreen), _mm_andnot_ps(dVisible, sGreen));
+					bBlue = _mm_or_ps(_mm_and_ps(dVisible, bBlue), _mm_andnot_ps(dVisible, sBlue));
+
+					__m128 bAlpha = _mm_add_ps(dAlpha, _mm_mul_ps(_mm_sub_ps(one, dAlpha), sAlpha));
+
+					bRed = _mm_min_ps(_mm_max_ps(bRed, zero), one);
+					bGreen = _mm_min_ps(_mm_max_ps(bGreen, zero), one);
+					bBlue = _mm_min_ps(_mm_max_ps(bBlue, zero), one);
+					bAlpha = _mm_min_ps(_mm_max_ps(bAlpha, zero), one);
+
+					blended = _mm_cvttps_epi32(_mm_mul_ps(bRed, scale));
+					blended = _mm_or_si128(blended, _mm_slli_epi32(_mm_cvttps_epi32(_mm_mul_ps(bGreen, scale)), 8));
+					blended = _mm_or_si128(blended, _mm_slli_epi32(_mm_cvttps_epi32(_mm_mul_ps(bBlue, scale)), 16));
+					blended = _mm_or_si128(blended, _mm_slli_epi32(_mm_cvttps_epi32(_mm_mul_ps(bAlpha, scale)), 24));
+
+				}
+
+				//Transparent source pixels leave the destination untouched.
+				blended = _mm_or_si128(_mm_and_si128(sTransparent, d), _mm_andnot_si128(sTransparent, blended));
+
+			}
+
+			__m128i changed = _mm_andnot_si128(_mm_cmpeq_epi32(blended, d), _mm_set1_epi32(-1));
+			if (_mm_movemask_ps(_mm_castsi128_ps(changed)) == 0) continue;
+
+			_result.modified = true;
+
+			__m128i bTransparent = _mm_cmpeq_epi32(_mm_srli_epi32(blended, 24), zeroInt);
+			if (_makeEmptyPixelsBlack) blended = _mm_andnot_si128(_mm_and_si128(changed, bTransparent), blended);
+
+			_mm_storeu_si128((__m128i*)dst, blended);
+
+			s32 added = _mm_movemask_ps(_mm_castsi128_ps(_mm_andnot_si128(bTransparent, dTransparent)));
+			s32 removed = _mm_movemask_ps(_mm_castsi128_ps(_mm_andnot_si128(dTransparent, bTransparent)));
+
+			BlendKernel_addResultMask(_result, _columnCounts, i, added, removed);
+
+		}
+
+		return i;
+
+	}
+
+	//Same as the SSE2 path, eight pixels at a time.
+	ZIXEL_TARGET_AVX2 static s32 BlendKernel_blendAVX2(u8* _dest, const u8* _source, s32 _start, s32 _count, BlendMode _blendMode, const u8* _opacityTable, bool _makeEmptyPixelsBlack, BlendSpanResult& _result, s32* _columnCounts) {
+
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 scale = _mm256_set1_ps(255.0f);
+		const __m256i channelMask = _mm256_set1_epi32(0xFF);
+		const __m256i zeroInt = _mm256_setzero_si256();
+		const __m256i allBits = _mm256_set1_epi32(-1);
+
+		s32 i = _start;
+		for (; i + 8 <= _count; i += 8) {
+
+			u8* dst = _dest + ((size_t)i * 4);
+			const u8* src = _source + ((size_t)i * 4);
+
+			__m256i s;
+
+			if (_opacityTable != nullptr) {
+
+				alignas(32) u8 temp[32];
+				memcpy(temp, src, 32);
+
+				for (s32 j = 3; j < 32; j += 4) temp[j] = _opacityTable[temp[j]];
+
+				s = _mm256_load_si256((const __m256i*)temp);
+
+			}
+			else {
+				s = _mm256_loadu_si256((const __m256i*)src);
+			}
+
+			__m256i d = _mm256_loadu_si256((const __m256i*)dst);
+
+			__m256i sAlphaInt = _mm256_srli_epi32(s, 24);
+			__m256i dAlphaInt = _mm256_srli_epi32(d, 24);
+
+			__m256i sTransparent = _mm256_cmpeq_epi32(sAlphaInt, zeroInt);
+			__m256i dTransparent = _mm256_cmpeq_epi32(dAlphaInt, zeroInt);
+
+			__m256i blended;
+
+			if (_blendMode == BlendMode::Overwrite) {
+				blended = s;
+			}
+			else {
+
+				if (_mm256_movemask_ps(_mm256_castsi256_ps(sTransparent)) == 0xFF) continue;
+
+				if (_mm256_movemask_ps(_mm256_castsi256_ps(dTransparent)) == 0xFF) {
+					blended = s;
+				}
+				else {
+
+					__m256 sRed = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_and_si256(s, channelMask)), scale);
+					__m256 sGreen = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(s, 8), channelMask)), scale);
+					__m256 sBlue = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(s, 16), channelMask)), scale);
+					__m256 sAlpha = _mm256_div_ps(_mm256_cvtepi32_ps(sAlphaInt), scale);
+
+					__m256 dRed = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_and_si256(d, channelMask)), scale);
+					__m256 dGreen = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(d, 8), channelMask)), scale);
+					__m256 dBlue = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(d, 16), channelMask)), scale);
+					__m256 dAlpha = _mm256_div_ps(_mm256_cvtepi32_ps(dAlphaInt), scale);
+
+					__m256 bRed = sRed, bGreen = sGreen, bBlue = sBlue;
+
+					switch (_blendMode) {
+
+					case BlendMode::Multiply: {
+
+						__m256 invDAlpha = _mm256_sub_ps(one, dAlpha);
+
+						bRed = _mm256_mul_ps(bRed, _mm256_add_ps(dRed, _mm256_mul_ps(_mm256_sub_ps(one, dRed), invDAlpha)));
+						bGreen = _mm256_mul_ps(bGreen, _mm256_add_ps(dGreen, _mm256_mul_ps(_mm256_sub_ps(one, dGreen), invDAlpha)));
+						bBlue = _mm256_mul_ps(bBlue, _mm256_add_ps(dBlue, _mm256_mul_ps(_mm256_sub_ps(one, dBlue), invDAlpha)));
+
+						break;
+
+					}
+
+					case BlendMode::Additive:
+
+						bRed = _mm256_min_ps(_mm256_add_ps(bRed, _mm256_mul_ps(dRed, dAlpha)), one);
+						bGreen = _mm256_min_ps(_mm256_add_ps(bGreen, _mm256_mul_ps(dGreen, dAlpha)), one);
+						bBlue = _mm256_min_ps(_mm256_add_ps(bBlue, _mm256_mul_ps(dBlue, dAlpha)), one);
+
+						break;
+
+					case BlendMode::Subtractive:
+
+						bRed = _mm256_max_ps(_mm256_sub_ps(bRed, _mm256_mul_ps(dRed, dAlpha)), zero);
+						bGreen = _mm256_max_ps(_mm256_sub_ps(bGreen, _mm256_mul_ps(dGreen, dAlpha)), zero);
+						bBlue = _mm256_max_ps(_mm256_sub_ps(bBlue, _mm256_mul_ps(dBlue, dAlpha)), zero);
+
+						break;
+
+					default:
+						break;
+
+					}
+
+					__m256 invSAlpha = _mm256_sub_ps(one, sAlpha);
+					__m256 denom = _mm256_add_ps(sAlpha, _mm256_mul_ps(dAlpha, invSAlpha));
+
+					bRed = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(bRed, sAlpha), _mm256_mul_ps(_mm256_mul_ps(dRed, dAlpha), invSAlpha)), denom);
+					bGreen = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(bGreen, sAlpha), _mm256_mul_ps(_mm256_mul_ps(dGreen, dAlpha), invSAlpha)), denom);
+					bBlue = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(bBlue, sAlpha), _mm256_mul_ps(_mm256_mul_ps(dBlue, dAlpha), invSAlpha)), denom);
+
+					__m256 dTransparentMask = _mm256_castsi256_ps(dTransparent);
+
+					bRed = _mm256_blendv_ps(bRed, sRed, dTransparentMask);
+					bGreen = _mm256_blendv_ps(bGreen, sGreen, dTransparentMask);
+					bBlue = _mm256_blendv_ps(bBlue, sBlue, dTransparentMask);
+
+					__m256 bAlpha = _mm256_add_ps(dAlpha, _mm256_mul_ps(_mm256_sub_ps(one, dAlpha), sAlpha));
+
+					bRed = _mm256_min_ps(_mm256_max_ps(bRed, zero), one);
+					bGreen = _mm256_min_ps(_mm256_max_ps(bGreen, zero), one);
+					bBlue = _mm256_min_ps(_mm256_max_ps(bBlue, zero), one);
+					bAlpha = _mm256_min_ps(_mm256_max_ps(bAlpha, zero), one);
+
+					blended = _mm256_cvttps_epi32(_mm256_mul_ps(bRed, scale));
+					blended = _mm256_or_si256(blended, _mm256_slli_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(bGreen, scale)), 8));
+					blended = _mm256_or_si256(blended, _mm256_slli_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(bBlue, scale)), 16));
+					blended = _mm256_or_si256(blended, _mm256_slli_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(bAlpha, scale)), 24));
+
+				}
+
+				blended = _mm256_blendv_epi8(blended, d, sTransparent);
+
+			}
+
+			__m256i changed = _mm256_xor_si256(_mm256_cmpeq_epi32(blended, d), allBits);
+			if (_mm256_movemask_ps(_mm256_castsi256_ps(changed)) == 0) continue;
+
+			_result.modified = true;
+
+			__m256i bTransparent = _mm256_cmpeq_epi32(_mm256_srli_epi32(blended, 24), zeroInt);
+			if (_makeEmptyPixelsBlack) blended = _mm256_andnot_si256(_mm256_and_si256(changed, bTransparent), blended);
+
+			_mm256_storeu_si256((__m256i*)dst, blended);
+
+			s32 added = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_andnot_si256(bTransparent, dTransparent)));
+			s32 removed = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_andnot_si256(dTransparent, bTransparent)));
+
+			BlendKernel_addResultMask(_result, _columnCounts, i, added, removed);
+
+		}
+
+		return i;
+
+	}
+
+	//Rounded division by 255 of eight 16-bit lanes, same as Color::div255.
+	static inline __m128i BlendKernel_div255(__m128i _value) {
+
+		_value = _mm_add_epi16(_value, _mm_set1_epi16(128));
+		return _mm_srli_epi16(_mm_add_epi16(_value, _mm_srli_epi16(_value, 8)), 8);
+
+	}
+
+	static inline __m128i BlendKernel_broadcastAlpha(__m128i _pixels) {
+		return _mm_shufflehi_epi16(_mm_shufflelo_epi16(_pixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	}
+
+	//Two premultiplied pixels widened to 16 bits per channel.
+	static inline __m128i BlendKernel_blendPremultipliedPair(__m128i _source, __m128i _dest, BlendMode _blendMode) {
+
+		const __m128i max = _mm_set1_epi16(255);
+		const __m128i alphaMask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+
+		__m128i sAlpha = BlendKernel_broadcastAlpha(_source);
+		__m128i dAlpha = BlendKernel_broadcastAlpha(_dest);
+
+		__m128i under = BlendKernel_div255(_mm_mullo_epi16(_dest, _mm_sub_epi16(max, sAlpha)));
+		__m128i alpha = _mm_add_epi16(sAlpha, BlendKernel_div255(_mm_mullo_epi16(dAlpha, _mm_sub_epi16(max, sAlpha))));
+
+		__m128i value;
+
+		switch (_blendMode) {
+
+		case BlendMode::Multiply:
+			value = _mm_add_epi16(_mm_add_epi16(BlendKernel_div255(_mm_mullo_epi16(_source, _mm_sub_epi16(max, dAlpha))), BlendKernel_div255(_mm_mullo_epi16(_source, _dest))), under);
+			break;
+
+		case BlendMode::Additive:
+			value = _mm_add_epi16(_mm_min_epi16(_mm_add_epi16(_source, BlendKernel_div255(_mm_mullo_epi16(_dest, sAlpha))), sAlpha), under);
+			break;
+
+		case BlendMode::Subtractive:
+			value = _mm_add_epi16(_mm_subs_epu16(_source, BlendKernel_div255(_mm_mullo_epi16(_dest, sAlpha))), under);
+			break;
+
+		default:
+			value = _mm_add_epi16(_source, under);
+			break;
+
+		}
+
+		value = _mm_min_epi16(value, alpha);
+
+		return _mm_or_si128(_mm_and_si128(alphaMask, alpha), _mm_andnot_si128(alphaMask, value));
+
+	}
+
+	static s32 BlendKernel_blendPremultipliedSSE2(u8* _dest, const u8* _source, s32 _start, s32 _count, BlendMode _blendMode, const u8* _opacityTable, BlendSpanResult& _result, s32* _columnCounts) {
+
+		const __m128i zeroInt = _mm_setzero_si128();
+
+		s32 i = _start;
+		for (; i + 4 <= _count; i += 4) {
+
+			u8* dst = _dest + ((size_t)i * 4);
+			const u8* src = _source + ((size_t)i * 4);
+
+			__m128i s;
+
+			if (_opacityTable != nullptr) {
+
+				alignas(16) u8 temp[16];
+				for (s32 j = 0; j < 16; ++j) temp[j] = _opacityTable[src[j]];
+
+				s = _mm_load_si128((const __m128i*)temp);
+
+			}
+			else {
+				s = _mm_loadu_si128((const __m128i*)src);
+			}
+
+			__m128i d = _mm_loadu_si128((const __m128i*)dst);
+
+			__m128i sTransparent = _mm_cmpeq_epi32(_mm_srli_epi32(s, 24), zeroInt);
+			__m128i dTransparent = _mm_cmpeq_epi32(_mm_srli_epi32(d, 24), zeroInt);
+
+			__m128i blended;
+
+			if (_blendMode == BlendMode::Overwrite) {
+				blended = s;
+			}
+			else {
+
+				if (_mm_movemask_ps(_mm_castsi128_ps(sTransparent)) == 0xF) continue;
+
+				__m128i low = BlendKernel_blendPremultipliedPair(_mm_unpacklo_epi8(s, zeroInt), _mm_unpacklo_epi8(d, zeroInt), _blendMode);
+				__m128i high = BlendKernel_blendPremultipliedPair(_mm_unpackhi_epi8(s, zeroInt), _mm_unpackhi_epi8(d, zeroInt), _blendMode);
+
+				blended = _mm_packus_epi16(low, high);
+
+				//Transparent source pixels leave the destination untouched.
+				blended = _mm_or_si128(_mm_and_si128(sTransparent, d), _mm_andnot_si128(sTransparent, blended));
+
+			}
+
+			__m128i changed = _mm_andnot_si128(_mm_cmpeq_epi32(blended, d), _mm_set1_epi32(-1));
+			if (_mm_movemask_ps(_mm_castsi128_ps(changed)) == 0) continue;
+
+			_result.modified = true;
+
+			_mm_storeu_si128((__m128i*)dst, blended);
+
+			__m128i bTransparent = _mm_cmpeq_epi32(_mm_srli_epi32(blended, 24), zeroInt);
+
+			s32 added = _mm_movemask_ps(_mm_castsi128_ps(_mm_andnot_si128(bTransparent, dTransparent)));
+			s32 removed = _mm_movemask_ps(_mm_castsi128_ps(_mm_andnot_si128(dTransparent, bTransparent)));
+
+			BlendKernel_addResultMask(_result, _columnCounts, i, added, removed);
+
+		}
+
+		return i;
+
+	}
+
+	static s32 BlendKernel_premultiplySSE2(u8* _dest, const u8* _source, s32 _count) {
+
+		const __m128i zeroInt = _mm_setzero_si128();
+		const __m128i alphaMask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+
+		s32 i = 0;
+		for (; i + 4 <= _count; i += 4) {
+
+			__m128i pixels = _mm_loadu_si128((const __m128i*)(_source + ((size_t)i * 4)));
+
+			__m128i low = _mm_unpacklo_epi8(pixels, zeroInt);
+			__m128i high = _mm_unpackhi_epi8(pixels, zeroInt);
+
+			low = _mm_or_si128(_mm_and_si128(alphaMask, low), _mm_andnot_si128(alphaMask, BlendKernel_div255(_mm_mullo_epi16(low, BlendKernel_broadcastAlpha(low)))));
+			high = _mm_or_si128(_mm_and_si128(alphaMask, high), _mm_andnot_si128(alphaMask, BlendKernel_div255(_mm_mullo_epi16(high, BlendKernel_broadcastAlpha(high)))));
+
+			_mm_storeu_si128((__m128i*)(_dest + ((size_t)i * 4)), _mm_packus_epi16(low, high));
+
+		}
+
+		return i;
+
+	}
+
+	#endif
+
+	void BlendKernel::createOpacityTable(f32 _opacity, u8* _table) {
+
+		for (s32 i = 0; i < 256; ++i) {
+			_table[i] = (u8)roundf(i * _opacity);
+		}
+
+	}
+
+	void BlendKernel::blendSpan(u8* _dest, const u8* _source, s32 _count, BlendMode _blendMode, const u8* _opacityTable, bool _makeEmptyPixelsBlack, BlendSpanResult& _result, s32* _columnCounts) {
+
+		if (_count <= 0) return;
+
+		s32 start = 0;
+
+		#ifdef ZIXEL_SIMD_X86
+
+		static const bool useAVX2 = CPU::hasAVX2();
+
+		if (useAVX2) start = BlendKernel_blendAVX2(_dest, _source, start, _count, _blendMode, _opacityTable, _makeEmptyPixelsBlack, _result, _columnCounts);
+		start = BlendKernel_blendSSE2(_dest, _source, start, _count, _blendMode, _opacityTable, _makeEmptyPixelsBlack, _result, _columnCounts);
+
+		#endif
+
+		BlendKernel_blendScalar(_dest, _source, start, _count, _blendMode, _opacityTable, _makeEmptyPixelsBlack, _result, _columnCounts);
+
+	}
+
+	void BlendKernel::blendSpanPremultiplied(u8* _dest, const u8* _source, s32 _count, BlendMode _blendMode, const u8* _opacityTable, BlendSpanResult& _result, s32* _columnCounts) {
+
+		if (_count <= 0) return;
+
+		s32 start = 0;
+
+		#ifdef ZIXEL_SIMD_X86
+		start = BlendKernel_blendPremultipliedSSE2(_dest, _source, start, _count, _blendMode, _opacityTable, _result, _columnCounts);
+		#endif
+
+		BlendKernel_blendPremultipliedScalar(_dest, _source, start, _count, _blendMode, _opacityTable, _result, _columnCounts);
+
+	}
+
+	void BlendKernel::premultiplySpan(u8* _dest, const u8* _source, s32 _count) {
+
+		s32 i = 0;
+
+		#ifdef ZIXEL_SIMD_X86
+		i = BlendKernel_premultiplySSE2(_dest, _source, _count);
+		#endif
+
+		for (; i < _count; ++i) {
+
+			const u8* src = _source + ((size_t)i * 4);
+			Color4 color = Color::premultiply({ src[0], src[1], src[2], src[3] });
+
+			memcpy(_dest + ((size_t)i * 4), &color, 4);
+
+		}
+
+	}
+
+	void BlendKernel::unpremultiplySpan(u8* _dest, const u8* _source, s32 _count) {
+
+		for (s32 i = 0; i < _count; ++i) {
+
+			const u8* src = _source + ((size_t)i * 4);
+			u8* dst = _dest + ((size_t)i * 4);
+
+			//Opaque pixels are the same in both forms.
+			if (src[3] == 255) {
+
+				if (dst != src) memcpy(dst, src, 4);
+				continue;
+
+			}
+
+			Color4 color = Color::unpremultiply({ src[0], src[1], src[2], src[3] });
+			memcpy(dst, &color, 4);
+
+		}
+
+	}
+
+}
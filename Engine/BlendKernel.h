@@ -0,0 +1,42 @@
+/*
+    BlendKernel.h
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#pragma once
+
+#include "Engine/Color.h"
+
+namespace Zixel {
+
+	struct BlendSpanResult {
+
+		bool modified = false;
+		bool removedPixels = false; //True if at least one pixel became fully transparent.
+
+		s32 pixelCountDelta = 0;
+		s32 firstAddedIndex = -1; //First and last pixel in the span that went from transparent to visible.
+		s32 lastAddedIndex = -1;
+
+	};
+
+	//Blends whole spans of RGBA pixels.
+	//Results are bit-exact with Color::blendColor, the SIMD paths perform the same float operations in the same order.
+	//If _columnCounts is set, it's updated with the number of visible pixels gained or lost per pixel of the span.
+	struct BlendKernel {
+
+		static void createOpacityTable(f32 _opacity, u8* _table);
+		static void blendSpan(u8* _dest, const u8* _source, s32 _count, BlendMode _blendMode, const u8* _opacityTable, bool _makeEmptyPixelsBlack, BlendSpanResult& _result, s32* _columnCounts = nullptr);
+
+		//Premultiplied pixels on both sides, bit-exact with Color::blendColorPremultiplied. Integer math only, there's no per pixel division.
+		//The opacity table is applied to every channel. Transparent premultiplied pixels are always zero, so there's no need for _makeEmptyPixelsBlack.
+		static void blendSpanPremultiplied(u8* _dest, const u8* _source, s32 _count, BlendMode _blendMode, const u8* _opacityTable, BlendSpanResult& _result, s32* _columnCounts = nullptr);
+
+		//_dest and _source may be the same.
+		static void premultiplySpan(u8* _dest, const u8* _source, s32 _count);
+		static void unpremultiplySpan(u8* _dest, const u8* _source, s32 _count);
+
+	};
+
+}
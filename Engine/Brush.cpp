@@ -0,0 +1,309 @@
+/*
+    Brush.cpp
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#include "Engine/ZixelPCH.h"
+#include "Engine/Brush.h"
+#include "Engine/MaskBuffer.h"
+#include "Engine/BlendKernel.h"
+#include "Engine/Math.h"
+
+namespace Zixel {
+
+	Brush::Brush(s32 _size, BrushShape _shape) {
+
+		if (_shape == BrushShape::Custom) {
+
+			ZIXEL_WARN("Error in Brush::Brush. Custom brushes have to be created from a mask, using a square brush.");
+			_shape = BrushShape::Square;
+
+		}
+
+		_size = Math::clampInt(_size, 1, ZIXEL_MAX_BRUSH_SIZE);
+
+		width = _size;
+		height = _size;
+		shape = _shape;
+
+		//Slightly smaller radius than half the size, so small round brushes don't end up square.
+		f32 center = _size / 2.0f;
+		f32 radius = center - 0.25f;
+
+		bool row[ZIXEL_MAX_BRUSH_SIZE];
+
+		for (s32 y = 0; y < _size; ++y) {
+
+			for (s32 x = 0; x < _size; ++x) {
+
+				if (shape == BrushShape::Square) {
+
+					row[x] = true;
+					continue;
+
+				}
+
+				f32 deltaX = (x + 0.5f) - center;
+				f32 deltaY = (y + 0.5f) - center;
+
+				row[x] = ((deltaX * deltaX) + (deltaY * deltaY) <= radius * radius);
+
+			}
+
+			__addRow(y, row, _size);
+
+		}
+
+	}
+
+	Brush::Brush(MaskBuffer* _mask) {
+
+		shape = BrushShape::Custom;
+
+		width = Math::minInt(_mask->width, ZIXEL_MAX_BRUSH_SIZE);
+		height = Math::minInt(_mask->height, ZIXEL_MAX_BRUSH_SIZE);
+
+		bool row[ZIXEL_MAX_BRUSH_SIZE];
+
+		for (s32 y = 0; y < height; ++y) {
+
+			for (s32 x = 0; x < width; ++x) {
+				row[x] = _mask->read(x, y);
+			}
+
+			__addRow(y, row, width);
+
+		}
+
+	}
+
+	void Brush::__addRow(s32 _y, const bool* _row, s32 _width) {
+
+		s32 x = 0;
+
+		while (x < _width) {
+
+			if (!_row[x]) {
+
+				++x;
+				continue;
+
+			}
+
+			s32 start = x;
+			while (x < _width && _row[x]) ++x;
+
+			spans.push_back({ start - (width / 2), _y - (height / 2), x - start });
+
+		}
+
+	}
+
+	void BrushStroke::begin(PixelBuffer* _buffer, Brush* _brush, Color4 _color, BlendMode _blendMode) {
+
+		if (active) end();
+
+		buffer = _buffer;
+		brush = _brush;
+		blendMode = _blendMode;
+
+		active = true;
+		modified = false;
+		hasPosition = false;
+
+		if (_buffer->makeEmptyPixelsBlack && _color.a == 0) _color = { 0, 0, 0, 0 };
+		_color = _buffer->__toStored(_color);
+
+		for (s32 i = 0; i < ZIXEL_MAX_BRUSH_SIZE; ++i) {
+			memcpy(source + ((size_t)i * 4), &_color, 4);
+		}
+
+		skipNullTiles = _buffer->__canSkipNullTiles(_color, _blendMode);
+
+		s32 words = (_buffer->width + 63) / 64;
+		size_t size = (size_t)words * (size_t)_buffer->height;
+
+		//The coverage is kept between strokes, it's cleared again after each one.
+		if (words != wordsPerRow || covered.size() != size) {
+
+			wordsPerRow = words;
+			covered.assign(size, 0);
+
+		}
+
+		coveredTop = -1;
+		coveredBottom = -1;
+
+		bands.resize(1);
+		bands[0] = PixelBufferBand();
+		_buffer->__prepareBands(bands);
+
+	}
+
+	bool BrushStroke::stamp(s32 _x, s32 _y) {
+
+		if (!active) {
+
+			ZIXEL_WARN("Error in BrushStroke::stamp. Stroke hasn't begun.");
+			return false;
+
+		}
+
+		lastX = _x;
+		lastY = _y;
+		hasPosition = true;
+
+		__stamp(_x, _y);
+
+		return __flush();
+
+	}
+
+	bool BrushStroke::lineTo(s32 _x, s32 _y) {
+
+		if (!active) {
+
+			ZIXEL_WARN("Error in BrushStroke::lineTo. Stroke hasn't begun.");
+			return false;
+
+		}
+
+		if (!hasPosition) return stamp(_x, _y);
+
+		s32 x = lastX, y = lastY;
+
+		s32 deltaX = Math::absInt(_x - x);
+		s32 deltaY = Math::absInt(_y - y);
+
+		s32 signedX = (x < _x) ? 1 : -1;
+		s32 signedY = (y < _y) ? 1 : -1;
+
+		s32 err = deltaX - deltaY;
+
+		while (x != _x || y != _y) {
+
+			s32 err2 = err * 2;
+
+			if (err2 > -deltaY) {
+
+				err -= deltaY;
+				x += signedX;
+
+			}
+
+			if (err2 < deltaX) {
+
+				err += deltaX;
+				y += signedY;
+
+			}
+
+			__stamp(x, y);
+
+		}
+
+		lastX = _x;
+		lastY = _y;
+
+		return __flush();
+
+	}
+
+	bool BrushStroke::end() {
+
+		if (!active) return false;
+
+		__flush();
+
+		if (coveredTop != -1) {
+
+			size_t first = (size_t)coveredTop * (size_t)wordsPerRow;
+			size_t last = (size_t)(coveredBottom + 1) * (size_t)wordsPerRow;
+
+			std::fill(covered.begin() + first, covered.begin() + last, (u64)0);
+
+		}
+
+		coveredTop = -1;
+		coveredBottom = -1;
+
+		active = false;
+
+		return modified;
+
+	}
+
+	void BrushStroke::__stamp(s32 _x, s32 _y) {
+
+		s32 bufferWidth = buffer->width;
+		s32 bufferHeight = buffer->height;
+
+		for (const BrushSpan& brushSpan : brush->spans) {
+
+			s32 y = _y + brushSpan.y;
+			if (y < 0 || y >= bufferHeight) continue;
+
+			s32 left = Math::maxInt(_x + brushSpan.x, 0);
+			s32 right = Math::minInt(_x + brushSpan.x + brushSpan.count, bufferWidth);
+
+			if (left >= right) continue;
+
+			if (coveredTop == -1 || y < coveredTop) coveredTop = y;
+			if (y > coveredBottom) coveredBottom = y;
+
+			u64* row = covered.data() + ((size_t)y * (size_t)wordsPerRow);
+			s32 x = left, end = 0;
+
+			//Alternates between skipping covered pixels and writing uncovered ones, a whole word at a time.
+			while (MaskBuffer::findRun(row, x, right, end, false)) {
+
+				MaskBuffer::writeBits(row, x, end, true);
+				__writeSpan(x, y, end - x);
+
+				x = end;
+
+			}
+
+		}
+
+	}
+
+	void BrushStroke::__writeSpan(s32 _x, s32 _y, s32 _count) {
+
+		PixelBufferBand& band = bands[0];
+
+		RowSpan span;
+		RowSpanIterator it = buffer->rowSpans(_x, _y, _count, 1);
+
+		while (it.next(span)) {
+
+			if (span.nullTile && skipNullTiles) continue;
+
+			BlendSpanResult result;
+			buffer->__blendSpan(buffer->pixelPtrWrite(span.x, span.y), source, span.count, blendMode, nullptr, result, (band.columnCountsPtr != nullptr) ? (band.columnCountsPtr + span.x) : nullptr);
+
+			buffer->__applyBlendSpanResult(result, span.x, span.y, span.count, band);
+
+		}
+
+	}
+
+	bool BrushStroke::__flush() {
+
+		PixelBufferBand& band = bands[0];
+		bool changed = band.modified;
+
+		if (changed) modified = true;
+
+		buffer->__reduceBands(bands);
+
+		s32* columnCounts = band.columnCountsPtr;
+		band = PixelBufferBand();
+		band.columnCountsPtr = columnCounts;
+
+		return changed;
+
+	}
+
+}
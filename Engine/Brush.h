@@ -0,0 +1,82 @@
+/*
+    Brush.h
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "Engine/Color.h"
+#include "Engine/PixelBuffer.h"
+#include "Engine/ZixelMacros.h"
+
+namespace Zixel {
+
+	struct MaskBuffer;
+
+	enum class BrushShape : u8 {
+
+		Round,
+		Square,
+		Custom,
+
+	};
+
+	//Horizontal run of brush pixels, relative to the brush center.
+	struct BrushSpan {
+		s32 x = 0, y = 0, count = 0;
+	};
+
+	//Brush mask precomputed as horizontal spans, top to bottom.
+	struct Brush {
+
+		s32 width = 0, height = 0;
+		BrushShape shape = BrushShape::Round;
+
+		std::vector<BrushSpan> spans;
+
+		Brush(s32 _size, BrushShape _shape = BrushShape::Round); //Size is clamped to 1-ZIXEL_MAX_BRUSH_SIZE.
+		Brush(MaskBuffer* _mask); //Custom shape, centered on the mask. Masks larger than ZIXEL_MAX_BRUSH_SIZE are cropped.
+
+		void __addRow(s32 _y, const bool* _row, s32 _width);
+
+	};
+
+	//Stamps a brush along a stroke, one span at a time.
+	//Every pixel is written at most once per stroke, so overlapping stamps don't build up when blending.
+	//Pixel count and bbox are updated once per stamp or lineTo, dirty tracking once per span.
+	struct BrushStroke {
+
+		PixelBuffer* buffer = nullptr;
+		Brush* brush = nullptr;
+		BlendMode blendMode = BlendMode::Normal;
+
+		u8 source[ZIXEL_MAX_BRUSH_SIZE * 4] = {}; //One row of the stroke color, in the alpha mode of the buffer.
+		bool skipNullTiles = false;
+
+		bool active = false;
+		bool modified = false;
+		bool hasPosition = false;
+		s32 lastX = 0, lastY = 0;
+
+		//One bit per buffer pixel that has been written this stroke. Only the rows between coveredTop and coveredBottom are cleared again.
+		s32 wordsPerRow = 0;
+		std::vector<u64> covered;
+		s32 coveredTop = -1, coveredBottom = -1;
+
+		std::vector<PixelBufferBand> bands; //Always a single band, kept around so spans don't allocate.
+
+		void begin(PixelBuffer* _buffer, Brush* _brush, Color4 _color, BlendMode _blendMode = BlendMode::Normal);
+		bool stamp(s32 _x, s32 _y); //Stamps at _x, _y and makes it the current position. Returns true if the buffer changed.
+		bool lineTo(s32 _x, s32 _y); //Stamps every position on the line from the current position to _x, _y. The first call after begin only stamps _x, _y.
+		bool end(); //Returns true if the stroke changed the buffer.
+
+		void __stamp(s32 _x, s32 _y);
+		void __writeSpan(s32 _x, s32 _y, s32 _count);
+		bool __flush();
+
+	};
+
+}
@@ -0,0 +1,101 @@
+/*
+    CPU.cpp
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#include "Engine/ZixelPCH.h"
+#include "Engine/CPU.h"
+
+#ifdef ZIXEL_SIMD_X86
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+		#include <immintrin.h>
+	#endif
+#endif
+
+namespace Zixel {
+
+	struct CPUFeatures {
+
+		bool sse2 = false;
+		bool avx2 = false;
+
+	};
+
+	#ifdef ZIXEL_SIMD_X86
+
+	static void CPU_cpuid(s32 _info[4], s32 _function, s32 _subFunction) {
+
+		#if defined(_MSC_VER)
+		__cpuidex(_info, _function, _subFunction);
+		#else
+		__cpuid_count(_function, _subFunction, _info[0], _info[1], _info[2], _info[3]);
+		#endif
+
+	}
+
+	static u64 CPU_xgetbv() {
+
+		#if defined(_MSC_VER)
+		return _xgetbv(0);
+		#else
+		u32 eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return ((u64)edx << 32) | eax;
+		#endif
+
+	}
+
+	#endif
+
+	static CPUFeatures CPU_detect() {
+
+		CPUFeatures features;
+
+		#ifdef ZIXEL_SIMD_X86
+
+		s32 info[4] = { 0, 0, 0, 0 };
+		CPU_cpuid(info, 0, 0);
+		s32 maxFunction = info[0];
+
+		if (maxFunction < 1) return features;
+
+		CPU_cpuid(info, 1, 0);
+		features.sse2 = ((info[3] & (1 << 26)) != 0);
+
+		bool osxsave = ((info[2] & (1 << 27)) != 0);
+		bool avx = ((info[2] & (1 << 28)) != 0);
+
+		//The OS has to save the YMM registers on context switches, otherwise AVX can't be used even if the CPU supports it.
+		if (maxFunction >= 7 && osxsave && avx && (CPU_xgetbv() & 0x06) == 0x06) {
+
+			CPU_cpuid(info, 7, 0);
+			features.avx2 = ((info[1] & (1 << 5)) != 0);
+
+		}
+
+		#endif
+
+		return features;
+
+	}
+
+	static const CPUFeatures& CPU_getFeatures() {
+
+		static CPUFeatures features = CPU_detect();
+		return features;
+
+	}
+
+	bool CPU::hasSSE2() {
+		return CPU_getFeatures().sse2;
+	}
+
+	bool CPU::hasAVX2() {
+		return CPU_getFeatures().avx2;
+	}
+
+}
@@ -0,0 +1,29 @@
+/*
+    CPU.h
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define ZIXEL_SIMD_X86
+#endif
+
+//MSVC allows AVX2 intrinsics anywhere, GCC and Clang need the target to be enabled per function.
+#if defined(_MSC_VER) && !defined(__clang__)
+	#define ZIXEL_TARGET_AVX2
+#else
+	#define ZIXEL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace Zixel {
+
+	struct CPU {
+
+		static bool hasSSE2();
+		static bool hasAVX2();
+
+	};
+
+}
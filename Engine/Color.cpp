@@ -276,6 +276,84 @@ namespace Zixel {
 
 	}
 
+	u8 Color::div255(u32 _value) {
+
+		_value += 128;
+		return (u8)((_value + (_value >> 8)) >> 8);
+
+	}
+
+	Color4 Color::premultiply(Color4 _color) {
+		return { div255((u32)_color.r * _color.a), div255((u32)_color.g * _color.a), div255((u32)_color.b * _color.a), _color.a };
+	}
+
+	Color4 Color::unpremultiply(Color4 _color) {
+
+		if (_color.a == 0) return { 0, 0, 0, 0 };
+		if (_color.a == 255) return _color;
+
+		u32 half = _color.a / 2;
+
+		return {
+			(u8)Math::minInt((s32)(((u32)_color.r * 255 + half) / _color.a), 255),
+			(u8)Math::minInt((s32)(((u32)_color.g * 255 + half) / _color.a), 255),
+			(u8)Math::minInt((s32)(((u32)_color.b * 255 + half) / _color.a), 255),
+			_color.a
+		};
+
+	}
+
+	static inline u8 Color_blendChannelPremultiplied(u32 _source, u32 _destination, u32 _sourceAlpha, u32 _destinationAlpha, u32 _alpha, BlendMode _blendMode) {
+
+		u32 under = Color::div255(_destination * (255 - _sourceAlpha));
+		u32 value;
+
+		switch (_blendMode) {
+
+		case BlendMode::Multiply:
+			value = Color::div255(_source * (255 - _destinationAlpha)) + Color::div255(_source * _destination) + under;
+			break;
+
+		case BlendMode::Additive:
+			value = Math::minInt((s32)(_source + Color::div255(_destination * _sourceAlpha)), (s32)_sourceAlpha) + under;
+			break;
+
+		case BlendMode::Subtractive: {
+
+			u32 subtract = Color::div255(_destination * _sourceAlpha);
+			value = ((_source > subtract) ? (_source - subtract) : 0) + under;
+
+			break;
+
+		}
+
+		default:
+			value = _source + under;
+			break;
+
+		}
+
+		//Rounding can push the color past alpha by one.
+		return (u8)Math::minInt((s32)value, (s32)_alpha);
+
+	}
+
+	Color4 Color::blendColorPremultiplied(Color4 _source, Color4 _destination, BlendMode _blendMode) {
+
+		if (_blendMode == BlendMode::Overwrite) return _source;
+		if (_source.a == 0) return _destination;
+
+		u32 alpha = _source.a + div255((u32)_destination.a * (255 - _source.a));
+
+		return {
+			Color_blendChannelPremultiplied(_source.r, _destination.r, _source.a, _destination.a, alpha, _blendMode),
+			Color_blendChannelPremultiplied(_source.g, _destination.g, _source.a, _destination.a, alpha, _blendMode),
+			Color_blendChannelPremultiplied(_source.b, _destination.b, _source.a, _destination.a, alpha, _blendMode),
+			(u8)alpha
+		};
+
+	}
+
 	u8 Color::subtractAlpha(u8 _source, u8 _destination) {
 
 		if (_source == 0) {
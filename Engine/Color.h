@@ -77,6 +77,14 @@ namespace Zixel {
 		static Color3 hexToRGB(std::string& _hex);
 		static u8 RGBToLum(Color3 _rgb);
 		static Color4 blendColor(Color4 _source, Color4 _destination, BlendMode _blendMode);
+
+		//Premultiplied colors store red, green and blue already multiplied by alpha, so they're never larger than alpha.
+		//Going from premultiplied to straight and back is lossless. The other way around is only lossless for opaque pixels, lower alpha can't hold all 256 values per channel.
+		static u8 div255(u32 _value); //Rounded _value / 255 without a division, _value can't exceed 255 * 255.
+		static Color4 premultiply(Color4 _color);
+		static Color4 unpremultiply(Color4 _color);
+		static Color4 blendColorPremultiplied(Color4 _source, Color4 _destination, BlendMode _blendMode); //Same blend modes as blendColor, using integers only.
+
 		static u8 subtractAlpha(u8 _source, u8 _destination);
 
 	};
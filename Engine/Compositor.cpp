@@ -0,0 +1,476 @@
+/*
+    Compositor.cpp
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#include "Engine/ZixelPCH.h"
+#include "Engine/Compositor.h"
+#include "Engine/PixelBuffer.h"
+#include "Engine/BlendKernel.h"
+#include "Engine/Math.h"
+
+namespace Zixel {
+
+	Compositor::Compositor(s32 _width, s32 _height) {
+
+		if (_width < 1 || _height < 1) {
+
+			ZIXEL_WARN("Error in Compositor::Compositor. Size cannot be less than 1: {}x{}", _width, _height);
+			return;
+
+		}
+
+		width = _width;
+		height = _height;
+
+		tileColumns = (width + ZIXEL_CHUNK_SIZE - 1) / ZIXEL_CHUNK_SIZE;
+		tileRows = (height + ZIXEL_CHUNK_SIZE - 1) / ZIXEL_CHUNK_SIZE;
+
+		root = __createGroup();
+
+	}
+
+	Compositor::~Compositor() {
+		if (root != nullptr) __deleteLayer(root);
+	}
+
+	CompositorLayer* Compositor::addLayer(PixelBuffer* _buffer, s32 _index, CompositorLayer* _group) {
+
+		if (_buffer == nullptr || _buffer->width != width || _buffer->height != height) {
+
+			ZIXEL_WARN("Error in Compositor::addLayer. Layer buffer must have the same size as the compositor ({}, {}).", width, height);
+			return nullptr;
+
+		}
+
+		CompositorLayer* layer = new CompositorLayer();
+		layer->buffer = _buffer;
+
+		if (!__insertLayer(layer, _index, _group, "addLayer")) {
+
+			delete layer;
+			return nullptr;
+
+		}
+
+		layer->seenChanges.record(_buffer);
+		invalidateLayer(layer);
+
+		return layer;
+
+	}
+
+	CompositorLayer* Compositor::addGroup(s32 _index, CompositorLayer* _group) {
+
+		CompositorLayer* group = __createGroup();
+
+		if (!__insertLayer(group, _index, _group, "addGroup")) {
+
+			__deleteLayer(group);
+			return nullptr;
+
+		}
+
+		return group;
+
+	}
+
+	void Compositor::removeLayer(CompositorLayer* _layer) {
+
+		s32 index = getLayerIndex(_layer);
+
+		if (index == -1) {
+
+			ZIXEL_WARN("Error in Compositor::removeLayer. Layer doesn't belong to this compositor.");
+			return;
+
+		}
+
+		__invalidateChanges(_layer);
+		invalidateLayer(_layer);
+
+		std::vector<CompositorLayer*>& siblings = _layer->parent->children;
+		siblings.erase(siblings.begin() + index);
+
+		__deleteLayer(_layer);
+
+	}
+
+	void Compositor::moveLayer(CompositorLayer* _layer, s32 _index, CompositorLayer* _group) {
+
+		s32 index = getLayerIndex(_layer);
+		if (index == -1) return;
+
+		if (_group == nullptr) _group = root;
+
+		if (!_group->isGroup()) {
+
+			ZIXEL_WARN("Error in Compositor::moveLayer. Target is not a group.");
+			return;
+
+		}
+
+		for (CompositorLayer* group = _group; group != nullptr; group = group->parent) {
+
+			if (group == _layer) {
+
+				ZIXEL_WARN("Error in Compositor::moveLayer. Can't move a group into itself.");
+				return;
+
+			}
+
+		}
+
+		if (_group == _layer->parent) {
+
+			_index = Math::clampInt(_index, 0, (s32)_group->children.size() - 1);
+			if (index == _index) return;
+
+		}
+		else if ((s32)_group->children.size() >= ZIXEL_MAX_LAYER_COUNT) {
+
+			ZIXEL_WARN("Error in Compositor::moveLayer. Layer count can't exceed {}.", ZIXEL_MAX_LAYER_COUNT);
+			return;
+
+		}
+
+		//Pending edits belong to the old position.
+		__invalidateChanges(_layer);
+		invalidateLayer(_layer);
+
+		std::vector<CompositorLayer*>& siblings = _layer->parent->children;
+		siblings.erase(siblings.begin() + index);
+
+		if (_index < 0 || _index > (s32)_group->children.size()) _index = (s32)_group->children.size();
+
+		_group->children.insert(_group->children.begin() + _index, _layer);
+		_layer->parent = _group;
+
+		//Blending order only changes where the moved layer has pixels.
+		invalidateLayer(_layer);
+
+	}
+
+	s32 Compositor::getLayerIndex(CompositorLayer* _layer) {
+
+		if (_layer == nullptr || _layer->parent == nullptr) return -1;
+
+		std::vector<CompositorLayer*>& siblings = _layer->parent->children;
+
+		for (size_t i = 0; i < siblings.size(); ++i) {
+			if (siblings[i] == _layer) return (s32)i;
+		}
+
+		return -1;
+
+	}
+
+	void Compositor::setLayerVisible(CompositorLayer* _layer, bool _visible) {
+
+		if (_layer->visible == _visible) return;
+
+		//Hidden layers aren't checked for edits, so pending ones are picked up while the old state still applies.
+		__invalidateChanges(_layer);
+
+		_layer->visible = _visible;
+		invalidateLayer(_layer);
+
+	}
+
+	void Compositor::setLayerOpacity(CompositorLayer* _layer, f32 _opacity) {
+
+		_opacity = Math::clampFloat(_opacity, 0.0f, 1.0f);
+		if (_layer->opacity == _opacity) return;
+
+		_layer->opacity = _opacity;
+		if (_layer->visible) invalidateLayer(_layer);
+
+	}
+
+	void Compositor::setLayerBlendMode(CompositorLayer* _layer, BlendMode _blendMode) {
+
+		if (_layer->blendMode == _blendMode) return;
+
+		//Overwrite affects the whole group, so switching from it has to invalidate all of it too.
+		if (_layer->visible && _layer->blendMode == BlendMode::Overwrite && _layer->parent != nullptr) __invalidateTiles(_layer->parent, 0, 0, width, height);
+
+		_layer->blendMode = _blendMode;
+		if (_layer->visible) invalidateLayer(_layer);
+
+	}
+
+	void Compositor::invalidateRect(s32 _x, s32 _y, s32 _width, s32 _height) {
+		__invalidateTiles(root, _x, _y, _width, _height);
+	}
+
+	void Compositor::invalidateLayer(CompositorLayer* _layer) {
+
+		CompositorLayer* group = _layer->parent;
+		PixelBuffer* buffer = _layer->buffer;
+
+		if (group == nullptr) {
+
+			invalidateAll();
+			return;
+
+		}
+
+		if (_layer->blendMode == BlendMode::Overwrite) {
+
+			__invalidateTiles(group, 0, 0, width, height);
+			return;
+
+		}
+
+		//A group covers what's in its cache plus the tiles that are about to be composited.
+		if (_layer->isGroup()) {
+
+			for (s32 tileY = 0; tileY < tileRows; ++tileY) {
+
+				for (s32 tileX = 0; tileX < tileColumns; ++tileX) {
+
+					if (buffer->getTile(tileX, tileY) == PixelTile::getNull() && !_layer->invalidTiles[((size_t)tileY * (size_t)tileColumns) + (size_t)tileX]) continue;
+					__invalidateTiles(group, tileX * ZIXEL_CHUNK_SIZE, tileY * ZIXEL_CHUNK_SIZE, ZIXEL_CHUNK_SIZE, ZIXEL_CHUNK_SIZE);
+
+				}
+
+			}
+
+			return;
+
+		}
+
+		if (buffer->pixelCount == 0) return;
+
+		if (buffer->isTiled()) {
+
+			for (s32 tileY = 0; tileY < tileRows; ++tileY) {
+
+				for (s32 tileX = 0; tileX < tileColumns; ++tileX) {
+					if (buffer->getTile(tileX, tileY) != PixelTile::getNull()) __invalidateTiles(group, tileX * ZIXEL_CHUNK_SIZE, tileY * ZIXEL_CHUNK_SIZE, ZIXEL_CHUNK_SIZE, ZIXEL_CHUNK_SIZE);
+				}
+
+			}
+
+			return;
+
+		}
+
+		//Pixel counts are always up to date, unlike the bbox which callers may skip calculating.
+		if (!buffer->__hasPixelCounts()) {
+
+			__invalidateTiles(group, 0, 0, width, height);
+			return;
+
+		}
+
+		s32 top = 0, bottom = height - 1, left = 0, right = width - 1;
+
+		while (top < bottom && buffer->rowPixelCounts[top] == 0) ++top;
+		while (bottom > top && buffer->rowPixelCounts[bottom] == 0) --bottom;
+		while (left < right && buffer->columnPixelCounts[left] == 0) ++left;
+		while (right > left && buffer->columnPixelCounts[right] == 0) --right;
+
+		__invalidateTiles(group, left, top, right - left + 1, bottom - top + 1);
+
+	}
+
+	void Compositor::invalidateAll() {
+		__invalidateTiles(root, 0, 0, width, height);
+	}
+
+	bool Compositor::update() {
+		return __updateGroup(root);
+	}
+
+	PixelBuffer* Compositor::getResult() {
+		return root->buffer;
+	}
+
+	CompositorLayer* Compositor::__createGroup() {
+
+		CompositorLayer* group = new CompositorLayer();
+		group->type = LayerType::Group;
+		group->buffer = new PixelBuffer(width, height, { 0, 0, 0, 0 }, true, true, PixelStorage::Tiled);
+		group->invalidTiles.assign((size_t)tileColumns * (size_t)tileRows, 0);
+
+		return group;
+
+	}
+
+	void Compositor::__deleteLayer(CompositorLayer* _layer) {
+
+		for (CompositorLayer* child : _layer->children) {
+			__deleteLayer(child);
+		}
+
+		if (_layer->isGroup()) delete _layer->buffer;
+		delete _layer;
+
+	}
+
+	bool Compositor::__insertLayer(CompositorLayer* _layer, s32 _index, CompositorLayer* _group, const char* _caller) {
+
+		if (_group == nullptr) _group = root;
+
+		if (!_group->isGroup()) {
+
+			ZIXEL_WARN("Error in Compositor::{}. Parent is not a group.", _caller);
+			return false;
+
+		}
+
+		if ((s32)_group->children.size() >= ZIXEL_MAX_LAYER_COUNT) {
+
+			ZIXEL_WARN("Error in Compositor::{}. Layer count can't exceed {}.", _caller, ZIXEL_MAX_LAYER_COUNT);
+			return false;
+
+		}
+
+		if (_index < 0 || _index > (s32)_group->children.size()) _index = (s32)_group->children.size();
+
+		_group->children.insert(_group->children.begin() + _index, _layer);
+		_layer->parent = _group;
+
+		return true;
+
+	}
+
+	void Compositor::__invalidateTiles(CompositorLayer* _group, s32 _x, s32 _y, s32 _width, s32 _height) {
+
+		//A group's cache only changes within the invalidated tiles, so its parent needs the same tiles composited again.
+		for (CompositorLayer* group = _group; group != nullptr; group = group->parent) {
+
+			if (!PixelBuffer::markTiles(group->invalidTiles, width, height, _x, _y, _width, _height)) return;
+			group->hasInvalidTiles = true;
+
+			if (!group->visible) break;
+
+		}
+
+	}
+
+	void Compositor::__invalidateChanges(CompositorLayer* _layer) {
+
+		if (_layer->isGroup()) {
+
+			for (CompositorLayer* child : _layer->children) {
+				if (child->visible) __invalidateChanges(child);
+			}
+
+			return;
+
+		}
+
+		//Dirty blocks line up with the tiles.
+		_layer->seenChanges.collect(_layer->buffer, [&](s32 _block) {
+			__invalidateTiles(_layer->parent, (_block % tileColumns) * ZIXEL_CHUNK_SIZE, (_block / tileColumns) * ZIXEL_CHUNK_SIZE, ZIXEL_CHUNK_SIZE, ZIXEL_CHUNK_SIZE);
+		});
+
+	}
+
+	bool Compositor::__updateGroup(CompositorLayer* _group) {
+
+		//Children are brought up to date first, since their caches are what gets composited here.
+		for (CompositorLayer* child : _group->children) {
+
+			if (!child->visible) continue;
+
+			if (child->isGroup()) __updateGroup(child);
+			else __invalidateChanges(child);
+
+		}
+
+		if (!_group->hasInvalidTiles) return false;
+
+		std::vector<s32> tiles;
+
+		for (size_t i = 0; i < _group->invalidTiles.size(); ++i) {
+			if (_group->invalidTiles[i]) tiles.push_back((s32)i);
+		}
+
+		std::fill(_group->invalidTiles.begin(), _group->invalidTiles.end(), (u8)0);
+		_group->hasInvalidTiles = false;
+
+		std::vector<CompositorLayer*>& children = _group->children;
+
+		std::vector<u8> opacityTableData(children.size() * 256);
+		std::vector<const u8*> opacityTables(children.size(), nullptr);
+
+		for (size_t i = 0; i < children.size(); ++i) {
+
+			if (children[i]->opacity == 1.0f) continue;
+
+			BlendKernel::createOpacityTable(children[i]->opacity, opacityTableData.data() + (i * 256));
+			opacityTables[i] = opacityTableData.data() + (i * 256);
+
+		}
+
+		PixelBuffer* buffer = _group->buffer;
+
+		bool changed = buffer->writeTiles(tiles, [&](s32 _tileX, s32 _tileY, u8* _out) {
+
+			__compositeTile(_group, _tileX, _tileY, opacityTables, _out);
+			return true;
+
+		});
+
+		//Only the result is uploaded, group caches don't need dirty tracking.
+		if (_group != root) buffer->clearDirty();
+
+		return changed;
+
+	}
+
+	void Compositor::__compositeTile(CompositorLayer* _group, s32 _tileX, s32 _tileY, const std::vector<const u8*>& _opacityTables, u8* _out) {
+
+		s32 x = _tileX * ZIXEL_CHUNK_SIZE;
+		s32 y = _tileY * ZIXEL_CHUNK_SIZE;
+		s32 w = Math::minInt(ZIXEL_CHUNK_SIZE, width - x);
+		s32 h = Math::minInt(ZIXEL_CHUNK_SIZE, height - y);
+
+		const size_t stride = (size_t)ZIXEL_CHUNK_SIZE * 4;
+		memset(_out, 0, stride * ZIXEL_CHUNK_SIZE);
+
+		u8 converted[ZIXEL_CHUNK_SIZE * 4]; //Rows of layers stored in another alpha mode than the group.
+
+		std::vector<CompositorLayer*>& children = _group->children;
+
+		for (size_t i = 0; i < children.size(); ++i) {
+
+			CompositorLayer* layer = children[i];
+			PixelBuffer* buffer = layer->buffer;
+
+			if (!layer->visible) continue;
+
+			//Transparent pixels only change what's below them when overwriting.
+			if (layer->blendMode != BlendMode::Overwrite) {
+
+				if (layer->opacity <= 0.0f || buffer->pixelCount == 0) continue;
+				if (buffer->isNullTileAt(x, y)) continue;
+
+			}
+
+			//Rows of a tile aligned block are contiguous in both storage modes.
+			for (s32 row = 0; row < h; ++row) {
+
+				const u8* source = buffer->pixelPtr(x, y + row);
+
+				if (buffer->alphaMode != _group->buffer->alphaMode) {
+
+					_group->buffer->__convertSpan(converted, source, w, buffer->alphaMode);
+					source = converted;
+
+				}
+
+				BlendSpanResult blendResult;
+				_group->buffer->__blendSpan(_out + ((size_t)row * stride), source, w, layer->blendMode, _opacityTables[i], blendResult, nullptr);
+
+			}
+
+		}
+
+	}
+
+}
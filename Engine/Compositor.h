@@ -0,0 +1,85 @@
+/*
+    Compositor.h
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "Engine/Color.h"
+#include "Engine/PixelBuffer.h"
+#include "Engine/ZixelMacros.h"
+
+namespace Zixel {
+
+	struct CompositorLayer {
+
+		LayerType type = LayerType::Layer;
+
+		//Layers don't own their buffer, it must be the same size as the compositor.
+		//Groups own a tiled buffer caching their composited children.
+		PixelBuffer* buffer = nullptr;
+
+		BlendMode blendMode = BlendMode::Normal;
+		f32 opacity = 1.0f;
+		bool visible = true;
+
+		CompositorLayer* parent = nullptr; //nullptr for the root group.
+		std::vector<CompositorLayer*> children; //Groups only, bottom to top.
+
+		std::vector<u8> invalidTiles; //Groups only, tiles of the cached buffer that have to be composited again.
+		bool hasInvalidTiles = false;
+
+		SeenChanges seenChanges; //Layers only, what the compositor has seen of the buffer.
+
+		inline bool isGroup() { return (type == LayerType::Group); }
+
+	};
+
+	//Flattens a tree of layers into a tiled buffer, one ZIXEL_CHUNK_SIZE tile at a time.
+	//Every group caches its composited children, update only composites the tiles that were invalidated by an edit or a layer change since the last update.
+	//Invalidation travels up the tree through visible groups only, so nothing below a hidden group is looked at until it's shown again.
+	//Edits are picked up from the change counts of the layer buffers, which leaves their dirty rects to the surface uploads. Tiles the compositor changes are marked dirty in the result.
+	struct Compositor {
+
+		s32 width = 0, height = 0;
+		s32 tileColumns = 0, tileRows = 0;
+
+		CompositorLayer* root = nullptr; //Top level group, its buffer is the result.
+
+		Compositor(s32 _width, s32 _height);
+		~Compositor();
+
+		//_group nullptr means the top level. _index -1 adds on top.
+		CompositorLayer* addLayer(PixelBuffer* _buffer, s32 _index = -1, CompositorLayer* _group = nullptr);
+		CompositorLayer* addGroup(s32 _index = -1, CompositorLayer* _group = nullptr);
+		void removeLayer(CompositorLayer* _layer); //Removing a group removes its children too.
+		void moveLayer(CompositorLayer* _layer, s32 _index, CompositorLayer* _group = nullptr);
+		s32 getLayerIndex(CompositorLayer* _layer); //Index within the parent group.
+
+		void setLayerVisible(CompositorLayer* _layer, bool _visible);
+		void setLayerOpacity(CompositorLayer* _layer, f32 _opacity);
+		void setLayerBlendMode(CompositorLayer* _layer, BlendMode _blendMode);
+
+		void invalidateRect(s32 _x, s32 _y, s32 _width, s32 _height); //Composites the top level again, groups keep their cache.
+		void invalidateLayer(CompositorLayer* _layer); //Invalidates the tiles the layer has visible pixels in.
+		void invalidateAll();
+
+		bool update(); //Returns true if the result changed.
+		PixelBuffer* getResult();
+
+		CompositorLayer* __createGroup();
+		void __deleteLayer(CompositorLayer* _layer);
+		bool __insertLayer(CompositorLayer* _layer, s32 _index, CompositorLayer* _group, const char* _caller);
+
+		void __invalidateTiles(CompositorLayer* _group, s32 _x, s32 _y, s32 _width, s32 _height); //Propagates to the parent while the group is visible.
+		void __invalidateChanges(CompositorLayer* _layer); //Invalidates the tiles the layer buffer changed in since the last look, or of every layer below a group.
+
+		bool __updateGroup(CompositorLayer* _group);
+		void __compositeTile(CompositorLayer* _group, s32 _tileX, s32 _tileY, const std::vector<const u8*>& _opacityTables, u8* _out);
+
+	};
+
+}
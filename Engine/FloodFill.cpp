@@ -0,0 +1,367 @@
+/*
+    FloodFill.cpp
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#include "Engine/ZixelPCH.h"
+#include "Engine/FloodFill.h"
+#include "Engine/MaskBuffer.h"
+#include "Engine/BlendKernel.h"
+#include "Engine/CPU.h"
+#include "Engine/JobSystem.h"
+#include "Engine/Math.h"
+
+#include <bitset>
+
+#ifdef ZIXEL_SIMD_X86
+	#include <immintrin.h>
+#endif
+
+namespace Zixel {
+
+	//Blocks have to lie inside a single tile, so null tiles can be matched a whole block at a time.
+	static_assert(ZIXEL_CHUNK_SIZE % 64 == 0, "FloodFill blocks must not cross tile boundaries.");
+
+	struct FloodFillSegment {
+		s32 y = 0, left = 0, right = 0;
+	};
+
+	//Bit i is set if pixel i of the row matches the seed.
+	static u64 FloodFill_matchRow(const u8* _pixels, s32 _count, const u8* _seed, u8 _tolerance) {
+
+		u64 bits = 0;
+		s32 i = 0;
+
+		bool seedEmpty = (_seed[3] == 0);
+
+		#ifdef ZIXEL_SIMD_X86
+
+		u32 seedValue;
+		memcpy(&seedValue, _seed, 4);
+
+		const __m128i seed = _mm_set1_epi32((s32)seedValue);
+		const __m128i tolerance = _mm_set1_epi8((char)_tolerance);
+		const __m128i alphaMask = _mm_set1_epi32((s32)0xFF000000);
+		const __m128i zero = _mm_setzero_si128();
+
+		for (; i + 4 <= _count; i += 4) {
+
+			__m128i pixels = _mm_loadu_si128((const __m128i*)(_pixels + ((size_t)i * 4)));
+
+			//Absolute difference per channel, anything left after subtracting the tolerance is out of range.
+			__m128i diff = _mm_or_si128(_mm_subs_epu8(pixels, seed), _mm_subs_epu8(seed, pixels));
+			__m128i match = _mm_cmpeq_epi32(_mm_subs_epu8(diff, tolerance), zero);
+
+			if (seedEmpty) match = _mm_or_si128(match, _mm_cmpeq_epi32(_mm_and_si128(pixels, alphaMask), zero));
+
+			bits |= (u64)_mm_movemask_ps(_mm_castsi128_ps(match)) << i;
+
+		}
+
+		#endif
+
+		for (; i < _count; ++i) {
+
+			const u8* pixel = _pixels + ((size_t)i * 4);
+
+			bool match = (seedEmpty && pixel[3] == 0);
+
+			if (!match) {
+
+				match = true;
+
+				for (s32 c = 0; c < 4 && match; ++c) {
+					match = (Math::absInt((s32)pixel[c] - (s32)_seed[c]) <= (s32)_tolerance);
+				}
+
+			}
+
+			if (match) bits |= (u64)1 << i;
+
+		}
+
+		return bits;
+
+	}
+
+	bool FloodFillRegion::find(PixelBuffer* _buffer, s32 _x, s32 _y, u8 _tolerance, FloodFillMode _mode) {
+
+		if (_x < 0 || _y < 0 || _x >= _buffer->width || _y >= _buffer->height) return false;
+
+		buffer = _buffer;
+		tolerance = _tolerance;
+		memcpy(seed, _buffer->pixelPtr(_x, _y), 4);
+
+		wordsPerRow = (_buffer->width + 63) / 64;
+		blockRows = (_buffer->height + 63) / 64;
+
+		top = -1;
+		bottom = -1;
+		filledCount = 0;
+
+		size_t size = (size_t)wordsPerRow * (size_t)_buffer->height;
+
+		matches.assign(size, 0);
+		filled.assign(size, 0);
+		computedBlocks.assign((size_t)wordsPerRow * (size_t)blockRows, 0);
+
+		if (_mode == FloodFillMode::Global) __fillGlobal();
+		else __fillContiguous(_x, _y);
+
+		return true;
+
+	}
+
+	s32 FloodFillRegion::__computeBlocks(s32 _blockY, s32 _firstBlockX, s32 _lastBlockX) {
+
+		s32 blockTop = _blockY * 64;
+		s32 blockBottom = Math::minInt(blockTop + 64, buffer->height);
+
+		static const u8 empty[4] = {};
+		u64 emptyBits = (FloodFill_matchRow(empty, 1, seed, tolerance) != 0) ? ~(u64)0 : 0;
+
+		s32 matchCount = 0;
+
+		auto computeRow = [&](s32 _blockX, s32 _y) {
+
+			s32 left = _blockX * 64;
+			s32 count = Math::minInt(64, buffer->width - left);
+
+			u64 bits;
+
+			if (buffer->isNullTileAt(left, _y)) bits = emptyBits & ((count == 64) ? ~(u64)0 : ((((u64)1) << count) - 1));
+			else bits = FloodFill_matchRow(buffer->pixelPtr(left, _y), count, seed, tolerance);
+
+			matches[((size_t)_y * (size_t)wordsPerRow) + (size_t)_blockX] = bits;
+			matchCount += (s32)std::bitset<64>(bits).count();
+
+		};
+
+		//Block by block in tiled buffers and row by row in contiguous ones, so both are read in memory order.
+		if (buffer->isTiled()) {
+
+			for (s32 blockX = _firstBlockX; blockX < _lastBlockX; ++blockX) {
+				for (s32 y = blockTop; y < blockBottom; ++y) computeRow(blockX, y);
+			}
+
+		}
+		else {
+
+			for (s32 y = blockTop; y < blockBottom; ++y) {
+				for (s32 blockX = _firstBlockX; blockX < _lastBlockX; ++blockX) computeRow(blockX, y);
+			}
+
+		}
+
+		for (s32 blockX = _firstBlockX; blockX < _lastBlockX; ++blockX) {
+			computedBlocks[((size_t)_blockY * (size_t)wordsPerRow) + (size_t)blockX] = 1;
+		}
+
+		return matchCount;
+
+	}
+
+	u64 FloodFillRegion::__open(s32 _word, s32 _y) {
+
+		if (computedBlocks[((size_t)(_y / 64) * (size_t)wordsPerRow) + (size_t)_word] == 0) __computeBlocks(_y / 64, _word, _word + 1);
+
+		size_t index = ((size_t)_y * (size_t)wordsPerRow) + (size_t)_word;
+		return matches[index] & ~filled[index];
+
+	}
+
+	//Span stack scanline fill. Each segment is a range of a row next to a filled run, every open run touching it gets filled and pushes the rows above and below.
+	void FloodFillRegion::__fillContiguous(s32 _x, s32 _y) {
+
+		s32 height = buffer->height;
+
+		std::vector<FloodFillSegment> stack;
+		stack.push_back({ _y, _x, _x + 1 });
+
+		while (!stack.empty()) {
+
+			FloodFillSegment segment = stack.back();
+			stack.pop_back();
+
+			s32 y = segment.y;
+			s32 x = segment.left, end = 0;
+			auto open = [this, y](s32 _word) { return __open(_word, y); };
+
+			//Skips to the next open pixel a word at a time, the run may continue past the segment.
+			while (MaskBuffer::findComputedRun(open, x, segment.right, end, buffer->width)) {
+
+				//Extends the run to the left, past the segment if needed.
+				s32 start = x;
+
+				while (start > 0) {
+
+					s32 word = (start - 1) >> 6;
+					u64 closed = ~__open(word, y) & (~(u64)0 >> (63 - ((start - 1) & 63)));
+
+					if (closed != 0) {
+
+						start = (word * 64) + (64 - Math::countLeadingZeros(closed));
+						break;
+
+					}
+
+					start = word * 64;
+
+				}
+
+				MaskBuffer::writeBits(filled.data() + ((size_t)y * (size_t)wordsPerRow), start, end, true);
+				filledCount += end - start;
+
+				if (top == -1 || y < top) top = y;
+				if (y > bottom) bottom = y;
+
+				if (y > 0) stack.push_back({ y - 1, start, end });
+				if (y < height - 1) stack.push_back({ y + 1, start, end });
+
+				x = end;
+
+			}
+
+		}
+
+	}
+
+	void FloodFillRegion::__fillGlobal() {
+
+		std::vector<s32> rowMatches((size_t)blockRows, 0);
+
+		JobSystem::parallelFor(0, blockRows, 1, [&](s32 _first, s32 _last) {
+			for (s32 i = _first; i < _last; ++i) rowMatches[i] = __computeBlocks(i, 0, wordsPerRow);
+		});
+
+		filled = matches;
+
+		for (s32 count : rowMatches) filledCount += count;
+
+		if (filledCount > 0) {
+
+			top = 0;
+			bottom = buffer->height - 1;
+
+		}
+
+	}
+
+	bool FloodFill::select(PixelBuffer* _buffer, s32 _x, s32 _y, u8 _tolerance, FloodFillMode _mode, MaskBuffer* _mask, bool _value) {
+
+		FloodFillRegion region;
+		if (!region.find(_buffer, _x, _y, _tolerance, _mode) || region.top == -1) return false;
+
+		//Mask rows use the same word layout as the region.
+		s32 bottom = Math::minInt(region.bottom, _mask->height - 1);
+		s32 words = Math::minInt(region.wordsPerRow, _mask->wordsPerRow);
+
+		for (s32 y = region.top; y <= bottom; ++y) {
+
+			const u64* row = region.getRow(y);
+			u64* maskRow = _mask->rowPtr(y);
+
+			for (s32 word = 0; word < words; ++word) {
+
+				if (_value) maskRow[word] |= row[word];
+				else maskRow[word] &= ~row[word];
+
+			}
+
+			maskRow[_mask->wordsPerRow - 1] &= _mask->lastWordMask;
+
+		}
+
+		return true;
+
+	}
+
+	bool FloodFill::fill(PixelBuffer* _buffer, s32 _x, s32 _y, Color4 _color, u8 _tolerance, FloodFillMode _mode, BlendMode _blendMode, bool _calculateBBox) {
+
+		FloodFillRegion region;
+		if (!region.find(_buffer, _x, _y, _tolerance, _mode) || region.top == -1) return false;
+
+		if (_buffer->makeEmptyPixelsBlack && _color.a == 0) _color = { 0, 0, 0, 0 };
+
+		Color4 stored = _buffer->__toStored(_color);
+
+		//Nothing outside the region is left to keep. The start pixel changes, so the buffer is modified.
+		if (region.isFull() && _blendMode == BlendMode::Overwrite && memcmp(&stored, region.seed, 4) != 0) {
+
+			_buffer->fill(_color);
+			return true;
+
+		}
+
+		_color = stored;
+
+		//One word of the fill color, runs never span more than that.
+		u8 source[64 * 4];
+
+		for (s32 i = 0; i < 64; ++i) {
+			memcpy(source + ((size_t)i * 4), &_color, 4);
+		}
+
+		bool skipNullTiles = _buffer->__canSkipNullTiles(_color, _blendMode);
+
+		s32 bandRows = _buffer->__getBandRows(region.top, region.bottom + 1, _buffer->width);
+
+		std::vector<PixelBufferBand> bands((size_t)_buffer->__getBandCount(region.top, region.bottom + 1, bandRows));
+		_buffer->__prepareBands(bands);
+
+		_buffer->__forEachBand(region.top, region.bottom + 1, bandRows, [&](s32 _band, s32 _top, s32 _bottom) {
+
+			PixelBufferBand& band = bands[_band];
+
+			for (s32 y = _top; y < _bottom; ++y) {
+
+				const u64* row = region.getRow(y);
+
+				for (s32 word = 0; word < region.wordsPerRow; ++word) {
+
+					u64 bits = row[word];
+					if (bits == 0 || (skipNullTiles && _buffer->isNullTileAt(word * 64, y))) continue;
+
+					while (bits != 0) {
+
+						s32 first = Math::countTrailingZeros(bits);
+						u64 rest = ~bits & (~(u64)0 << first);
+						s32 last = (rest == 0) ? 64 : Math::countTrailingZeros(rest);
+
+						s32 x = (word * 64) + first;
+						s32 count = last - first;
+
+						BlendSpanResult result;
+						_buffer->__blendSpan(_buffer->pixelPtrWrite(x, y), source, count, _blendMode, nullptr, result, (band.columnCountsPtr != nullptr) ? (band.columnCountsPtr + x) : nullptr);
+
+						_buffer->__applyBlendSpanResult(result, x, y, count, band);
+
+						bits &= (last == 64) ? 0 : (~(u64)0 << last);
+
+					}
+
+				}
+
+			}
+
+			if (!_calculateBBox) {
+
+				band.calcBBox = false;
+				band.bBoxLeft = -1;
+
+			}
+
+		});
+
+		_buffer->__reduceBands(bands);
+
+		for (PixelBufferBand& band : bands) {
+			if (band.modified) return true;
+		}
+
+		return false;
+
+	}
+
+}
@@ -0,0 +1,64 @@
+/*
+    FloodFill.h
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "Engine/Color.h"
+#include "Engine/PixelBuffer.h"
+#include "Engine/ZixelMacros.h"
+
+namespace Zixel {
+
+	struct MaskBuffer;
+
+	enum class FloodFillMode : u8 {
+
+		Contiguous, //Pixels connected to the start position, horizontally or vertically.
+		Global, //Every matching pixel in the buffer.
+
+	};
+
+	//Pixels matching the start pixel, one bit per pixel.
+	//Pixels match if every stored channel is within the tolerance of the start pixel. Fully transparent pixels always match each other.
+	//Matches are found one 64x64 block at a time, contiguous fills only look at the blocks they reach.
+	struct FloodFillRegion {
+
+		PixelBuffer* buffer = nullptr;
+		u8 seed[4] = {};
+		u8 tolerance = 0;
+
+		s32 wordsPerRow = 0, blockRows = 0;
+		s32 top = -1, bottom = -1; //Rows that have filled pixels.
+		s64 filledCount = 0;
+
+		std::vector<u64> matches;
+		std::vector<u64> filled;
+		std::vector<u8> computedBlocks; //1 once the matches of a block have been found.
+
+		bool find(PixelBuffer* _buffer, s32 _x, s32 _y, u8 _tolerance, FloodFillMode _mode); //Returns false if the start position is outside the buffer.
+		inline const u64* getRow(s32 _y) { return filled.data() + ((size_t)_y * (size_t)wordsPerRow); }
+		inline bool isFull() { return (filledCount == (s64)buffer->width * (s64)buffer->height); }
+
+		s32 __computeBlocks(s32 _blockY, s32 _firstBlockX, s32 _lastBlockX); //Returns the number of matching pixels.
+		u64 __open(s32 _word, s32 _y); //Matching pixels that aren't filled yet.
+		void __fillContiguous(s32 _x, s32 _y);
+		void __fillGlobal();
+
+	};
+
+	struct FloodFill {
+
+		//Adds the region to the mask without clearing it first, _value false removes it instead. Positions in the mask match positions in the buffer.
+		static bool select(PixelBuffer* _buffer, s32 _x, s32 _y, u8 _tolerance, FloodFillMode _mode, MaskBuffer* _mask, bool _value = true);
+
+		//Returns true if the buffer changed.
+		static bool fill(PixelBuffer* _buffer, s32 _x, s32 _y, Color4 _color, u8 _tolerance = 0, FloodFillMode _mode = FloodFillMode::Contiguous, BlendMode _blendMode = BlendMode::Overwrite, bool _calculateBBox = true);
+
+	};
+
+}
@@ -0,0 +1,425 @@
+/*
+    IndexedBuffer.cpp
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#include "Engine/ZixelPCH.h"
+#include "Engine/IndexedBuffer.h"
+#include "Engine/PixelBuffer.h"
+#include "Engine/CPU.h"
+
+#include <unordered_map>
+
+#ifdef ZIXEL_SIMD_X86
+	#include <immintrin.h>
+#endif
+
+namespace Zixel {
+
+	static u32 IndexedBuffer_packColor(Color4 _color) {
+		return (u32)_color.r | ((u32)_color.g << 8) | ((u32)_color.b << 16) | ((u32)_color.a << 24);
+	}
+
+	static s32 IndexedBuffer_expandScalar(const u8* _indices, bool _wide, const u32* _table, s32 _first, s32 _count, u32* _out) {
+
+		if (_wide) {
+
+			const u16* indices = (const u16*)_indices;
+			for (s32 i = _first; i < _count; ++i) _out[i] = _table[indices[i]];
+
+		}
+		else {
+			for (s32 i = _first; i < _count; ++i) _out[i] = _table[_indices[i]];
+		}
+
+		return _count;
+
+	}
+
+#ifdef ZIXEL_SIMD_X86
+	//Looks up 8 indices at a time with a gather from the color table. Returns how many pixels were written.
+	ZIXEL_TARGET_AVX2 static s32 IndexedBuffer_expandAVX2(const u8* _indices, bool _wide, const u32* _table, s32 _count, u32* _out) {
+
+		s32 i = 0;
+
+		if (_wide) {
+
+			const u16* indices = (const u16*)_indices;
+
+			for (; i + 8 <= _count; i += 8) {
+
+				__m256i index = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(indices + i)));
+				_mm256_storeu_si256((__m256i*)(_out + i), _mm256_i32gather_epi32((const int*)_table, index, 4));
+
+			}
+
+		}
+		else {
+
+			for (; i + 8 <= _count; i += 8) {
+
+				__m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(_indices + i)));
+				_mm256_storeu_si256((__m256i*)(_out + i), _mm256_i32gather_epi32((const int*)_table, index, 4));
+
+			}
+
+		}
+
+		return i;
+
+	}
+#endif
+
+	static void IndexedBuffer_expand(const u8* _indices, bool _wide, const u32* _table, s32 _count, u32* _out) {
+
+		s32 i = 0;
+
+#ifdef ZIXEL_SIMD_X86
+		static const bool useAVX2 = CPU::hasAVX2();
+		if (useAVX2) i = IndexedBuffer_expandAVX2(_indices, _wide, _table, _count, _out);
+#endif
+
+		IndexedBuffer_expandScalar(_indices, _wide, _table, i, _count, _out);
+
+	}
+
+	Color4 Palette::getColor(s32 _index) {
+
+		if (_index < 0 || _index >= getCount()) return { 0, 0, 0, 0 };
+		return colors[_index];
+
+	}
+
+	void Palette::setColor(s32 _index, Color4 _color) {
+
+		if (_index < 0 || _index >= getCount()) {
+
+			ZIXEL_WARN("Error in Palette::setColor. Index {} out of range. Valid range: 0-{}", _index, getCount() - 1);
+			return;
+
+		}
+
+		colors[_index] = _color;
+
+	}
+
+	s32 Palette::addColor(Color4 _color) {
+
+		//16-bit indices can't address more than 65536 colors.
+		if (getCount() >= Math::minInt(ZIXEL_MAX_PALETTE_COUNT, 65536)) return -1;
+
+		colors.push_back(_color);
+		return getCount() - 1;
+
+	}
+
+	s32 Palette::findColor(Color4 _color) {
+
+		for (s32 i = 0; i < getCount(); ++i) {
+
+			const Color4& color = colors[i];
+
+			if (color.a == 0 && _color.a == 0) return i;
+			if (color.r == _color.r && color.g == _color.g && color.b == _color.b && color.a == _color.a) return i;
+
+		}
+
+		return -1;
+
+	}
+
+	IndexedBuffer::IndexedBuffer(s32 _width, s32 _height, Palette* _palette, IndexFormat _format) {
+
+		width = Math::maxInt(_width, 1);
+		height = Math::maxInt(_height, 1);
+		format = _format;
+		palette = _palette;
+
+		data.assign((size_t)width * (size_t)height * ((format == IndexFormat::Index16) ? 2 : 1), 0);
+
+	}
+
+	void IndexedBuffer::fill(s32 _index) {
+
+		if (_index < 0 || _index >= getMaxColorCount()) {
+
+			ZIXEL_WARN("Error in IndexedBuffer::fill. Index {} out of range. Valid range: 0-{}", _index, getMaxColorCount() - 1);
+			return;
+
+		}
+
+		if (format == IndexFormat::Index8) {
+
+			memset(data.data(), _index, data.size());
+			return;
+
+		}
+
+		u16* indices = (u16*)data.data();
+		std::fill(indices, indices + ((size_t)width * (size_t)height), (u16)_index);
+
+	}
+
+	void IndexedBuffer::writeIndex(s32 _x, s32 _y, s32 _index) {
+
+		if (_x < 0 || _y < 0 || _x >= width || _y >= height) {
+
+			ZIXEL_WARN("Error in IndexedBuffer::writeIndex. Write position ({}, {}) out of range. Valid range: (0-{}, 0-{})", _x, _y, width - 1, height - 1);
+			return;
+
+		}
+
+		if (_index < 0 || _index >= getMaxColorCount()) {
+
+			ZIXEL_WARN("Error in IndexedBuffer::writeIndex. Index {} out of range. Valid range: 0-{}", _index, getMaxColorCount() - 1);
+			return;
+
+		}
+
+		size_t pos = ((size_t)_y * (size_t)width) + (size_t)_x;
+
+		if (format == IndexFormat::Index8) data[pos] = (u8)_index;
+		else ((u16*)data.data())[pos] = (u16)_index;
+
+	}
+
+	s32 IndexedBuffer::readIndex(s32 _x, s32 _y) {
+
+		if (_x < 0 || _y < 0 || _x >= width || _y >= height) {
+
+			ZIXEL_WARN("Error in IndexedBuffer::readIndex. Read position ({}, {}) out of range. Valid range: (0-{}, 0-{})", _x, _y, width - 1, height - 1);
+			return 0;
+
+		}
+
+		size_t pos = ((size_t)_y * (size_t)width) + (size_t)_x;
+
+		if (format == IndexFormat::Index8) return data[pos];
+		return ((u16*)data.data())[pos];
+
+	}
+
+	Color4 IndexedBuffer::readPixel(s32 _x, s32 _y) {
+
+		if (_x < 0 || _y < 0 || _x >= width || _y >= height) {
+
+			ZIXEL_WARN("Error in IndexedBuffer::readPixel. Read position ({}, {}) out of range. Valid range: (0-{}, 0-{})", _x, _y, width - 1, height - 1);
+			return { 0, 0, 0, 0 };
+
+		}
+
+		if (palette == nullptr) return { 0, 0, 0, 0 };
+		return palette->getColor(readIndex(_x, _y));
+
+	}
+
+	void IndexedBuffer::__buildColorTable(PixelBuffer* _dest, std::vector<u32>& _table) {
+
+		_table.assign((size_t)getMaxColorCount(), 0);
+		if (palette == nullptr) return;
+
+		s32 count = Math::minInt(palette->getCount(), getMaxColorCount());
+
+		for (s32 i = 0; i < count; ++i) {
+
+			Color4 color = palette->colors[i];
+
+			if (color.a == 0 && _dest->makeEmptyPixelsBlack) continue;
+			_table[i] = IndexedBuffer_packColor(_dest->__toStored(color));
+
+		}
+
+	}
+
+	void IndexedBuffer::toPixelBuffer(PixelBuffer* _dest) {
+
+		if (_dest->width != width || _dest->height != height) {
+
+			ZIXEL_WARN("Error in IndexedBuffer::toPixelBuffer. Destination buffer size ({}x{}) doesn't match ({}x{}).", _dest->width, _dest->height, width, height);
+			return;
+
+		}
+
+		std::vector<u32> table;
+		__buildColorTable(_dest, table);
+
+		//Every pixel is replaced, so the counts and bbox are rebuilt from the written pixels.
+		_dest->pixelCount = 0;
+		_dest->__setBBox(-1, -1, -1, -1);
+		if (_dest->__hasPixelCounts()) _dest->__setPixelCounts(0, 0);
+
+		bool wide = (format == IndexFormat::Index16);
+		size_t indexSize = wide ? 2 : 1;
+		bool tiled = _dest->isTiled();
+
+		s32 bandRows = _dest->__getBandRows(0, height, width);
+		std::vector<PixelBufferBand> bands((size_t)_dest->__getBandCount(0, height, bandRows));
+		_dest->__prepareBands(bands);
+
+		_dest->__forEachBand(0, height, bandRows, [&](s32 _band, s32 _top, s32 _bottom) {
+
+			PixelBufferBand& band = bands[_band];
+			std::vector<u32> scratch(tiled ? ZIXEL_CHUNK_SIZE : 0);
+
+			RowSpan span;
+			RowSpanIterator it = _dest->rowSpans(0, _top, width, _bottom - _top);
+
+			while (it.next(span)) {
+
+				const u8* indices = data.data() + ((((size_t)span.y * (size_t)width) + (size_t)span.x) * indexSize);
+
+				//Tiled spans are expanded into scratch first, so spans that stay empty don't allocate a tile.
+				u32* out = tiled ? scratch.data() : (u32*)span.data;
+				IndexedBuffer_expand(indices, wide, table.data(), span.count, out);
+
+				s32 first = -1, last = -1, visible = 0;
+				u32 anyBits = 0;
+
+				for (s32 i = 0; i < span.count; ++i) {
+
+					anyBits |= out[i];
+					if ((out[i] >> 24) == 0) continue;
+
+					if (first == -1) first = i;
+					last = i;
+
+					++visible;
+					if (band.columnCountsPtr != nullptr) ++band.columnCountsPtr[span.x + i];
+
+				}
+
+				if (tiled && (anyBits != 0 || !span.nullTile)) memcpy(_dest->pixelPtrWrite(span.x, span.y), out, (size_t)span.count * 4);
+				if (first == -1) continue;
+
+				band.pixelCountDelta += visible;
+				if (_dest->__hasPixelCounts()) _dest->rowPixelCounts[span.y] += visible;
+
+				if (_dest->useBBox) {
+
+					band.checkBBoxIncrease(span.x + first, span.y);
+					band.checkBBoxIncrease(span.x + last, span.y);
+
+				}
+
+			}
+
+		});
+
+		_dest->__reduceBands(bands);
+
+		if (tiled) _dest->releaseEmptyTiles();
+		_dest->markAllDirty();
+
+	}
+
+	bool IndexedBuffer::fromPixelBuffer(PixelBuffer* _source, bool _addColors) {
+
+		if (_source->width != width || _source->height != height) {
+
+			ZIXEL_WARN("Error in IndexedBuffer::fromPixelBuffer. Source buffer size ({}x{}) doesn't match ({}x{}).", _source->width, _source->height, width, height);
+			return false;
+
+		}
+
+		if (palette == nullptr) {
+
+			ZIXEL_WARN("Error in IndexedBuffer::fromPixelBuffer. Buffer has no palette.");
+			return false;
+
+		}
+
+		bool wide = (format == IndexFormat::Index16);
+		size_t indexSize = wide ? 2 : 1;
+		s32 maxColors = getMaxColorCount();
+		bool matchedAll = true;
+
+		//Stored colors map to indices, transparent pixels all share key 0.
+		std::unordered_map<u32, s32> indexMap;
+
+		auto findIndex = [&](u32 _stored) -> s32 {
+
+			if ((_stored >> 24) == 0) _stored = 0;
+
+			auto found = indexMap.find(_stored);
+			if (found != indexMap.end()) return found->second;
+
+			Color4 color = _source->__fromStored({ (u8)_stored, (u8)(_stored >> 8), (u8)(_stored >> 16), (u8)(_stored >> 24) });
+			s32 index = palette->findColor(color);
+
+			if (index >= maxColors) index = -1;
+			if (index == -1 && _addColors && palette->getCount() < maxColors) index = palette->addColor(color);
+
+			if (index == -1) {
+
+				matchedAll = false;
+				index = 0;
+
+			}
+
+			indexMap[_stored] = index;
+			return index;
+
+		};
+
+		u32 lastColor = 0;
+		s32 lastIndex = -1;
+
+		RowSpan span;
+		RowSpanIterator it = _source->rowSpans();
+
+		while (it.next(span)) {
+
+			u8* indices = data.data() + ((((size_t)span.y * (size_t)width) + (size_t)span.x) * indexSize);
+			const u32* pixels = (const u32*)span.data;
+
+			s32 i = 0;
+
+			while (i < span.count) {
+
+				u32 color = pixels[i];
+
+				if (lastIndex == -1 || color != lastColor) {
+
+					lastColor = color;
+					lastIndex = findIndex(color);
+
+				}
+
+				//Pixel art is mostly runs of the same color, find where the run ends before writing it.
+				s32 end = i + 1;
+
+#ifdef ZIXEL_SIMD_X86
+				__m128i repeated = _mm_set1_epi32((int)color);
+
+				while (end + 4 <= span.count) {
+
+					s32 equal = _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(pixels + end)), repeated));
+					if (equal != 0xFFFF) {
+
+						end += Math::countTrailingZeros((u64)(~equal & 0xFFFF)) / 4;
+						break;
+
+					}
+
+					end += 4;
+
+				}
+#endif
+
+				while (end < span.count && pixels[end] == color) ++end;
+
+				if (wide) std::fill((u16*)indices + i, (u16*)indices + end, (u16)lastIndex);
+				else memset(indices + i, lastIndex, (size_t)(end - i));
+
+				i = end;
+
+			}
+
+		}
+
+		return matchedAll;
+
+	}
+
+}
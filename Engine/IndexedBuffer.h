@@ -0,0 +1,69 @@
+/*
+    IndexedBuffer.h
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "Engine/Color.h"
+#include "Engine/ZixelMacros.h"
+
+namespace Zixel {
+
+	struct PixelBuffer;
+
+	//Straight colors, shared by every indexed buffer using them.
+	struct Palette {
+
+		std::vector<Color4> colors;
+
+		inline s32 getCount() { return (s32)colors.size(); }
+
+		Color4 getColor(s32 _index); //Transparent black for indices outside the palette.
+		void setColor(s32 _index, Color4 _color); //Buffers using the palette change color without touching their pixels.
+		s32 addColor(Color4 _color); //Returns the new index, or -1 if the palette is full.
+		s32 findColor(Color4 _color); //Exact match, transparent colors all match each other. Returns -1 if the color isn't in the palette.
+
+	};
+
+	enum class IndexFormat : u8 {
+
+		Index8, //Up to 256 colors, a quarter of the memory of RGBA.
+		Index16, //Up to 65536 colors, half the memory of RGBA.
+
+	};
+
+	//Pixels stored as indices into a palette, converted to and from PixelBuffer for editing and drawing.
+	struct IndexedBuffer {
+
+		s32 width = 0, height = 0;
+		IndexFormat format = IndexFormat::Index8;
+
+		Palette* palette = nullptr; //Not owned.
+		std::vector<u8> data; //Row by row, 16-bit indices are stored in native byte order.
+
+		IndexedBuffer(s32 _width, s32 _height, Palette* _palette, IndexFormat _format = IndexFormat::Index8);
+
+		inline s32 getMaxColorCount() { return (format == IndexFormat::Index8) ? 256 : 65536; }
+		inline size_t getMemoryUsage() { return data.size(); }
+
+		void fill(s32 _index);
+		void writeIndex(s32 _x, s32 _y, s32 _index);
+		s32 readIndex(s32 _x, s32 _y);
+		Color4 readPixel(s32 _x, s32 _y);
+
+		//_dest must be the same size. Indices outside the palette become transparent.
+		void toPixelBuffer(PixelBuffer* _dest);
+
+		//Colors that aren't in the palette are added if _addColors is set and there's room.
+		//Returns false if a color couldn't be matched, those pixels get index 0.
+		bool fromPixelBuffer(PixelBuffer* _source, bool _addColors = true);
+
+		void __buildColorTable(PixelBuffer* _dest, std::vector<u32>& _table); //Palette colors in the alpha mode of _dest, one per possible index.
+
+	};
+
+}
@@ -0,0 +1,365 @@
+/*
+    JobSystem.cpp
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#include "Engine/ZixelPCH.h"
+#include "Engine/JobSystem.h"
+#include "Engine/Math.h"
+
+#include <thread>
+#include <deque>
+#include <condition_variable>
+
+namespace Zixel {
+
+	struct JobQueue {
+
+		std::mutex mutex;
+		std::deque<JobHandle> jobs;
+
+	};
+
+	static std::vector<std::thread> JobSystem_workers;
+	static std::vector<std::unique_ptr<JobQueue>> JobSystem_queues; //One per worker, the last one is shared by threads outside the pool.
+
+	static JobQueue JobSystem_backgroundQueue; //Oldest first, only workers with nothing else to do take from it.
+
+	static std::atomic<s32> JobSystem_queuedCount = 0; //Both kinds of queues, wakes up sleeping workers.
+	static std::atomic<bool> JobSystem_stopping = false;
+	static std::mutex JobSystem_sleepMutex;
+	static std::condition_variable JobSystem_sleepCondition;
+
+	static std::mutex JobSystem_mainThreadMutex;
+	static std::vector<std::function<void()>> JobSystem_mainThreadQueue;
+	static std::thread::id JobSystem_mainThreadId = std::this_thread::get_id();
+
+	static thread_local s32 JobSystem_workerIndex = -1;
+
+	bool JobSystem::init(s32 _threadCount) {
+
+		if (!JobSystem_workers.empty()) {
+
+			ZIXEL_WARN("Job system already initialized.");
+			return true;
+
+		}
+
+		if (_threadCount <= 0) _threadCount = Math::maxInt((s32)std::thread::hardware_concurrency() - 1, 0);
+
+		JobSystem_mainThreadId = std::this_thread::get_id();
+		JobSystem_stopping = false;
+
+		for (s32 i = 0; i <= _threadCount; ++i) {
+			JobSystem_queues.push_back(std::make_unique<JobQueue>());
+		}
+
+		for (s32 i = 0; i < _threadCount; ++i) {
+			JobSystem_workers.emplace_back(&JobSystem::__workerLoop, i);
+		}
+
+		ZIXEL_INFO("Initialized job system with {} worker threads.", _threadCount);
+
+		return true;
+
+	}
+
+	void JobSystem::free() {
+
+		{
+			std::lock_guard<std::mutex> lock(JobSystem_sleepMutex);
+			JobSystem_stopping = true;
+		}
+
+		JobSystem_sleepCondition.notify_all();
+
+		for (std::thread& worker : JobSystem_workers) {
+			worker.join();
+		}
+
+		JobSystem_workers.clear();
+
+		//Anything left over runs on this thread, so nobody waits on a job that never finishes.
+		while (__runPendingJob() || __runBackgroundJob());
+
+		JobSystem_queues.clear();
+		drainMainThreadQueue();
+
+		ZIXEL_INFO("Destroyed job system.");
+
+	}
+
+	s32 JobSystem::getThreadCount() {
+		return (s32)JobSystem_workers.size() + 1;
+	}
+
+	bool JobSystem::isMainThread() {
+		return (std::this_thread::get_id() == JobSystem_mainThreadId);
+	}
+
+	JobHandle JobSystem::schedule(std::function<void()> _func, const std::vector<JobHandle>& _dependencies) {
+		return __schedule(std::move(_func), _dependencies, false);
+	}
+
+	JobHandle JobSystem::scheduleBackground(std::function<void()> _func, const std::vector<JobHandle>& _dependencies) {
+		return __schedule(std::move(_func), _dependencies, true);
+	}
+
+	JobHandle JobSystem::__schedule(std::function<void()> _func, const std::vector<JobHandle>& _dependencies, bool _background) {
+
+		JobHandle job = std::make_shared<Job>();
+		job->func = std::move(_func);
+		job->background = _background;
+
+		for (const JobHandle& dependency : _dependencies) {
+
+			if (dependency == nullptr) continue;
+
+			std::lock_guard<std::mutex> lock(dependency->continuationMutex);
+			if (dependency->done) continue;
+
+			job->pendingDependencies.fetch_add(1);
+			dependency->continuations.push_back(job);
+
+		}
+
+		if (job->pendingDependencies.fetch_sub(1) == 1) __push(job);
+
+		return job;
+
+	}
+
+	bool JobSystem::isDone(const JobHandle& _job) {
+		return (_job == nullptr || _job->done);
+	}
+
+	void JobSystem::wait(const JobHandle& _job) {
+
+		while (!isDone(_job)) {
+			if (!__runPendingJob()) std::this_thread::yield();
+		}
+
+	}
+
+	void JobSystem::parallelFor(s32 _begin, s32 _end, s32 _grainSize, const std::function<void(s32, s32)>& _func) {
+
+		if (_end <= _begin) return;
+		if (_grainSize < 1) _grainSize = 1;
+
+		s32 rangeCount = ((_end - _begin) + _grainSize - 1) / _grainSize;
+		s32 helperCount = Math::minInt((s32)JobSystem_workers.size(), rangeCount - 1);
+
+		if (helperCount <= 0) {
+
+			_func(_begin, _end);
+			return;
+
+		}
+
+		//Ranges are handed out from a shared counter, so threads that start late simply get fewer of them.
+		std::atomic<s32> nextRange = 0;
+
+		auto runRanges = [&]() {
+
+			s32 range;
+			while ((range = nextRange.fetch_add(1)) < rangeCount) {
+
+				s32 rangeBegin = _begin + (range * _grainSize);
+				_func(rangeBegin, Math::minInt(rangeBegin + _grainSize, _end));
+
+			}
+
+		};
+
+		std::vector<JobHandle> helpers;
+		helpers.reserve((size_t)helperCount);
+
+		for (s32 i = 0; i < helperCount; ++i) {
+			helpers.push_back(schedule(runRanges));
+		}
+
+		runRanges();
+
+		for (const JobHandle& helper : helpers) {
+			wait(helper);
+		}
+
+	}
+
+	void JobSystem::parallelForRows(s32 _height, s32 _rowsPerJob, const std::function<void(s32, s32)>& _func) {
+		parallelFor(0, _height, _rowsPerJob, _func);
+	}
+
+	void JobSystem::parallelForTiles(s32 _width, s32 _height, s32 _tileSize, const std::function<void(s32, s32, s32, s32)>& _func) {
+
+		if (_width <= 0 || _height <= 0 || _tileSize <= 0) return;
+
+		s32 columns = (_width + _tileSize - 1) / _tileSize;
+		s32 rows = (_height + _tileSize - 1) / _tileSize;
+
+		parallelFor(0, columns * rows, 1, [&](s32 _first, s32 _last) {
+
+			for (s32 i = _first; i < _last; ++i) {
+
+				s32 x = (i % columns) * _tileSize;
+				s32 y = (i / columns) * _tileSize;
+
+				_func(x, y, Math::minInt(_tileSize, _width - x), Math::minInt(_tileSize, _height - y));
+
+			}
+
+		});
+
+	}
+
+	void JobSystem::runOnMainThread(std::function<void()> _func) {
+
+		std::lock_guard<std::mutex> lock(JobSystem_mainThreadMutex);
+		JobSystem_mainThreadQueue.push_back(std::move(_func));
+
+	}
+
+	void JobSystem::drainMainThreadQueue() {
+
+		std::vector<std::function<void()>> queue;
+
+		{
+			std::lock_guard<std::mutex> lock(JobSystem_mainThreadMutex);
+			queue.swap(JobSystem_mainThreadQueue);
+		}
+
+		//Functions queued while draining run next update.
+		for (std::function<void()>& func : queue) {
+			func();
+		}
+
+	}
+
+	//Takes a job from the calling worker's own queue first, then steals from the others. Returns false if there was nothing to run.
+	bool JobSystem::__runPendingJob() {
+
+		size_t queueCount = JobSystem_queues.size();
+		if (queueCount == 0) return false;
+
+		size_t start = (JobSystem_workerIndex >= 0) ? (size_t)JobSystem_workerIndex : (queueCount - 1);
+
+		for (size_t i = 0; i < queueCount; ++i) {
+
+			JobQueue& queue = *JobSystem_queues[(start + i) % queueCount];
+			JobHandle job;
+
+			{
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				if (queue.jobs.empty()) continue;
+
+				//Owners take the newest job, thieves the oldest one.
+				if (i == 0) {
+
+					job = std::move(queue.jobs.back());
+					queue.jobs.pop_back();
+
+				}
+				else {
+
+					job = std::move(queue.jobs.front());
+					queue.jobs.pop_front();
+
+				}
+			}
+
+			JobSystem_queuedCount.fetch_sub(1);
+			__execute(job);
+
+			return true;
+
+		}
+
+		return false;
+
+	}
+
+	//Only called by workers with nothing else to run, and on free.
+	bool JobSystem::__runBackgroundJob() {
+
+		JobHandle job;
+
+		{
+			std::lock_guard<std::mutex> lock(JobSystem_backgroundQueue.mutex);
+			if (JobSystem_backgroundQueue.jobs.empty()) return false;
+
+			job = std::move(JobSystem_backgroundQueue.jobs.front());
+			JobSystem_backgroundQueue.jobs.pop_front();
+		}
+
+		JobSystem_queuedCount.fetch_sub(1);
+		__execute(job);
+
+		return true;
+
+	}
+
+	void JobSystem::__push(const JobHandle& _job) {
+
+		//Without workers the job runs right away.
+		if (JobSystem_workers.empty()) {
+
+			__execute(_job);
+			return;
+
+		}
+
+		JobQueue& queue = _job->background ? JobSystem_backgroundQueue : *JobSystem_queues[(JobSystem_workerIndex >= 0) ? (size_t)JobSystem_workerIndex : (JobSystem_queues.size() - 1)];
+
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.jobs.push_back(_job);
+		}
+
+		JobSystem_queuedCount.fetch_add(1);
+
+		{
+			std::lock_guard<std::mutex> lock(JobSystem_sleepMutex);
+		}
+
+		JobSystem_sleepCondition.notify_one();
+
+	}
+
+	void JobSystem::__execute(const JobHandle& _job) {
+
+		if (_job->func) _job->func();
+
+		std::vector<JobHandle> continuations;
+
+		{
+			std::lock_guard<std::mutex> lock(_job->continuationMutex);
+
+			_job->done = true;
+			continuations.swap(_job->continuations);
+		}
+
+		for (const JobHandle& continuation : continuations) {
+			if (continuation->pendingDependencies.fetch_sub(1) == 1) __push(continuation);
+		}
+
+	}
+
+	void JobSystem::__workerLoop(s32 _index) {
+
+		JobSystem_workerIndex = _index;
+
+		while (true) {
+
+			if (__runPendingJob() || __runBackgroundJob()) continue;
+
+			std::unique_lock<std::mutex> lock(JobSystem_sleepMutex);
+			JobSystem_sleepCondition.wait(lock, []() { return (JobSystem_stopping || JobSystem_queuedCount > 0); });
+
+			if (JobSystem_stopping) break;
+
+		}
+
+	}
+
+}
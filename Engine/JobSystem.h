@@ -0,0 +1,66 @@
+/*
+    JobSystem.h
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <mutex>
+
+namespace Zixel {
+
+	struct Job {
+
+		std::function<void()> func;
+
+		std::atomic<s32> pendingDependencies = 1; //Job is queued once this hits 0. Starts at 1 so it can't run while its dependencies are being registered.
+		std::atomic<bool> done = false;
+		bool background = false; //Queued with the low priority jobs.
+
+		std::mutex continuationMutex;
+		std::vector<std::shared_ptr<Job>> continuations; //Jobs depending on this one.
+
+	};
+
+	typedef std::shared_ptr<Job> JobHandle;
+
+	//Pool of worker threads, each with its own queue. Idle workers steal jobs from the other queues.
+	//Jobs scheduled from threads outside the pool go into a shared queue that every worker takes from.
+	//Background jobs have a queue of their own that workers only take from when there's nothing else to run.
+	struct JobSystem {
+
+		static bool init(s32 _threadCount = 0); //0 uses one worker per hardware thread, minus the main thread.
+		static void free();
+
+		static s32 getThreadCount(); //Workers plus the calling thread, the number of threads parallelFor can use.
+		static bool isMainThread();
+
+		static JobHandle schedule(std::function<void()> _func, const std::vector<JobHandle>& _dependencies = {});
+		static JobHandle scheduleBackground(std::function<void()> _func, const std::vector<JobHandle>& _dependencies = {}); //Low priority work like prefetching, only run by workers with nothing else to do. Without workers it runs right away.
+		static bool isDone(const JobHandle& _job);
+		static void wait(const JobHandle& _job); //Runs other jobs while waiting, background jobs are left to the workers.
+
+		//Calls _func with ranges of at most _grainSize items until [_begin, _end) is covered. Blocks until every range is done, the calling thread helps out.
+		static void parallelFor(s32 _begin, s32 _end, s32 _grainSize, const std::function<void(s32, s32)>& _func);
+		static void parallelForRows(s32 _height, s32 _rowsPerJob, const std::function<void(s32, s32)>& _func);
+		static void parallelForTiles(s32 _width, s32 _height, s32 _tileSize, const std::function<void(s32, s32, s32, s32)>& _func); //x, y, width, height of each tile.
+
+		//Functions that have to run on the main thread, like GL calls. Drained once per update by ZixelApp.
+		static void runOnMainThread(std::function<void()> _func);
+		static void drainMainThreadQueue();
+
+		static JobHandle __schedule(std::function<void()> _func, const std::vector<JobHandle>& _dependencies, bool _background);
+		static bool __runPendingJob();
+		static bool __runBackgroundJob();
+		static void __push(const JobHandle& _job);
+		static void __execute(const JobHandle& _job);
+		static void __workerLoop(s32 _index);
+
+	};
+
+}
@@ -6,9 +6,27 @@
 
 #include "Engine/ZixelPCH.h"
 #include "Engine/MaskBuffer.h"
+#include "Engine/Math.h"
+
+#include <bitset>
 
 namespace Zixel {
 
+	//64 bits of _row starting at bit _bit, which may lie outside the row. Bits outside the row read as 0.
+	static u64 MaskBuffer_readBits(const u64* _row, s32 _wordsPerRow, s32 _bit) {
+
+		s32 word = (_bit >= 0) ? (_bit / 64) : -((63 - _bit) / 64);
+		s32 offset = _bit - (word * 64);
+
+		u64 low = (word >= 0 && word < _wordsPerRow) ? _row[word] : 0;
+		if (offset == 0) return low;
+
+		u64 high = (word + 1 >= 0 && word + 1 < _wordsPerRow) ? _row[word + 1] : 0;
+
+		return (low >> offset) | (high << (64 - offset));
+
+	}
+
 	MaskBuffer::MaskBuffer(s32 _width, s32 _height, bool _fill) {
 
 		if (_width < 1 || _height < 1) {
@@ -20,19 +38,14 @@ namespace Zixel {
 
 		width = _width;
 		height = _height;
-		columns = (s32)ceil(_width / 8.0);
-		
-		size =  columns * _height;
-
-		buffer = new u8[size]();
+		wordsPerRow = (_width + 63) / 64;
 
-		if (_fill) {
+		size = (size_t)wordsPerRow * (size_t)_height;
+		lastWordMask = ((_width % 64) == 0) ? ~(u64)0 : ((((u64)1) << (_width % 64)) - 1);
 
-			for (s32 i = 0; i < size; ++i) {
-				buffer[i] = 0xFF;
-			}
+		buffer = new u64[size]();
 
-		}
+		if (_fill) fill();
 
 	}
 
@@ -46,18 +59,13 @@ namespace Zixel {
 
 	void MaskBuffer::fill() {
 
-		for (s32 i = 0; i < size; ++i) {
-			buffer[i] = 0xFF;
-		}
+		std::fill(buffer, buffer + size, ~(u64)0);
+		__clearPadding();
 
 	}
 
 	void MaskBuffer::clear() {
-
-		for (s32 i = 0; i < size; ++i) {
-			buffer[i] = 0x00;
-		}
-
+		std::fill(buffer, buffer + size, (u64)0);
 	}
 
 	void MaskBuffer::write(s32 _x, s32 _y, bool _value) {
@@ -69,14 +77,42 @@ namespace Zixel {
 
 		}
 
-		s32 column = (_x / 8);
-		s32 bit = 7 - (_x - (column * 8));
-		
+		u64& word = rowPtr(_y)[_x >> 6];
+		u64 bit = ((u64)1) << (_x & 63);
+
 		if (_value) {
-			buffer[(_y * columns) + column] |= (0x01 << bit);
+			word |= bit;
 		}
 		else {
-			buffer[(_y * columns) + column] &= ((0x01 << bit) ^ 0xFF);
+			word &= ~bit;
+		}
+
+	}
+
+	void MaskBuffer::writeSpan(s32 _x, s32 _y, s32 _count, bool _value) {
+
+		if (_y < 0 || _y >= height) return;
+
+		s32 right = Math::minInt(_x + _count, width);
+		_x = Math::maxInt(_x, 0);
+
+		writeBits(rowPtr(_y), _x, right, _value);
+
+	}
+
+	void MaskBuffer::writeBits(u64* _row, s32 _first, s32 _last, bool _value) {
+
+		//Whole words at once, partial words at either end.
+		while (_first < _last) {
+
+			s32 count = Math::minInt(64 - (_first & 63), _last - _first);
+			u64 mask = (count == 64) ? ~(u64)0 : (((((u64)1) << count) - 1) << (_first & 63));
+
+			if (_value) _row[_first >> 6] |= mask;
+			else _row[_first >> 6] &= ~mask;
+
+			_first += count;
+
 		}
 
 	}
@@ -90,20 +126,146 @@ namespace Zixel {
 
 		}
 
-		s32 column = (_x / 8);
-		s32 bit = 7 - (_x - (column * 8));
-
-		return (((buffer[(_y * columns) + column] >> bit) & 0x01) == 0x01);
+		return (((rowPtr(_y)[_x >> 6] >> (_x & 63)) & 0x01) == 0x01);
 
 	}
 
 	MaskBuffer* MaskBuffer::clone() {
 
 		MaskBuffer* mask = new MaskBuffer(width, height);
-		for (size_t i = 0; i < (size_t)size; ++i) mask->buffer[i] = buffer[i];
+		memcpy(mask->buffer, buffer, size * sizeof(u64));
 
 		return mask;
 
 	}
 
-}
\ No newline at end of file
+	void MaskBuffer::combine(MaskBuffer* _mask, MaskOperation _operation, s32 _x, s32 _y) {
+
+		//Rows would be read after they've been written to.
+		if (_mask == this) {
+
+			MaskBuffer* copy = clone();
+			combine(copy, _operation, _x, _y);
+			delete copy;
+
+			return;
+
+		}
+
+		bool clearOutside = (_operation == MaskOperation::Replace || _operation == MaskOperation::Intersect);
+
+		for (s32 y = 0; y < height; ++y) {
+
+			u64* row = rowPtr(y);
+			s32 sourceY = y - _y;
+
+			if (sourceY < 0 || sourceY >= _mask->height) {
+
+				if (clearOutside) std::fill(row, row + wordsPerRow, (u64)0);
+				continue;
+
+			}
+
+			const u64* sourceRow = _mask->rowPtr(sourceY);
+
+			for (s32 word = 0; word < wordsPerRow; ++word) {
+
+				u64 bits = MaskBuffer_readBits(sourceRow, _mask->wordsPerRow, (word * 64) - _x);
+
+				switch (_operation) {
+
+					case MaskOperation::Replace: row[word] = bits; break;
+					case MaskOperation::Add: row[word] |= bits; break;
+					case MaskOperation::Subtract: row[word] &= ~bits; break;
+					case MaskOperation::Intersect: row[word] &= bits; break;
+					case MaskOperation::Xor: row[word] ^= bits; break;
+
+				}
+
+			}
+
+			//Bits of the other mask can land past the right edge.
+			row[wordsPerRow - 1] &= lastWordMask;
+
+		}
+
+	}
+
+	void MaskBuffer::shift(s32 _x, s32 _y) {
+		combine(this, MaskOperation::Replace, _x, _y);
+	}
+
+	void MaskBuffer::invert() {
+
+		for (size_t i = 0; i < size; ++i) {
+			buffer[i] = ~buffer[i];
+		}
+
+		__clearPadding();
+
+	}
+
+	s64 MaskBuffer::count() {
+
+		s64 bitCount = 0;
+
+		for (size_t i = 0; i < size; ++i) {
+			bitCount += (s64)std::bitset<64>(buffer[i]).count();
+		}
+
+		return bitCount;
+
+	}
+
+	bool MaskBuffer::isEmpty() {
+
+		for (size_t i = 0; i < size; ++i) {
+			if (buffer[i] != 0) return false;
+		}
+
+		return true;
+
+	}
+
+	bool MaskBuffer::getBBox(s32& _left, s32& _top, s32& _right, s32& _bottom) {
+
+		_left = -1;
+		_top = -1;
+		_right = -1;
+		_bottom = -1;
+
+		for (s32 y = 0; y < height; ++y) {
+
+			const u64* row = rowPtr(y);
+
+			for (s32 word = 0; word < wordsPerRow; ++word) {
+
+				u64 bits = row[word];
+				if (bits == 0) continue;
+
+				s32 first = (word * 64) + Math::countTrailingZeros(bits);
+				s32 last = (word * 64) + 63 - Math::countLeadingZeros(bits);
+
+				if (_left == -1 || first < _left) _left = first;
+				if (last > _right) _right = last;
+
+				if (_top == -1) _top = y;
+				_bottom = y;
+
+			}
+
+		}
+
+		return (_left != -1);
+
+	}
+
+	void MaskBuffer::__clearPadding() {
+
+		for (s32 y = 0; y < height; ++y) {
+			rowPtr(y)[wordsPerRow - 1] &= lastWordMask;
+		}
+
+	}
+
+}
@@ -6,22 +6,104 @@
 
 #pragma once
 
+#include "Engine/Math.h"
+
 namespace Zixel {
 
+	enum class MaskOperation : u8 {
+
+		Replace, //Copies the other mask, everything outside it is cleared.
+		Add,
+		Subtract,
+		Intersect, //Everything outside the other mask is cleared.
+		Xor,
+
+	};
+
+	//One bit per pixel, bit (x % 64) of word (x / 64) in each row.
+	//Rows are padded to whole words, the padding bits are always 0.
 	struct MaskBuffer {
 
-		s32 width = 0, height = 0, columns = 0, size = 0;
-		u8* buffer = nullptr;
+		s32 width = 0, height = 0, wordsPerRow = 0;
+		size_t size = 0; //In words.
+		u64 lastWordMask = 0; //Bits of the last word in each row that lie inside the mask.
+		u64* buffer = nullptr;
 
 		MaskBuffer(s32 _width, s32 _height, bool _fill = false);
 		~MaskBuffer();
 
+		inline u64* rowPtr(s32 _y) { return buffer + ((size_t)_y * (size_t)wordsPerRow); }
+
+		static void writeBits(u64* _row, s32 _first, s32 _last, bool _value); //Bits _first to _last - 1 of a row, not clipped.
+
+		//Finds the next run of bits equal to _value in a row, starting at _x and ending before _right. Returns false if there is none.
+		static inline bool findRun(const u64* _row, s32& _x, s32 _right, s32& _end, bool _value = true) {
+			return findComputedRun([_row, _value](s32 _word) { return _value ? _row[_word] : ~_row[_word]; }, _x, _right, _end, _right);
+		}
+
+		//Same as above for rows that are computed a word at a time, _getWord(i) returns word i with the wanted bits set.
+		//The run has to start before _right but may continue up to _limit.
+		template<class F>
+		static bool findComputedRun(const F& _getWord, s32& _x, s32 _right, s32& _end, s32 _limit) {
+
+			while (_x < _right) {
+
+				u64 bits = _getWord(_x >> 6) & (~(u64)0 << (_x & 63));
+
+				if (bits == 0) {
+
+					_x = (_x | 63) + 1;
+					continue;
+
+				}
+
+				_x = (_x & ~63) + Math::countTrailingZeros(bits);
+				if (_x >= _right) return false;
+
+				_end = _x;
+
+				while (_end < _limit) {
+
+					u64 unset = ~_getWord(_end >> 6) & (~(u64)0 << (_end & 63));
+
+					if (unset != 0) {
+
+						_end = (_end & ~63) + Math::countTrailingZeros(unset);
+						break;
+
+					}
+
+					_end = (_end | 63) + 1;
+
+				}
+
+				_end = Math::minInt(_end, _limit);
+				return true;
+
+			}
+
+			return false;
+
+		}
+
 		void fill();
 		void clear();
 		void write(s32 _x, s32 _y, bool _value);
+		void writeSpan(s32 _x, s32 _y, s32 _count, bool _value); //Clipped to the mask.
 		bool read(s32 _x, s32 _y);
 		MaskBuffer* clone();
 
+		//Combines _mask, with its top left corner at _x, _y, into this mask. The masks don't have to be the same size.
+		void combine(MaskBuffer* _mask, MaskOperation _operation, s32 _x = 0, s32 _y = 0);
+		void shift(s32 _x, s32 _y); //Moves every bit by _x, _y. Bits moved outside the mask are lost.
+		void invert();
+
+		s64 count(); //Number of set bits.
+		bool isEmpty();
+		bool getBBox(s32& _left, s32& _top, s32& _right, s32& _bottom); //Returns false if the mask is empty.
+
+		void __clearPadding();
+
 	};
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,241 @@
+/*
+    MaskOutline.cpp
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#include "Engine/ZixelPCH.h"
+#include "Engine/MaskOutline.h"
+#include "Engine/MaskBuffer.h"
+#include "Engine/JobSystem.h"
+#include "Engine/Math.h"
+
+namespace Zixel {
+
+	void MaskOutline::build(MaskBuffer* _mask) {
+
+		width = _mask->width;
+		height = _mask->height;
+
+		bands.clear();
+		bands.resize((size_t)((height + ZIXEL_CHUNK_SIZE - 1) / ZIXEL_CHUNK_SIZE));
+
+		JobSystem::parallelFor(0, (s32)bands.size(), 1, [&](s32 _first, s32 _last) {
+			for (s32 band = _first; band < _last; ++band) __extractBand(_mask, band);
+		});
+
+	}
+
+	void MaskOutline::update(MaskBuffer* _mask, s32 _x, s32 _y, s32 _width, s32 _height) {
+
+		if (_mask->width != width || _mask->height != height) {
+
+			build(_mask);
+			return;
+
+		}
+
+		s32 left = Math::maxInt(_x, 0);
+		s32 right = Math::minInt(_x + _width, width);
+		s32 top = Math::maxInt(_y, 0);
+		s32 bottom = Math::minInt(_y + _height, height);
+
+		if (left >= right || top >= bottom) return;
+
+		//Changed rows move the grid lines above and below them, the line below the last row may belong to the next band.
+		s32 firstBand = top / ZIXEL_CHUNK_SIZE;
+		s32 lastBand = Math::minInt(bottom / ZIXEL_CHUNK_SIZE, (s32)bands.size() - 1);
+
+		JobSystem::parallelFor(firstBand, lastBand + 1, 1, [&](s32 _first, s32 _last) {
+			for (s32 band = _first; band < _last; ++band) __updateBand(_mask, band, left, top, right, bottom);
+		});
+
+	}
+
+	size_t MaskOutline::getEdgeCount() {
+
+		size_t count = 0;
+
+		for (MaskOutlineBand& band : bands) {
+			count += band.horizontal.size() + band.vertical.size();
+		}
+
+		return count;
+
+	}
+
+	void MaskOutline::__extractBand(MaskBuffer* _mask, s32 _band) {
+
+		MaskOutlineBand& band = bands[_band];
+
+		band.horizontal.clear();
+		band.vertical.clear();
+
+		s32 top = _band * ZIXEL_CHUNK_SIZE;
+		s32 bottom = Math::minInt(top + ZIXEL_CHUNK_SIZE, height);
+		s32 lastLine = (bottom == height) ? height : (bottom - 1);
+
+		for (s32 y = top; y <= lastLine; ++y) __extractHorizontal(_mask, band, y, 0, width);
+		__extractVertical(_mask, _band, 0, width);
+
+	}
+
+	void MaskOutline::__updateBand(MaskBuffer* _mask, s32 _band, s32 _left, s32 _top, s32 _right, s32 _bottom) {
+
+		MaskOutlineBand& band = bands[_band];
+
+		s32 bandTop = _band * ZIXEL_CHUNK_SIZE;
+		s32 bandBottom = Math::minInt(bandTop + ZIXEL_CHUNK_SIZE, height);
+		s32 lastLine = (bandBottom == height) ? height : (bandBottom - 1);
+
+		//Grid lines _top to _bottom are next to a changed row.
+		s32 firstLine = Math::maxInt(_top, bandTop);
+		s32 endLine = Math::minInt(_bottom, lastLine) + 1;
+
+		if (firstLine >= endLine) return;
+
+		//Horizontal edges touching the changed columns are extracted again. Edges are merged runs, so the range grows to the edges it removes.
+		std::vector<s32> lineLefts((size_t)(endLine - firstLine), _left);
+		std::vector<s32> lineRights((size_t)(endLine - firstLine), _right);
+
+		size_t kept = 0;
+
+		for (size_t i = 0; i < band.horizontal.size(); ++i) {
+
+			MaskEdge edge = band.horizontal[i];
+
+			if (edge.y >= firstLine && edge.y < endLine && edge.x <= _right && edge.x + edge.length >= _left) {
+
+				s32 line = edge.y - firstLine;
+
+				lineLefts[line] = Math::minInt(lineLefts[line], edge.x);
+				lineRights[line] = Math::maxInt(lineRights[line], edge.x + edge.length);
+
+				continue;
+
+			}
+
+			band.horizontal[kept++] = edge;
+
+		}
+
+		band.horizontal.resize(kept);
+
+		for (s32 y = firstLine; y < endLine; ++y) {
+			__extractHorizontal(_mask, band, y, lineLefts[y - firstLine], lineRights[y - firstLine]);
+		}
+
+		//Vertical edges are merged down the whole band, so the changed grid lines are extracted again for every row of it.
+		kept = 0;
+
+		for (size_t i = 0; i < band.vertical.size(); ++i) {
+
+			MaskEdge edge = band.vertical[i];
+			if (edge.x >= _left && edge.x <= _right) continue;
+
+			band.vertical[kept++] = edge;
+
+		}
+
+		band.vertical.resize(kept);
+		__extractVertical(_mask, _band, _left, _right);
+
+	}
+
+	void MaskOutline::__extractHorizontal(MaskBuffer* _mask, MaskOutlineBand& _band, s32 _y, s32 _left, s32 _right) {
+
+		const u64* above = (_y > 0) ? _mask->rowPtr(_y - 1) : nullptr;
+		const u64* below = (_y < height) ? _mask->rowPtr(_y) : nullptr;
+
+		//Horizontal edges lie between pixels that differ from the pixel above.
+		s32 firstWord = _left >> 6;
+		s32 lastWord = (_right - 1) >> 6;
+
+		std::vector<u64> edges((size_t)(lastWord + 1));
+
+		for (s32 word = firstWord; word <= lastWord; ++word) {
+			edges[word] = ((above != nullptr) ? above[word] : 0) ^ ((below != nullptr) ? below[word] : 0);
+		}
+
+		s32 x = _left, end = 0;
+
+		while (MaskBuffer::findRun(edges.data(), x, _right, end)) {
+
+			_band.horizontal.push_back({ x, _y, end - x });
+			x = end;
+
+		}
+
+	}
+
+	void MaskOutline::__extractVertical(MaskBuffer* _mask, s32 _band, s32 _left, s32 _right) {
+
+		MaskOutlineBand& band = bands[_band];
+
+		s32 top = _band * ZIXEL_CHUNK_SIZE;
+		s32 bottom = Math::minInt(top + ZIXEL_CHUNK_SIZE, height);
+		s32 rows = bottom - top;
+
+		//Vertical edges lie left of pixels that differ from the pixel to their left, and right of the last column if it's selected.
+		//Bit x of a row is set if there's an edge on grid line x, they're merged down the rows of the band afterwards.
+		s32 wordsPerRow = _mask->wordsPerRow;
+		s32 firstWord = _left >> 6;
+		s32 lastWord = _right >> 6;
+		s32 edgeWords = lastWord - firstWord + 1;
+
+		std::vector<u64> rowEdges((size_t)edgeWords * (size_t)rows, 0);
+
+		for (s32 y = top; y < bottom; ++y) {
+
+			const u64* row = _mask->rowPtr(y);
+			u64* rowEdge = rowEdges.data() + ((size_t)(y - top) * (size_t)edgeWords);
+
+			u64 carry = (firstWord > 0) ? (row[firstWord - 1] >> 63) : 0;
+
+			for (s32 word = firstWord; word <= lastWord; ++word) {
+
+				u64 bits = (word < wordsPerRow) ? row[word] : 0;
+
+				rowEdge[word - firstWord] = bits ^ ((bits << 1) | carry);
+				carry = bits >> 63;
+
+			}
+
+		}
+
+		for (s32 row = 0; row < rows; ++row) {
+
+			const u64* rowEdge = rowEdges.data() + ((size_t)row * (size_t)edgeWords);
+			const u64* previous = (row > 0) ? (rowEdge - edgeWords) : nullptr;
+
+			for (s32 word = 0; word < edgeWords; ++word) {
+
+				//Edges that don't continue an edge from the row above start a new segment.
+				u64 starts = rowEdge[word] & ~((previous != nullptr) ? previous[word] : 0);
+
+				//Only grid lines _left to _right.
+				s32 wordX = (firstWord + word) * 64;
+				if (wordX < _left) starts &= ~(u64)0 << (_left - wordX);
+				if (_right - wordX < 63) starts &= ~(~(u64)0 << (_right - wordX + 1));
+
+				while (starts != 0) {
+
+					s32 bit = Math::countTrailingZeros(starts);
+					starts &= starts - 1;
+
+					u64 mask = (u64)1 << bit;
+					s32 end = row + 1;
+
+					while (end < rows && (rowEdges[((size_t)end * (size_t)edgeWords) + (size_t)word] & mask) != 0) ++end;
+
+					band.vertical.push_back({ wordX + bit, top + row, end - row });
+
+				}
+
+			}
+
+		}
+
+	}
+
+}
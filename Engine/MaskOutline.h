@@ -0,0 +1,49 @@
+/*
+    MaskOutline.h
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "Engine/ZixelMacros.h"
+
+namespace Zixel {
+
+	struct MaskBuffer;
+
+	//Edge between selected and unselected pixels, in pixel grid coordinates.
+	//Horizontal edges go from (x, y) to (x + length, y), vertical ones from (x, y) to (x, y + length).
+	struct MaskEdge {
+		s32 x = 0, y = 0, length = 0;
+	};
+
+	struct MaskOutlineBand {
+
+		std::vector<MaskEdge> horizontal; //Grid lines top to bottom - 1 of the band, the last band also has the bottom line of the mask.
+		std::vector<MaskEdge> vertical; //Cut at the band edges.
+
+	};
+
+	//Boundary of a MaskBuffer selection as merged horizontal and vertical edges, for drawing marching ants.
+	//Edges are kept per ZIXEL_CHUNK_SIZE band of rows, so an edit only extracts the edges next to the pixels it changed again.
+	struct MaskOutline {
+
+		s32 width = 0, height = 0;
+		std::vector<MaskOutlineBand> bands;
+
+		void build(MaskBuffer* _mask); //Extracts every band, the outline takes the size of the mask.
+		void update(MaskBuffer* _mask, s32 _x, s32 _y, s32 _width, s32 _height); //Rect of the mask that changed since the last build or update.
+
+		size_t getEdgeCount();
+
+		void __extractBand(MaskBuffer* _mask, s32 _band);
+		void __updateBand(MaskBuffer* _mask, s32 _band, s32 _left, s32 _top, s32 _right, s32 _bottom); //Replaces the edges next to the changed pixels.
+		void __extractHorizontal(MaskBuffer* _mask, MaskOutlineBand& _band, s32 _y, s32 _left, s32 _right); //Edges on grid line _y between columns _left and _right.
+		void __extractVertical(MaskBuffer* _mask, s32 _band, s32 _left, s32 _right); //Edges on grid lines _left to _right, inclusive.
+
+	};
+
+}
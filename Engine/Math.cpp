@@ -7,6 +7,10 @@
 #include "Engine/ZixelPCH.h"
 #include "Engine/Math.h"
 
+#if defined(_MSC_VER) && !defined(__clang__)
+	#include <intrin.h>
+#endif
+
 namespace Zixel {
 
 	bool Vector2u16::operator == (Vector2u16 _v) {
@@ -130,6 +134,36 @@ namespace Zixel {
 		return value;
 	}
 
+	s32 Math::countTrailingZeros(u64 _value) {
+
+		#if defined(_MSC_VER) && !defined(__clang__)
+
+		unsigned long index;
+		_BitScanForward64(&index, _value);
+
+		return (s32)index;
+
+		#else
+		return __builtin_ctzll(_value);
+		#endif
+
+	}
+
+	s32 Math::countLeadingZeros(u64 _value) {
+
+		#if defined(_MSC_VER) && !defined(__clang__)
+
+		unsigned long index;
+		_BitScanReverse64(&index, _value);
+
+		return 63 - (s32)index;
+
+		#else
+		return __builtin_clzll(_value);
+		#endif
+
+	}
+
 	s32 Math::absInt(s32 value) {
 		return abs(value);
 	}
@@ -91,6 +91,9 @@ namespace Zixel {
 		static f32 clampFloat(f32 value, f32 minVal, f32 maxVal);
 		static f64 clampDouble(f64 value, f64 minVal, f64 maxVal);
 
+		static s32 countTrailingZeros(u64 _value); //_value can't be 0.
+		static s32 countLeadingZeros(u64 _value); //_value can't be 0.
+
 		static s32 absInt(s32 value);
 		static f32 absFloat(f32 value);
 
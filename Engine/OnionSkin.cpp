@@ -0,0 +1,332 @@
+/*
+    OnionSkin.cpp
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#include "Engine/ZixelPCH.h"
+#include "Engine/OnionSkin.h"
+#include "Engine/PixelBuffer.h"
+#include "Engine/BlendKernel.h"
+#include "Engine/Math.h"
+
+#define ZIXEL_ONION_SKIN_TABLE_SIZE (256 * 4) //Opacity, then red, green and blue tint tables of one frame.
+
+namespace Zixel {
+
+	OnionSkin::OnionSkin(s32 _width, s32 _height) {
+
+		if (_width < 1 || _height < 1) {
+
+			ZIXEL_WARN("Error in OnionSkin::OnionSkin. Size cannot be less than 1: {}x{}", _width, _height);
+			return;
+
+		}
+
+		width = _width;
+		height = _height;
+
+		tileColumns = (width + ZIXEL_CHUNK_SIZE - 1) / ZIXEL_CHUNK_SIZE;
+		tileRows = (height + ZIXEL_CHUNK_SIZE - 1) / ZIXEL_CHUNK_SIZE;
+
+		result = new PixelBuffer(width, height, { 0, 0, 0, 0 }, true, true, PixelStorage::Tiled);
+		invalidTiles.assign((size_t)tileColumns * (size_t)tileRows, 0);
+
+	}
+
+	OnionSkin::~OnionSkin() {
+		delete result;
+	}
+
+	void OnionSkin::setFrames(const std::vector<PixelBuffer*>& _frames) {
+
+		for (PixelBuffer* frame : _frames) {
+
+			if (frame != nullptr && (frame->width != width || frame->height != height)) {
+
+				ZIXEL_WARN("Error in OnionSkin::setFrames. Frame size ({}x{}) doesn't match ({}x{}).", frame->width, frame->height, width, height);
+				return;
+
+			}
+
+		}
+
+		frames = _frames;
+		seenChanges.assign(frames.size(), SeenChanges());
+
+		for (size_t i = 0; i < frames.size(); ++i) {
+			if (frames[i] != nullptr) seenChanges[i].record(frames[i]);
+		}
+
+		invalidateAll();
+
+	}
+
+	void OnionSkin::setFrame(s32 _frame, PixelBuffer* _buffer) {
+
+		if (_frame < 0 || _frame >= (s32)frames.size()) {
+
+			ZIXEL_WARN("Error in OnionSkin::setFrame. Frame {} out of range. Valid range: 0-{}", _frame, (s32)frames.size() - 1);
+			return;
+
+		}
+
+		if (_buffer != nullptr && (_buffer->width != width || _buffer->height != height)) {
+
+			ZIXEL_WARN("Error in OnionSkin::setFrame. Frame size ({}x{}) doesn't match ({}x{}).", _buffer->width, _buffer->height, width, height);
+			return;
+
+		}
+
+		if (frames[_frame] == _buffer) return;
+
+		frames[_frame] = _buffer;
+
+		seenChanges[_frame] = SeenChanges();
+		if (_buffer != nullptr) seenChanges[_frame].record(_buffer);
+
+		invalidateFrame(_frame);
+
+	}
+
+	void OnionSkin::setCurrentFrame(s32 _frame) {
+
+		if (currentFrame == _frame) return;
+
+		//Every shown frame moves to another distance, so every tile changes.
+		currentFrame = _frame;
+		invalidateAll();
+
+	}
+
+	void OnionSkin::setFrameCounts(s32 _previousCount, s32 _nextCount) {
+
+		_previousCount = Math::clampInt(_previousCount, 0, ZIXEL_ANIM_MAX_ONION_SKIN_FRAMES);
+		_nextCount = Math::clampInt(_nextCount, 0, ZIXEL_ANIM_MAX_ONION_SKIN_FRAMES);
+
+		if (previousCount == _previousCount && nextCount == _nextCount) return;
+
+		previousCount = _previousCount;
+		nextCount = _nextCount;
+		invalidateAll();
+
+	}
+
+	void OnionSkin::setLoop(bool _loop) {
+
+		if (loop == _loop) return;
+
+		loop = _loop;
+		invalidateAll();
+
+	}
+
+	void OnionSkin::setTints(Color4 _previousTint, Color4 _nextTint) {
+
+		if (Color::match(previousTint, _previousTint) && Color::match(nextTint, _nextTint)) return;
+
+		previousTint = _previousTint;
+		nextTint = _nextTint;
+		invalidateAll();
+
+	}
+
+	void OnionSkin::setOpacity(f32 _opacity, f32 _falloff) {
+
+		_opacity = Math::clampFloat(_opacity, 0.0f, 1.0f);
+		_falloff = Math::clampFloat(_falloff, 0.0f, 1.0f);
+
+		if (opacity == _opacity && falloff == _falloff) return;
+
+		opacity = _opacity;
+		falloff = _falloff;
+		invalidateAll();
+
+	}
+
+	bool OnionSkin::isShown(s32 _frame) {
+
+		for (s32 offset = -previousCount; offset <= nextCount; ++offset) {
+			if (offset != 0 && __getFrameIndex(offset) == _frame) return true;
+		}
+
+		return false;
+
+	}
+
+	void OnionSkin::invalidateFrame(s32 _frame, s32 _x, s32 _y, s32 _width, s32 _height) {
+		if (isShown(_frame)) __invalidateTiles(_x, _y, _width, _height);
+	}
+
+	void OnionSkin::invalidateFrame(s32 _frame) {
+		invalidateFrame(_frame, 0, 0, width, height);
+	}
+
+	void OnionSkin::invalidateAll() {
+		__invalidateTiles(0, 0, width, height);
+	}
+
+	bool OnionSkin::update() {
+
+		//Dirty blocks line up with the tiles.
+		for (s32 offset = -previousCount; offset <= nextCount; ++offset) {
+
+			s32 frame = __getFrameIndex(offset);
+			if (frame == -1 || frames[frame] == nullptr) continue;
+
+			seenChanges[frame].collect(frames[frame], [&](s32 _block) {
+				__invalidateTiles((_block % tileColumns) * ZIXEL_CHUNK_SIZE, (_block / tileColumns) * ZIXEL_CHUNK_SIZE, ZIXEL_CHUNK_SIZE, ZIXEL_CHUNK_SIZE);
+			});
+
+		}
+
+		if (!hasInvalidTiles) return false;
+
+		std::vector<s32> tiles;
+
+		for (size_t i = 0; i < invalidTiles.size(); ++i) {
+			if (invalidTiles[i]) tiles.push_back((s32)i);
+		}
+
+		std::fill(invalidTiles.begin(), invalidTiles.end(), (u8)0);
+		hasInvalidTiles = false;
+
+		//Frames from the furthest to the nearest, a frame reached from both sides when looping is only drawn at its nearest distance.
+		std::vector<s32> order;
+		std::vector<Color4> tints;
+		std::vector<f32> opacities;
+
+		s32 maxDistance = Math::maxInt(previousCount, nextCount);
+		f32 frameOpacity = opacity;
+
+		for (s32 distance = 1; distance <= maxDistance; ++distance) {
+
+			for (s32 side = 0; side < 2; ++side) {
+
+				s32 offset = (side == 0) ? -distance : distance;
+				if (distance > ((side == 0) ? previousCount : nextCount)) continue;
+
+				s32 frame = __getFrameIndex(offset);
+				if (frame == -1 || frames[frame] == nullptr || frameOpacity <= 0.0f) continue;
+				if (std::find(order.begin(), order.end(), frame) != order.end()) continue;
+
+				order.push_back(frame);
+				tints.push_back((side == 0) ? previousTint : nextTint);
+				opacities.push_back(frameOpacity);
+
+			}
+
+			frameOpacity *= falloff;
+
+		}
+
+		std::reverse(order.begin(), order.end());
+		std::reverse(tints.begin(), tints.end());
+		std::reverse(opacities.begin(), opacities.end());
+
+		std::vector<u8> tables(order.size() * ZIXEL_ONION_SKIN_TABLE_SIZE);
+
+		for (size_t i = 0; i < order.size(); ++i) {
+
+			u8* table = tables.data() + (i * ZIXEL_ONION_SKIN_TABLE_SIZE);
+			BlendKernel::createOpacityTable(opacities[i], table);
+
+			u32 strength = tints[i].a;
+			u8 tint[3] = { tints[i].r, tints[i].g, tints[i].b };
+
+			for (s32 channel = 0; channel < 3; ++channel) {
+
+				u8* channelTable = table + ((size_t)(channel + 1) * 256);
+				for (u32 value = 0; value < 256; ++value) channelTable[value] = (u8)(((value * (255 - strength)) + ((u32)tint[channel] * strength) + 127) / 255);
+
+			}
+
+		}
+
+		return result->writeTiles(tiles, [&](s32 _tileX, s32 _tileY, u8* _out) {
+
+			//Tiles no shown frame has pixels in stay empty.
+			bool any = false;
+			for (s32 frame : order) if (!frames[frame]->isNullTileAt(_tileX * ZIXEL_CHUNK_SIZE, _tileY * ZIXEL_CHUNK_SIZE)) any = true;
+
+			if (any) __blendTile(_tileX, _tileY, order, tables, _out);
+			return any;
+
+		});
+
+	}
+
+	PixelBuffer* OnionSkin::getResult() {
+		return result;
+	}
+
+	s32 OnionSkin::__getFrameIndex(s32 _offset) {
+
+		s32 count = (s32)frames.size();
+		if (count == 0) return -1;
+
+		s32 frame = currentFrame + _offset;
+
+		if (loop) frame = ((frame % count) + count) % count;
+		else if (frame < 0 || frame >= count) return -1;
+
+		return (frame == currentFrame) ? -1 : frame;
+
+	}
+
+	void OnionSkin::__invalidateTiles(s32 _x, s32 _y, s32 _width, s32 _height) {
+		if (PixelBuffer::markTiles(invalidTiles, width, height, _x, _y, _width, _height)) hasInvalidTiles = true;
+	}
+
+	void OnionSkin::__blendTile(s32 _tileX, s32 _tileY, const std::vector<s32>& _order, const std::vector<u8>& _tables, u8* _out) {
+
+		s32 x = _tileX * ZIXEL_CHUNK_SIZE;
+		s32 y = _tileY * ZIXEL_CHUNK_SIZE;
+		s32 w = Math::minInt(ZIXEL_CHUNK_SIZE, width - x);
+		s32 h = Math::minInt(ZIXEL_CHUNK_SIZE, height - y);
+
+		const size_t stride = (size_t)ZIXEL_CHUNK_SIZE * 4;
+		memset(_out, 0, stride * ZIXEL_CHUNK_SIZE);
+
+		u8 tinted[ZIXEL_CHUNK_SIZE * 4];
+
+		for (size_t i = 0; i < _order.size(); ++i) {
+
+			PixelBuffer* frame = frames[_order[i]];
+			if (frame->pixelCount == 0 || frame->isNullTileAt(x, y)) continue;
+
+			const u8* table = _tables.data() + (i * ZIXEL_ONION_SKIN_TABLE_SIZE);
+			const u8* red = table + 256;
+			const u8* green = table + 512;
+			const u8* blue = table + 768;
+
+			//The tile lies in one frame tile, so each row is read straight from the frame.
+			for (s32 row = 0; row < h; ++row) {
+
+				const u8* source = frame->pixelPtr(x, y + row);
+
+				if (frame->alphaMode != result->alphaMode) result->__convertSpan(tinted, source, w, frame->alphaMode);
+				else memcpy(tinted, source, (size_t)w * 4);
+
+				//The result is straight, so tinting only touches the color channels.
+				for (s32 j = 0; j < w; ++j) {
+
+					u8* pixel = tinted + ((size_t)j * 4);
+					if (pixel[3] == 0) continue;
+
+					pixel[0] = red[pixel[0]];
+					pixel[1] = green[pixel[1]];
+					pixel[2] = blue[pixel[2]];
+
+				}
+
+				BlendSpanResult blendResult;
+				result->__blendSpan(_out + ((size_t)row * stride), tinted, w, BlendMode::Normal, table, blendResult, nullptr);
+
+			}
+
+		}
+
+	}
+
+}
@@ -0,0 +1,73 @@
+/*
+    OnionSkin.h
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "Engine/Color.h"
+#include "Engine/PixelBuffer.h"
+#include "Engine/ZixelMacros.h"
+
+namespace Zixel {
+
+	//Neighbouring animation frames blended into one tiled buffer, drawn under the current frame.
+	//Frames further away are drawn first and fade out, so the nearest frames end up on top.
+	//The result is cached per ZIXEL_CHUNK_SIZE tile. Only tiles invalidated by a changed frame, a settings change or a playhead move are blended again on update.
+	//Edits to the shown frames are found on update from their change counts.
+	struct OnionSkin {
+
+		s32 width = 0, height = 0;
+		s32 tileColumns = 0, tileRows = 0;
+
+		std::vector<PixelBuffer*> frames; //Flattened frames, not owned. They must be the size of the onion skin, nullptr for empty frames.
+		s32 currentFrame = 0;
+
+		s32 previousCount = ZIXEL_ANIM_DEFAULT_ONION_SKIN_FRAMES;
+		s32 nextCount = ZIXEL_ANIM_DEFAULT_ONION_SKIN_FRAMES;
+		bool loop = false; //Frames past either end of the animation wrap around.
+
+		//Alpha is how much of the tint replaces the frame colors.
+		Color4 previousTint = { 255, 64, 64, 128 };
+		Color4 nextTint = { 64, 128, 255, 128 };
+
+		f32 opacity = 0.5f; //Opacity of the nearest frames.
+		f32 falloff = 0.5f; //Each frame further away gets this much of the opacity of the one before it.
+
+		PixelBuffer* result = nullptr;
+
+		std::vector<u8> invalidTiles;
+		bool hasInvalidTiles = false;
+
+		std::vector<SeenChanges> seenChanges; //What update has seen of each frame.
+
+		OnionSkin(s32 _width, s32 _height);
+		~OnionSkin();
+
+		void setFrames(const std::vector<PixelBuffer*>& _frames);
+		void setFrame(s32 _frame, PixelBuffer* _buffer);
+		void setCurrentFrame(s32 _frame);
+		void setFrameCounts(s32 _previousCount, s32 _nextCount);
+		void setLoop(bool _loop);
+		void setTints(Color4 _previousTint, Color4 _nextTint);
+		void setOpacity(f32 _opacity, f32 _falloff);
+
+		bool isShown(s32 _frame); //Whether the frame is part of the onion skin at the current frame.
+
+		void invalidateFrame(s32 _frame, s32 _x, s32 _y, s32 _width, s32 _height); //Only needed for raw writes that don't mark the frame dirty. Ignored if the frame isn't shown.
+		void invalidateFrame(s32 _frame);
+		void invalidateAll();
+
+		bool update(); //Returns true if the result changed.
+		PixelBuffer* getResult();
+
+		s32 __getFrameIndex(s32 _offset); //Frame _offset frames from the current one, -1 if there's none.
+		void __invalidateTiles(s32 _x, s32 _y, s32 _width, s32 _height);
+		void __blendTile(s32 _tileX, s32 _tileY, const std::vector<s32>& _order, const std::vector<u8>& _tables, u8* _out);
+
+	};
+
+}
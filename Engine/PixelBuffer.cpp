@@ -8,10 +8,81 @@
 #include "Engine/PixelBuffer.h"
 #include "Engine/Math.h"
 #include "Engine/MaskBuffer.h"
+#include "Engine/BlendKernel.h"
+#include "Engine/JobSystem.h"
 
 namespace Zixel {
 
-	PixelBuffer::PixelBuffer(s32 _width, s32 _height, Color4 _fillColor, bool _useBBox, bool _makeEmptyPixelsBlack) {
+	static bool PixelBuffer_isZero(const u8* _data, size_t _size) {
+
+		size_t i = 0;
+
+		for (; i + 8 <= _size; i += 8) {
+
+			u64 value;
+			memcpy(&value, _data + i, 8);
+
+			if (value != 0) return false;
+
+		}
+
+		for (; i < _size; ++i) {
+			if (_data[i] != 0) return false;
+		}
+
+		return true;
+
+	}
+
+	//Start and length of the in range parts of [_start, _start + _length) when positions wrap around _size.
+	//Ranges as long as the buffer cover all of it once, so pieces never overlap.
+	static s32 PixelBuffer_wrapRange(s32 _start, s32 _length, s32 _size, s32 (*_ranges)[2]) {
+
+		if (_length >= _size) {
+
+			_ranges[0][0] = 0;
+			_ranges[0][1] = _size;
+
+			return 1;
+
+		}
+
+		s32 start = ((_start % _size) + _size) % _size;
+
+		_ranges[0][0] = start;
+		_ranges[0][1] = Math::minInt(_length, _size - start);
+
+		if (start + _length <= _size) return 1;
+
+		_ranges[1][0] = 0;
+		_ranges[1][1] = start + _length - _size;
+
+		return 2;
+
+	}
+
+	PixelTile* PixelTile::getNull() {
+
+		static PixelTile nullTile;
+		return &nullTile;
+
+	}
+
+	PixelTile* PixelTile::retain(PixelTile* _tile) {
+
+		if (_tile != getNull()) _tile->refCount.fetch_add(1, std::memory_order_relaxed);
+		return _tile;
+
+	}
+
+	void PixelTile::release(PixelTile* _tile) {
+
+		if (_tile == getNull()) return;
+		if (_tile->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) delete _tile;
+
+	}
+
+	PixelBuffer::PixelBuffer(s32 _width, s32 _height, Color4 _fillColor, bool _useBBox, bool _makeEmptyPixelsBlack, PixelStorage _storage) {
 
 		if (_width < 1 || _height < 1) {
 
@@ -34,36 +105,35 @@ namespace Zixel {
 		useBBox = _useBBox;
 		makeEmptyPixelsBlack = _makeEmptyPixelsBlack;
 
-		s32 size = (_width * _height * 4); //Red, green, blue, alpha.
-		buffer = new u8[size]();
-
-		if (buffer == nullptr) {
-			ZIXEL_CRITICAL("Unable to allocate memory for PixelBuffer.");
-			return;
-		}
+		storage = _storage;
 
-		if (_fillColor.r != 0 || _fillColor.g != 0 || _fillColor.b != 0 || _fillColor.a != 0) {
+		if (storage == PixelStorage::Tiled) {
 
-			if (!makeEmptyPixelsBlack || _fillColor.a > 0) {
+			tileColumns = (_width + ZIXEL_CHUNK_SIZE - 1) / ZIXEL_CHUNK_SIZE;
+			tileRows = (_height + ZIXEL_CHUNK_SIZE - 1) / ZIXEL_CHUNK_SIZE;
 
-				for (s32 i = 0; i < size; i += 4) {
+			tiles.assign((size_t)tileColumns * (size_t)tileRows, PixelTile::getNull());
 
-					buffer[i] = _fillColor.r;
-					buffer[i + 1] = _fillColor.g;
-					buffer[i + 2] = _fillColor.b;
-					buffer[i + 3] = _fillColor.a;
+		}
+		else {
 
-				}
+			buffer = new u8[(size_t)_width * (size_t)_height * 4](); //Red, green, blue, alpha.
 
+			if (buffer == nullptr) {
+				ZIXEL_CRITICAL("Unable to allocate memory for PixelBuffer.");
+				return;
 			}
 
-			if (_fillColor.a != 0) {
+		}
 
-				pixelCount = (width * height);
-				if (useBBox) __setBBox(0, 0, width - 1, height - 1);
+		if (useBBox) __setPixelCounts(0, 0);
 
-			}
+		dirtyColumns = (_width + ZIXEL_CHUNK_SIZE - 1) / ZIXEL_CHUNK_SIZE;
+		dirtyRows = (_height + ZIXEL_CHUNK_SIZE - 1) / ZIXEL_CHUNK_SIZE;
+		dirtyBlocks.resize((size_t)dirtyColumns * (size_t)dirtyRows);
 
+		if (_fillColor.r != 0 || _fillColor.g != 0 || _fillColor.b != 0 || _fillColor.a != 0) {
+			fill(_fillColor);
 		}
 
 	}
@@ -74,6 +144,105 @@ namespace Zixel {
 			delete[] buffer;
 		}
 
+		for (size_t i = 0; i < tiles.size(); ++i) {
+			__releaseTile(i);
+		}
+
+	}
+
+	PixelTile* PixelBuffer::__acquireTile(size_t _index) {
+
+		PixelTile*& tile = tiles[_index];
+
+		if (tile == PixelTile::getNull()) tile = new PixelTile();
+		else if (tile->isShared()) {
+
+			//Copy on write.
+			PixelTile* copiedTile = new PixelTile();
+			memcpy(copiedTile->data, tile->data, sizeof(PixelTile::data));
+
+			PixelTile::release(tile);
+			tile = copiedTile;
+
+		}
+
+		return tile;
+
+	}
+
+	void PixelBuffer::__releaseTile(size_t _index) {
+
+		PixelTile::release(tiles[_index]);
+		tiles[_index] = PixelTile::getNull();
+
+	}
+
+	bool PixelBuffer::__writeIsNoop(s32 _x, s32 _y, Color4 _color) {
+
+		//Writing zeros into the null tile doesn't change anything, so there's no reason to allocate a tile for it.
+		return (_color.r == 0 && _color.g == 0 && _color.b == 0 && _color.a == 0 && isNullTileAt(_x, _y));
+
+	}
+
+	bool PixelBuffer::__canSkipNullTiles(Color4 _color, BlendMode _blendMode) {
+
+		Color4 ontoEmpty = __blendColor(_color, { 0, 0, 0, 0 }, _blendMode);
+		return (ontoEmpty.a == 0 && (makeEmptyPixelsBlack || (ontoEmpty.r == 0 && ontoEmpty.g == 0 && ontoEmpty.b == 0)));
+
+	}
+
+	PixelTile* PixelBuffer::getTile(s32 _tileX, s32 _tileY) {
+
+		if (storage != PixelStorage::Tiled || _tileX < 0 || _tileY < 0 || _tileX >= tileColumns || _tileY >= tileRows) return nullptr;
+		return tiles[((size_t)_tileY * (size_t)tileColumns) + (size_t)_tileX];
+
+	}
+
+	s32 PixelBuffer::releaseEmptyTiles() {
+
+		s32 released = 0;
+
+		for (size_t i = 0; i < tiles.size(); ++i) {
+
+			if (tiles[i] == PixelTile::getNull()) continue;
+
+			if (PixelBuffer_isZero(tiles[i]->data, sizeof(PixelTile::data))) {
+
+				__releaseTile(i);
+				++released;
+
+			}
+
+		}
+
+		return released;
+
+	}
+
+	size_t PixelBuffer::getMemoryUsage() {
+
+		if (storage == PixelStorage::Contiguous) return ((size_t)width * (size_t)height * 4);
+
+		size_t usage = tiles.size() * sizeof(PixelTile*);
+
+		for (size_t i = 0; i < tiles.size(); ++i) {
+			if (tiles[i] != PixelTile::getNull()) usage += sizeof(PixelTile);
+		}
+
+		return usage;
+
+	}
+
+	s32 PixelBuffer::getSharedTileCount() {
+
+		s32 count = 0;
+
+		for (size_t i = 0; i < tiles.size(); ++i) {
+			if (tiles[i] != PixelTile::getNull() && tiles[i]->isShared()) ++count;
+		}
+
+		return count;
+
 	}
 
 	void PixelBuffer::__setBBox(s32 _left, s32 _top, s32 _right, s32 _bottom) {
@@ -85,7 +254,60 @@ namespace Zixel {
 
 	}
 
-	void PixelBuffer::checkBBoxIncrease(s32 _x, s32 _y) {
+	void PixelBuffer::__blendSpan(u8* _dest, const u8* _source, s32 _count, BlendMode _blendMode, const u8* _opacityTable, BlendSpanResult& _result, s32* _columnCounts) {
+
+		if (isPremultiplied()) BlendKernel::blendSpanPremultiplied(_dest, _source, _count, _blendMode, _opacityTable, _result, _columnCounts);
+		else BlendKernel::blendSpan(_dest, _source, _count, _blendMode, _opacityTable, makeEmptyPixelsBlack, _result, _columnCounts);
+
+	}
+
+	void PixelBuffer::__convertSpan(u8* _dest, const u8* _source, s32 _count, AlphaMode _sourceAlphaMode) {
+
+		if (_sourceAlphaMode == alphaMode) {
+
+			if (_dest != _source) memcpy(_dest, _source, (size_t)_count * 4);
+			return;
+
+		}
+
+		if (isPremultiplied()) {
+
+			BlendKernel::premultiplySpan(_dest, _source, _count);
+			return;
+
+		}
+
+		//Transparent premultiplied pixels are already black, so makeEmptyPixelsBlack holds either way.
+		BlendKernel::unpremultiplySpan(_dest, _source, _count);
+
+	}
+
+	void PixelBuffer::__applyBlendSpanResult(BlendSpanResult& _result, s32 _x, s32 _y, s32 _count, PixelBufferBand& _band) {
+
+		if (_result.modified) {
+
+			_band.modified = true;
+			markDirty(_x, _y, _count, 1);
+
+		}
+
+		_band.pixelCountDelta += _result.pixelCountDelta;
+		if (__hasPixelCounts()) rowPixelCounts[_y] += _result.pixelCountDelta;
+
+		if (!useBBox) return;
+
+		if (_result.firstAddedIndex != -1) {
+
+			_band.checkBBoxIncrease(_x + _result.firstAddedIndex, _y);
+			_band.checkBBoxIncrease(_x + _result.lastAddedIndex, _y);
+
+		}
+
+		if (_result.removedPixels) _band.calcBBox = true;
+
+	}
+
+	void PixelBufferBand::checkBBoxIncrease(s32 _x, s32 _y) {
 
 		if (bBoxLeft == -1) {
 
@@ -103,370 +325,1222 @@ namespace Zixel {
 
 	}
 
-	void PixelBuffer::calculateBBox(bool _startFromCurrentBBox) {
+	s32 PixelBuffer::__getBandRows(s32 _top, s32 _bottom, s32 _pixelsPerRow) {
 
-		if (isEmpty()) {
-			__setBBox(-1, -1, -1, -1);
+		s32 alignedTop = (_top / ZIXEL_CHUNK_SIZE) * ZIXEL_CHUNK_SIZE;
+		s32 chunkRows = ((_bottom - alignedTop) + ZIXEL_CHUNK_SIZE - 1) / ZIXEL_CHUNK_SIZE;
+
+		s32 threadCount = JobSystem::getThreadCount();
+
+		if (threadCount <= 1 || chunkRows <= 1 || (s64)(_bottom - _top) * (s64)_pixelsPerRow < ZIXEL_PARALLEL_MIN_PIXELS) {
+			return Math::maxInt(chunkRows, 1) * ZIXEL_CHUNK_SIZE;
 		}
 
-		bool startFromBBox = (_startFromCurrentBBox && bBoxLeft != -1);
+		//A few bands per thread, so threads that finish early can pick up more work.
+		s32 bandCount = threadCount * 4;
+		return Math::maxInt((chunkRows + bandCount - 1) / bandCount, 1) * ZIXEL_CHUNK_SIZE;
 
-		s32 startX = startFromBBox ? bBoxLeft : 0;
-		s32 startY = startFromBBox ? bBoxTop : 0;
-		s32 endX = startFromBBox ? bBoxRight : width - 1;
-		s32 endY = startFromBBox ? bBoxBottom : height - 1;
+	}
 
-		s32 potentialTop = -1, potentialBottom = -1;
-		__setBBox(-1, -1, -1, -1);
+	s32 PixelBuffer::__getBandCount(s32 _top, s32 _bottom, s32 _bandRows) {
 
-		//Find bbox left and potential bbox top.
-		bool shouldBreak = false;
-		for (s32 x = startX; x <= endX; ++x) {
+		if (_bottom <= _top) return 0;
 
-			for (s32 y = startY; y <= endY; ++y) {
+		s32 alignedTop = (_top / ZIXEL_CHUNK_SIZE) * ZIXEL_CHUNK_SIZE;
+		return ((_bottom - alignedTop) + _bandRows - 1) / _bandRows;
 
-				if (readAlpha(x, y) == 0) continue;
+	}
 
-				bBoxLeft = x;
-				potentialTop = y;
+	void PixelBuffer::__forEachBand(s32 _top, s32 _bottom, s32 _bandRows, const std::function<void(s32, s32, s32)>& _func) {
 
-				shouldBreak = true;
-				break;
+		s32 alignedTop = (_top / ZIXEL_CHUNK_SIZE) * ZIXEL_CHUNK_SIZE;
+		s32 bandCount = __getBandCount(_top, _bottom, _bandRows);
 
-			}
+		auto runBand = [&](s32 _band) {
 
-			if (shouldBreak) break;
+			s32 bandTop = Math::maxInt(_top, alignedTop + (_band * _bandRows));
+			s32 bandBottom = Math::minInt(_bottom, alignedTop + ((_band + 1) * _bandRows));
 
-		}
+			_func(_band, bandTop, bandBottom);
+
+		};
 
-		if (bBoxLeft == -1) return;
-		else if (pixelCount == 1) {
+		if (bandCount == 1) {
 
-			bBoxRight = bBoxLeft;
-			bBoxTop = potentialTop;
-			bBoxBottom = potentialTop;
-			
+			runBand(0);
 			return;
 
 		}
 
-		//Find bbox right and potential bbox bottom.
-		shouldBreak = false;
-		for (s32 x = endX; x >= startX; --x) {
+		JobSystem::parallelFor(0, bandCount, 1, [&](s32 _first, s32 _last) {
+			for (s32 band = _first; band < _last; ++band) runBand(band);
+		});
 
-			for (s32 y = endY; y >= startY; --y) {
+	}
 
-				if (readAlpha(x, y) == 0) continue;
+	void PixelBuffer::__prepareBands(std::vector<PixelBufferBand>& _bands) {
 
-				bBoxRight = x;
-				potentialBottom = y;
+		if (!__hasPixelCounts()) return;
 
-				shouldBreak = true;
-				break;
+		//A single band can update the column counts directly, several bands would write to the same columns.
+		if (_bands.size() == 1) {
 
-			}
+			_bands[0].columnCountsPtr = columnPixelCounts.data();
+			return;
+
+		}
 
-			if (shouldBreak) break;
+		for (PixelBufferBand& band : _bands) {
+
+			band.columnCounts.assign((size_t)width, 0);
+			band.columnCountsPtr = band.columnCounts.data();
 
 		}
 
-		for (s32 x = bBoxLeft; x <= bBoxRight; ++x) {
+	}
 
-			//Find actual bbox top.
-			for (s32 y = startY; y < potentialTop; ++y) {
+	void PixelBuffer::__reduceBands(std::vector<PixelBufferBand>& _bands) {
 
-				if (readAlpha(x, y) > 0 && (bBoxTop == -1 || y < bBoxTop)) {
-					bBoxTop = y;
-				}
+		bool calcBBox = false;
 
-			}
+		for (PixelBufferBand& band : _bands) {
+
+			pixelCount += band.pixelCountDelta;
 
-			if (bBoxTop == -1) bBoxTop = potentialTop;
+			if (!band.columnCounts.empty()) {
+				for (s32 x = 0; x < width; ++x) columnPixelCounts[x] += band.columnCounts[x];
+			}
 
-			//Find actual bbox bottom.
-			for (s32 y = endY; y > potentialBottom; --y) {
+			if (useBBox && band.bBoxLeft != -1) {
 
-				if (readAlpha(x, y) > 0 && (bBoxBottom == -1 || y > bBoxBottom)) {
-					bBoxBottom = y;
-				}
+				checkBBoxIncrease(band.bBoxLeft, band.bBoxTop);
+				checkBBoxIncrease(band.bBoxRight, band.bBoxBottom);
 
 			}
 
-			if (bBoxBottom == -1) bBoxBottom = potentialBottom;
+			if (band.calcBBox) calcBBox = true;
 
 		}
 
-	}
+		if (calcBBox) calculateBBox(true);
 
-	bool PixelBuffer::isEmpty() {
-		return (pixelCount == 0);
 	}
 
-	void PixelBuffer::fill(Color4 _color) {
+	void PixelBuffer::__recountPixels() {
 
-		if (makeEmptyPixelsBlack && _color.a == 0) _color = { 0, 0, 0, 0 };
+		__setPixelCounts(0, 0);
 
-		s32 size = (width * height * 4);
-		for (s32 i = 0; i < size; i += 4) {
+		RowSpan span;
+		RowSpanIterator it = rowSpans();
 
-			buffer[i] = _color.r;
-			buffer[i + 1] = _color.g;
-			buffer[i + 2] = _color.b;
-			buffer[i + 3] = _color.a;
+		while (it.next(span)) {
 
-		}
+			if (span.nullTile) continue;
 
-		if (_color.a != 0) {
+			for (s32 i = 0; i < span.count; ++i) {
 
-			pixelCount = (width * height);
-			if (useBBox) __setBBox(0, 0, width - 1, height - 1);
+				if (span.data[((size_t)i * 4) + 3] == 0) continue;
 
-		}
-		else {
+				++rowPixelCounts[span.y];
+				++columnPixelCounts[span.x + i];
 
-			pixelCount = 0;
-			if (useBBox) __setBBox(-1, -1, -1, -1);
+			}
 
 		}
 
 	}
 
-	bool PixelBuffer::fillCheckModified(Color4 _color) {
+	void PixelBuffer::__setPixelCounts(s32 _rowCount, s32 _columnCount) {
 
-		bool modified = false;
+		rowPixelCounts.assign((size_t)height, _rowCount);
+		columnPixelCounts.assign((size_t)width, _columnCount);
 
-		if (makeEmptyPixelsBlack && _color.a == 0) _color = { 0, 0, 0, 0 };
+	}
 
-		s32 size = (width * height * 4);
-		for (s32 i = 0; i < size; i += 4) {
+	void PixelBuffer::markDirty(s32 _x, s32 _y, s32 _width, s32 _height) {
 
-			if (!Color::match(_color, { buffer[i], buffer[i + 1], buffer[i + 2], buffer[i + 3] })) {
+		if (!clipRect(_x, _y, _width, _height)) return;
 
-				buffer[i] = _color.r;
-				buffer[i + 1] = _color.g;
-				buffer[i + 2] = _color.b;
-				buffer[i + 3] = _color.a;
+		s32 right = _x + _width - 1;
+		s32 bottom = _y + _height - 1;
 
-				modified = true;
+		for (s32 blockY = _y / ZIXEL_CHUNK_SIZE; blockY <= bottom / ZIXEL_CHUNK_SIZE; ++blockY) {
+
+			for (s32 blockX = _x / ZIXEL_CHUNK_SIZE; blockX <= right / ZIXEL_CHUNK_SIZE; ++blockX) {
+
+				s32 left = Math::maxInt(_x, blockX * ZIXEL_CHUNK_SIZE);
+				s32 top = Math::maxInt(_y, blockY * ZIXEL_CHUNK_SIZE);
+
+				__markDirty(left, top);
+				__markDirty(Math::minInt(right, ((blockX + 1) * ZIXEL_CHUNK_SIZE) - 1), Math::minInt(bottom, ((blockY + 1) * ZIXEL_CHUNK_SIZE) - 1));
 
 			}
 
 		}
 
-		if (_color.a != 0) {
+	}
 
-			pixelCount = (width * height);
-			if (useBBox) __setBBox(0, 0, width - 1, height - 1);
+	void PixelBuffer::markAllDirty() {
 
-		}
-		else {
+		for (s32 blockY = 0; blockY < dirtyRows; ++blockY) {
 
-			pixelCount = 0;
-			if (useBBox) __setBBox(-1, -1, -1, -1);
+			for (s32 blockX = 0; blockX < dirtyColumns; ++blockX) {
+
+				DirtyBlock& block = dirtyBlocks[((size_t)blockY * (size_t)dirtyColumns) + (size_t)blockX];
+
+				block.left = blockX * ZIXEL_CHUNK_SIZE;
+				block.top = blockY * ZIXEL_CHUNK_SIZE;
+				block.right = Math::minInt(width, block.left + ZIXEL_CHUNK_SIZE) - 1;
+				block.bottom = Math::minInt(height, block.top + ZIXEL_CHUNK_SIZE) - 1;
+
+				++block.changeCount;
+
+			}
 
 		}
 
-		return modified;
+		changeCount.fetch_add(dirtyBlocks.size(), std::memory_order_relaxed);
+		dirty = (!dirtyBlocks.empty());
 
 	}
 
-	void PixelBuffer::writePixel(s32 _x, s32 _y, Color4 _color, BlendMode _blendMode, bool _calculateBBox) {
+	void PixelBuffer::getDirtyRects(std::vector<Rect>& _rects) {
 
-		if (_x < 0 || _y < 0 || _x >= width || _y >= height) {
+		_rects.clear();
+		if (!dirty) return;
 
-			ZIXEL_WARN("Error in PixelBuffer::writePixel. Write position ({}, {}) out of range. Valid range: (0-{}, 0-{})", _x, _y, width - 1, height - 1);
-			return;
+		//Rects that reach the bottom of the previous block row and can still grow downwards.
+		std::vector<size_t> open, nextOpen;
 
-		}
+		for (s32 blockY = 0; blockY < dirtyRows; ++blockY) {
 
-		if (_blendMode != BlendMode::Overwrite) _color = Color::blendColor(_color, readPixel(_x, _y), _blendMode);
-		if (makeEmptyPixelsBlack && _color.a == 0) _color = { 0, 0, 0, 0 };
+			size_t rowStart = _rects.size();
+			nextOpen.clear();
 
-		s32 ind = ((_y * width) + _x) * 4;
-		buffer[ind] = _color.r;
-		buffer[ind + 1] = _color.g;
-		buffer[ind + 2] = _color.b;
+			//Join blocks next to each other that cover the same rows.
+			for (s32 blockX = 0; blockX < dirtyColumns; ++blockX) {
 
-		u8 prevAlpha = buffer[ind + 3];
-		buffer[ind + 3] = _color.a;
+				DirtyBlock& block = dirtyBlocks[((size_t)blockY * (size_t)dirtyColumns) + (size_t)blockX];
+				if (block.left == -1) continue;
 
-		if (_color.a == 0 && prevAlpha != 0) {
+				if (_rects.size() > rowStart) {
 
-			--pixelCount;
-			if (useBBox && _calculateBBox) calculateBBox(true);
+					Rect& last = _rects.back();
+
+					if (last.x + last.width == block.left && last.y == block.top && last.y + last.height - 1 == block.bottom) {
+
+						last.width = block.right - last.x + 1;
+						continue;
+
+					}
+
+				}
+
+				_rects.push_back({ block.left, block.top, block.right - block.left + 1, block.bottom - block.top + 1 });
+
+			}
+
+			//Join rects with the rect right above them if they cover the same columns.
+			for (size_t i = rowStart; i < _rects.size();) {
+
+				Rect& rect = _rects[i];
+				bool joined = false;
+
+				for (size_t j : open) {
+
+					Rect& above = _rects[j];
+
+					if (above.x == rect.x && above.width == rect.width && above.y + above.height == rect.y) {
+
+						above.height += rect.height;
+						nextOpen.push_back(j);
+
+						joined = true;
+						break;
+
+					}
+
+				}
+
+				if (joined) _rects.erase(_rects.begin() + i);
+				else nextOpen.push_back(i++);
+
+			}
+
+			open.swap(nextOpen);
 
 		}
-		else if (_color.a != 0 && prevAlpha == 0) {
 
-			++pixelCount;
-			if (useBBox && _calculateBBox) checkBBoxIncrease(_x, _y);
+	}
 
+	void PixelBuffer::clearDirty() {
+
+		if (!dirty) return;
+
+		for (DirtyBlock& block : dirtyBlocks) {
+			block.left = block.top = block.right = block.bottom = -1;
 		}
 
+		dirty = false;
+
 	}
 
-	bool PixelBuffer::writePixelCheckModified(s32 _x, s32 _y, Color4 _color, BlendMode _blendMode, bool _calculateBBox) {
+	void SeenChanges::record(PixelBuffer* _buffer) {
 
-		if (_x < 0 || _y < 0 || _x >= width || _y >= height) {
+		changeCount = _buffer->changeCount.load(std::memory_order_relaxed);
+		blockChanges.resize(_buffer->dirtyBlocks.size());
 
-			ZIXEL_WARN("Error in PixelBuffer::writePixelCheckModified. Write position ({}, {}) out of range. Valid range: (0-{}, 0-{})", _x, _y, width - 1, height - 1);
-			return false;
+		for (size_t i = 0; i < _buffer->dirtyBlocks.size(); ++i) {
+			blockChanges[i] = _buffer->dirtyBlocks[i].changeCount;
+		}
+
+	}
+
+	bool SeenChanges::collect(PixelBuffer* _buffer, const std::function<void(s32)>& _changedBlock) {
+
+		u64 current = _buffer->changeCount.load(std::memory_order_relaxed);
+		if (current == changeCount && blockChanges.size() == _buffer->dirtyBlocks.size()) return false;
+
+		changeCount = current;
+
+		//Blocks of a buffer that hasn't been recorded yet count as changed if they were ever written to.
+		blockChanges.resize(_buffer->dirtyBlocks.size(), 0);
+
+		bool changed = false;
+
+		for (size_t i = 0; i < _buffer->dirtyBlocks.size(); ++i) {
+
+			u32 count = _buffer->dirtyBlocks[i].changeCount;
+			if (count == blockChanges[i]) continue;
+
+			blockChanges[i] = count;
+			_changedBlock((s32)i);
+
+			changed = true;
+
+		}
+
+		return changed;
+
+	}
+
+	void PixelBuffer::checkBBoxIncrease(s32 _x, s32 _y) {
+
+		if (bBoxLeft == -1) {
+
+			bBoxLeft = _x;
+			bBoxRight = _x;
+			bBoxTop = _y;
+			bBoxBottom = _y;
+
+			return;
+
+		}
+
+		if (_x < bBoxLeft) bBoxLeft = _x; else if (_x > bBoxRight) bBoxRight = _x;
+		if (_y < bBoxTop) bBoxTop = _y; else if (_y > bBoxBottom) bBoxBottom = _y;
+
+	}
+
+	void PixelBuffer::calculateBBox(bool _startFromCurrentBBox) {
+
+		if (isEmpty()) {
+
+			__setBBox(-1, -1, -1, -1);
+			return;
+
+		}
+
+		bool startFromBBox = (_startFromCurrentBBox && bBoxLeft != -1);
+
+		if (useBBox) {
+
+			//Shrink the bbox using the pixel counts, the cost only depends on how far the edges move.
+			bool recount = (!_startFromCurrentBBox || !__hasPixelCounts());
+
+			if (recount) __recountPixels();
+			if (recount || !startFromBBox) __setBBox(0, 0, width - 1, height - 1);
+
+			s32 left = bBoxLeft, top = bBoxTop, right = bBoxRight, bottom = bBoxBottom;
+
+			while (top <= bottom && rowPixelCounts[top] == 0) ++top;
+			while (bottom >= top && rowPixelCounts[bottom] == 0) --bottom;
+			while (left <= right && columnPixelCounts[left] == 0) ++left;
+			while (right >= left && columnPixelCounts[right] == 0) --right;
+
+			if (top > bottom || left > right) __setBBox(-1, -1, -1, -1);
+			else __setBBox(left, top, right, bottom);
+
+			return;
+
+		}
+
+		s32 startX = startFromBBox ? bBoxLeft : 0;
+		s32 startY = startFromBBox ? bBoxTop : 0;
+		s32 endX = startFromBBox ? bBoxRight : width - 1;
+		s32 endY = startFromBBox ? bBoxBottom : height - 1;
+
+		__setBBox(-1, -1, -1, -1);
+
+		//Find bbox top and bottom by testing whole rows.
+		for (s32 y = startY; y <= endY; ++y) {
+
+			if (spanHasAlpha(startX, y, endX - startX + 1)) {
+
+				bBoxTop = y;
+				break;
+
+			}
+
+		}
+
+		if (bBoxTop == -1) return;
+
+		for (s32 y = endY; y >= bBoxTop; --y) {
+
+			if (spanHasAlpha(startX, y, endX - startX + 1)) {
+
+				bBoxBottom = y;
+				break;
+
+			}
+
+		}
+
+		//Find bbox left and right. Each row only has to be scanned up to the bbox found so far.
+		s32 left = endX + 1;
+		s32 right = startX - 1;
+
+		for (s32 y = bBoxTop; y <= bBoxBottom; ++y) {
+
+			RowSpan span;
+
+			RowSpanIterator leftSpans = rowSpans(startX, y, left - startX, 1);
+			bool found = false;
+
+			while (!found && leftSpans.next(span)) {
+
+				for (s32 i = 0; i < span.count; ++i) {
+
+					if (span.data[(i * 4) + 3] == 0) continue;
+
+					left = span.x + i;
+					found = true;
+
+					break;
+
+				}
+
+			}
+
+			RowSpanIterator rightSpans = rowSpans(right + 1, y, endX - right, 1);
+			while (rightSpans.next(span)) {
+
+				for (s32 i = span.count - 1; i >= 0; --i) {
+
+					if (span.data[(i * 4) + 3] == 0) continue;
+
+					right = span.x + i;
+					break;
+
+				}
+
+			}
+
+		}
+
+		bBoxLeft = left;
+		bBoxRight = right;
+
+	}
+
+	bool PixelBuffer::isEmpty() {
+		return (pixelCount == 0);
+	}
+
+	void PixelBuffer::setAlphaMode(AlphaMode _alphaMode) {
+
+		if (alphaMode == _alphaMode) return;
+
+		AlphaMode prevAlphaMode = alphaMode;
+		alphaMode = _alphaMode;
+
+		//Alpha stays the same, so pixel counts and bbox don't change.
+		//Empty premultiplied buffers hold nothing but zeros, straight ones may still have color in transparent pixels.
+		if (pixelCount == 0 && prevAlphaMode == AlphaMode::Premultiplied) return;
+
+		__forEachBand(0, height, __getBandRows(0, height, width), [&](s32, s32 _top, s32 _bottom) {
+
+			RowSpan span;
+			RowSpanIterator it = rowSpans(0, _top, width, _bottom - _top);
+
+			while (it.next(span)) {
+
+				if (span.nullTile) continue;
+
+				u8* data = pixelPtrWrite(span.x, span.y);
+				__convertSpan(data, data, span.count, prevAlphaMode);
+
+			}
+
+		});
+
+		markAllDirty();
+
+	}
+
+	bool RowSpanIterator::next(RowSpan& _span) {
+
+		if (y > bottom) return false;
+
+		s32 end = right;
+		if (buffer->storage == PixelStorage::Tiled) end = Math::minInt(right, ((x / ZIXEL_CHUNK_SIZE) + 1) * ZIXEL_CHUNK_SIZE - 1);
+
+		_span.x = x;
+		_span.y = y;
+		_span.count = end - x + 1;
+
+		if (writable) {
+
+			_span.data = buffer->pixelPtrWrite(x, y);
+			_span.nullTile = false;
+
+		}
+		else {
+
+			_span.data = buffer->pixelPtr(x, y);
+			_span.nullTile = buffer->isNullTileAt(x, y);
+
+		}
+
+		x = end + 1;
+
+		if (x > right) {
+
+			x = left;
+			++y;
+
+		}
+
+		return true;
+
+	}
+
+	bool PixelBuffer::clipRect(s32& _x, s32& _y, s32& _width, s32& _height) {
+
+		s32 left = Math::maxInt(_x, 0);
+		s32 top = Math::maxInt(_y, 0);
+		s32 right = Math::minInt(_x + _width, width);
+		s32 bottom = Math::minInt(_y + _height, height);
+
+		if (left >= right || top >= bottom) {
+
+			_width = 0;
+			_height = 0;
+
+			return false;
+
+		}
+
+		_x = left;
+		_y = top;
+		_width = right - left;
+		_height = bottom - top;
+
+		return true;
+
+	}
+
+	s32 PixelBuffer::__wrapRect(s32 _x, s32 _y, s32 _width, s32 _height, Rect* _pieces) {
+
+		if (_width <= 0 || _height <= 0) return 0;
+
+		s32 columns[2][2], rows[2][2];
+		s32 columnCount = PixelBuffer_wrapRange(_x, _width, width, columns);
+		s32 rowCount = PixelBuffer_wrapRange(_y, _height, height, rows);
+
+		s32 count = 0;
+
+		for (s32 row = 0; row < rowCount; ++row) {
+			for (s32 column = 0; column < columnCount; ++column) _pieces[count++] = { columns[column][0], rows[row][0], columns[column][1], rows[row][1] };
+		}
+
+		return count;
+
+	}
+
+	RowSpanIterator PixelBuffer::rowSpans(bool _writable) {
+		return rowSpans(0, 0, width, height, _writable);
+	}
+
+	RowSpanIterator PixelBuffer::rowSpans(s32 _x, s32 _y, s32 _width, s32 _height, bool _writable) {
+
+		RowSpanIterator it;
+		it.buffer = this;
+		it.writable = _writable;
+
+		if (!clipRect(_x, _y, _width, _height)) return it;
+
+		it.left = _x;
+		it.top = _y;
+		it.right = _x + _width - 1;
+		it.bottom = _y + _height - 1;
+		it.x = _x;
+		it.y = _y;
+
+		return it;
+
+	}
+
+	bool PixelBuffer::spanHasAlpha(s32 _x, s32 _y, s32 _count) {
+
+		RowSpan span;
+		RowSpanIterator it = rowSpans(_x, _y, _count, 1);
+
+		while (it.next(span)) {
+
+			if (span.nullTile) continue;
+
+			const u8* data = span.data;
+			s32 i = 0;
+
+			//Test two pixels at a time.
+			for (; i + 2 <= span.count; i += 2) {
+
+				u64 pixels;
+				memcpy(&pixels, data + ((size_t)i * 4), 8);
+
+				if ((pixels & 0xFF000000FF000000ULL) != 0) return true;
+
+			}
+
+			if (i < span.count && data[((size_t)i * 4) + 3] != 0) return true;
+
+		}
+
+		return false;
+
+	}
+
+	void PixelBuffer::fill(Color4 _color) {
+
+		if (makeEmptyPixelsBlack && _color.a == 0) _color = { 0, 0, 0, 0 };
+		_color = __toStored(_color);
+
+		u32 packed;
+		memcpy(&packed, &_color, 4);
+
+		if (storage == PixelStorage::Tiled && packed == 0) {
+
+			for (size_t i = 0; i < tiles.size(); ++i) __releaseTile(i);
+
+		}
+		else if (storage == PixelStorage::Tiled) {
+
+			//Tiles fully inside the buffer share one filled tile and get copied on their first write, edge tiles are filled on their own.
+			PixelTile* filledTile = new PixelTile();
+
+			for (s32 i = 0; i < ZIXEL_CHUNK_SIZE * ZIXEL_CHUNK_SIZE; ++i) {
+				memcpy(filledTile->data + ((size_t)i * 4), &packed, 4);
+			}
+
+			for (s32 tileY = 0; tileY < tileRows; ++tileY) {
+
+				for (s32 tileX = 0; tileX < tileColumns; ++tileX) {
+
+					s32 tileLeft = tileX * ZIXEL_CHUNK_SIZE;
+					s32 tileTop = tileY * ZIXEL_CHUNK_SIZE;
+					size_t index = ((size_t)tileY * (size_t)tileColumns) + (size_t)tileX;
+
+					if (tileLeft + ZIXEL_CHUNK_SIZE <= width && tileTop + ZIXEL_CHUNK_SIZE <= height) {
+
+						PixelTile::release(tiles[index]);
+						tiles[index] = PixelTile::retain(filledTile);
+
+						continue;
+
+					}
+
+					RowSpan span;
+					RowSpanIterator it = rowSpans(tileLeft, tileTop, Math::minInt(ZIXEL_CHUNK_SIZE, width - tileLeft), Math::minInt(ZIXEL_CHUNK_SIZE, height - tileTop), true);
+
+					while (it.next(span)) {
+
+						for (s32 i = 0; i < span.count; ++i) {
+							memcpy(span.data + ((size_t)i * 4), &packed, 4);
+						}
+
+					}
+
+				}
+
+			}
+
+			PixelTile::release(filledTile);
+
+		}
+		else {
+
+			__forEachBand(0, height, __getBandRows(0, height, width), [&](s32, s32 _top, s32 _bottom) {
+
+				RowSpan span;
+				RowSpanIterator it = rowSpans(0, _top, width, _bottom - _top, true);
+
+				while (it.next(span)) {
+
+					for (s32 i = 0; i < span.count; ++i) {
+						memcpy(span.data + ((size_t)i * 4), &packed, 4);
+					}
+
+				}
+
+			});
+
+		}
+
+		markAllDirty();
+
+		if (_color.a != 0) {
+
+			pixelCount = (width * height);
+			if (__hasPixelCounts()) __setPixelCounts(width, height);
+			if (useBBox) __setBBox(0, 0, width - 1, height - 1);
+
+		}
+		else {
+
+			pixelCount = 0;
+			if (__hasPixelCounts()) __setPixelCounts(0, 0);
+			if (useBBox) __setBBox(-1, -1, -1, -1);
+
+		}
+
+	}
+
+	bool PixelBuffer::fillCheckModified(Color4 _color) {
+
+		if (makeEmptyPixelsBlack && _color.a == 0) _color = { 0, 0, 0, 0 };
+		_color = __toStored(_color);
+
+		u32 packed;
+		memcpy(&packed, &_color, 4);
+
+		s32 bandRows = __getBandRows(0, height, width);
+		std::vector<PixelBufferBand> bands((size_t)__getBandCount(0, height, bandRows));
+
+		__forEachBand(0, height, bandRows, [&](s32 _band, s32 _top, s32 _bottom) {
+
+			RowSpan span;
+			RowSpanIterator it = rowSpans(0, _top, width, _bottom - _top);
+
+			while (it.next(span)) {
+
+				//Null tiles already hold zeros everywhere.
+				if (span.nullTile && packed == 0) continue;
+
+				//Spans are compared before asking for a writable pointer, so shared tiles that already match aren't copied.
+				s32 first = 0;
+
+				for (; first < span.count; ++first) {
+
+					u32 current;
+					memcpy(&current, span.data + ((size_t)first * 4), 4);
+
+					if (current != packed) break;
+
+				}
+
+				if (first == span.count) continue;
+
+				u8* dest = pixelPtrWrite(span.x, span.y);
+				for (s32 i = first; i < span.count; ++i) memcpy(dest + ((size_t)i * 4), &packed, 4);
+
+				bands[_band].modified = true;
+
+			}
+
+		});
+
+		bool modified = false;
+		for (PixelBufferBand& band : bands) {
+			if (band.modified) modified = true;
+		}
+
+		if (_color.a != 0) {
+
+			pixelCount = (width * height);
+			if (__hasPixelCounts()) __setPixelCounts(width, height);
+			if (useBBox) __setBBox(0, 0, width - 1, height - 1);
+
+		}
+		else {
+
+			pixelCount = 0;
+			if (__hasPixelCounts()) __setPixelCounts(0, 0);
+			if (useBBox) __setBBox(-1, -1, -1, -1);
+
+		}
+
+		if (storage == PixelStorage::Tiled && packed == 0) {
+			for (size_t i = 0; i < tiles.size(); ++i) __releaseTile(i);
+		}
+
+		if (modified) markAllDirty();
+
+		return modified;
+
+	}
+
+	void PixelBuffer::writePixel(s32 _x, s32 _y, Color4 _color, BlendMode _blendMode, bool _calculateBBox) {
+
+		if (wrap && (_x < 0 || _y < 0 || _x >= width || _y >= height)) {
+
+			_x = __wrapX(_x);
+			_y = __wrapY(_y);
+
+		}
+
+		if (_x < 0 || _y < 0 || _x >= width || _y >= height) {
+
+			ZIXEL_WARN("Error in PixelBuffer::writePixel. Write position ({}, {}) out of range. Valid range: (0-{}, 0-{})", _x, _y, width - 1, height - 1);
+			return;
+
+		}
+
+		_color = __toStored(_color);
+
+		if (_blendMode != BlendMode::Overwrite) {
+
+			const u8* current = pixelPtr(_x, _y);
+			_color = __blendColor(_color, { current[0], current[1], current[2], current[3] }, _blendMode);
+
+		}
+
+		if (makeEmptyPixelsBlack && _color.a == 0) _color = { 0, 0, 0, 0 };
+
+		if (__writeIsNoop(_x, _y, _color)) return;
+
+		u8* pixel = pixelPtrWrite(_x, _y);
+		pixel[0] = _color.r;
+		pixel[1] = _color.g;
+		pixel[2] = _color.b;
+
+		u8 prevAlpha = pixel[3];
+		pixel[3] = _color.a;
+
+		__markDirty(_x, _y);
+
+		if (_color.a == 0 && prevAlpha != 0) {
+
+			--pixelCount;
+			__countPixel(_x, _y, -1);
+
+			if (useBBox && _calculateBBox) calculateBBox(true);
+
+		}
+		else if (_color.a != 0 && prevAlpha == 0) {
+
+			++pixelCount;
+			__countPixel(_x, _y, 1);
+
+			if (useBBox && _calculateBBox) checkBBoxIncrease(_x, _y);
+
+		}
+
+	}
+
+	bool PixelBuffer::writePixelCheckModified(s32 _x, s32 _y, Color4 _color, BlendMode _blendMode, bool _calculateBBox) {
+
+		if (wrap && (_x < 0 || _y < 0 || _x >= width || _y >= height)) {
+
+			_x = __wrapX(_x);
+			_y = __wrapY(_y);
+
+		}
+
+		if (_x < 0 || _y < 0 || _x >= width || _y >= height) {
+
+			ZIXEL_WARN("Error in PixelBuffer::writePixelCheckModified. Write position ({}, {}) out of range. Valid range: (0-{}, 0-{})", _x, _y, width - 1, height - 1);
+			return false;
+
+		}
+
+		_color = __toStored(_color);
+
+		if (_blendMode != BlendMode::Overwrite) {
+
+			const u8* current = pixelPtr(_x, _y);
+			_color = __blendColor(_color, { current[0], current[1], current[2], current[3] }, _blendMode);
+
+		}
+
+		if (makeEmptyPixelsBlack && _color.a == 0) _color = { 0, 0, 0, 0 };
+
+		u8* pixel = pixelPtr(_x, _y);
+		u8 prevAlpha = pixel[3];
+
+		if (!Color::match(_color, { pixel[0], pixel[1], pixel[2], prevAlpha })) {
+
+			pixel = pixelPtrWrite(_x, _y);
+
+			pixel[0] = _color.r;
+			pixel[1] = _color.g;
+			pixel[2] = _color.b;
+			pixel[3] = _color.a;
+
+			__markDirty(_x, _y);
+
+			if (_color.a == 0 && prevAlpha != 0) {
+
+				--pixelCount;
+				__countPixel(_x, _y, -1);
+
+				if (useBBox && _calculateBBox) calculateBBox(true);
+
+			}
+			else if (_color.a != 0 && prevAlpha == 0) {
+
+				++pixelCount;
+				__countPixel(_x, _y, 1);
+
+				if (useBBox && _calculateBBox) checkBBoxIncrease(_x, _y);
+
+			}
+
+			return true;
+
+		}
+
+		return false;
+
+	}
+
+	void PixelBuffer::writeLine(s32 _x1, s32 _y1, s32 _x2, s32 _y2, Color4 _color, BlendMode _blendMode, bool _writeFirstPixel, bool _calculateBBox) {
+
+		s32 deltaX = Math::absInt(_x2 - _x1);
+		s32 deltaY = Math::absInt(_y2 - _y1);
+
+		s32 signedX = (_x1 < _x2) ? 1 : -1;
+		s32 signedY = (_y1 < _y2) ? 1 : -1;
+
+		s32 err = deltaX - deltaY;
+
+		bool hasAlpha = (_color.a > 0);
+
+		if (_writeFirstPixel) writePixel(_x1, _y1, _color, _blendMode, hasAlpha && _calculateBBox); //This could break if we add some sort of blend mode that somehow changes the alpha.
+
+		//Wrapped position of the current pixel, stepped along with it so the line continues on the opposite edge.
+		//Lines aren't split into unwrapped pieces like rects, since a line longer than the buffer wraps more than four times and its pixels are written one by one either way.
+		s32 wrapX = wrap ? __wrapX(_x1) : 0;
+		s32 wrapY = wrap ? __wrapY(_y1) : 0;
+
+		while (_x1 != _x2 || _y1 != _y2) {
+
+			s32 err2 = err << 1;
+
+			if (err2 > -deltaY) {
+
+				err -= deltaY;
+				_x1 += signedX;
+				wrapX += signedX;
+
+			}
+
+			if (err2 < deltaX) {
+
+				err += deltaX;
+				_y1 += signedY;
+				wrapY += signedY;
+
+			}
+
+			if (wrap) {
+
+				if (wrapX == width) wrapX = 0; else if (wrapX < 0) wrapX = width - 1;
+				if (wrapY == height) wrapY = 0; else if (wrapY < 0) wrapY = height - 1;
+
+				writePixel(wrapX, wrapY, _color, _blendMode, hasAlpha && _calculateBBox);
+				continue;
+
+			}
+
+			if (_x1 < 0 || _y1 < 0 || _x1 >= width || _y1 >= height) continue;
+
+			writePixel(_x1, _y1, _color, _blendMode, hasAlpha && _calculateBBox);
+
+		}
+
+		if (useBBox && _calculateBBox && !hasAlpha) {
+			calculateBBox(true);
+		}
+
+	}
+
+	bool PixelBuffer::writeLineCheckModified(s32 _x1, s32 _y1, s32 _x2, s32 _y2, Color4 _color, BlendMode _blendMode, bool _writeFirstPixel, bool _calculateBBox) {
+
+		s32 deltaX = Math::absInt(_x2 - _x1);
+		s32 deltaY = Math::absInt(_y2 - _y1);
+
+		s32 signedX = (_x1 < _x2) ? 1 : -1;
+		s32 signedY = (_y1 < _y2) ? 1 : -1;
+
+		s32 err = deltaX - deltaY;
+
+		bool hasAlpha = (_color.a > 0);
+
+		bool modified = _writeFirstPixel ? writePixelCheckModified(_x1, _y1, _color, _blendMode, hasAlpha && _calculateBBox) : false; //This could break if we add some sort of blend mode that somehow changes the alpha.
+
+		//Wrapped position of the current pixel, stepped along with it so the line continues on the opposite edge.
+		//Lines aren't split into unwrapped pieces like rects, since a line longer than the buffer wraps more than four times and its pixels are written one by one either way.
+		s32 wrapX = wrap ? __wrapX(_x1) : 0;
+		s32 wrapY = wrap ? __wrapY(_y1) : 0;
+
+		while (_x1 != _x2 || _y1 != _y2) {
+
+			s32 err2 = err << 1;
+
+			if (err2 > -deltaY) {
+
+				err -= deltaY;
+				_x1 += signedX;
+				wrapX += signedX;
+
+			}
+
+			if (err2 < deltaX) {
+
+				err += deltaX;
+				_y1 += signedY;
+				wrapY += signedY;
+
+			}
+
+			if (wrap) {
+
+				if (wrapX == width) wrapX = 0; else if (wrapX < 0) wrapX = width - 1;
+				if (wrapY == height) wrapY = 0; else if (wrapY < 0) wrapY = height - 1;
+
+			}
+
+			s32 x = wrap ? wrapX : _x1;
+			s32 y = wrap ? wrapY : _y1;
+
+			if (x < 0 || y < 0 || x >= width || y >= height) continue;
+
+			if (writePixelCheckModified(x, y, _color, _blendMode, hasAlpha && _calculateBBox)) {
+				modified = true;
+			}
+
+		}
+
+		if (modified) {
+
+			if (useBBox && _calculateBBox && !hasAlpha) {
+				calculateBBox(true);
+			}
+
+		}
+
+		return modified;
+
+	}
+
+	void PixelBuffer::writeRect(s32 _x, s32 _y, s32 _width, s32 _height, Color4 _color, BlendMode _blendMode, bool _calculateBBox) {
+
+		if (!wrap) {
+
+			__writeRect(_x, _y, _width, _height, _color, _blendMode, _calculateBBox);
+			return;
+
+		}
+
+		Rect pieces[4];
+		s32 count = __wrapRect(_x, _y, _width, _height, pieces);
+
+		for (s32 i = 0; i < count; ++i) __writeRect(pieces[i].x, pieces[i].y, pieces[i].width, pieces[i].height, _color, _blendMode, _calculateBBox);
+
+	}
+
+	void PixelBuffer::__writeRect(s32 _x, s32 _y, s32 _width, s32 _height, Color4 _color, BlendMode _blendMode, bool _calculateBBox) {
+
+		if (!clipRect(_x, _y, _width, _height)) {
+			return;
+		}
+
+		_color = __toStored(_color);
+
+		//One row of the source color, blended onto every row of the rect.
+		std::vector<Color4> source((size_t)_width, _color);
+
+		bool skipNullTiles = __canSkipNullTiles(_color, _blendMode);
+
+		bool calcBBox = false;
 
-		}
+		RowSpan span;
+		RowSpanIterator it = rowSpans(_x, _y, _width, _height);
 
-		if (_blendMode != BlendMode::Overwrite) _color = Color::blendColor(_color, readPixel(_x, _y), _blendMode);
-		if (makeEmptyPixelsBlack && _color.a == 0) _color = { 0, 0, 0, 0 };
+		while (it.next(span)) {
 
-		s32 ind = ((_y * width) + _x) * 4;
-		u8 prevAlpha = buffer[ind + 3];
+			if (span.nullTile && skipNullTiles) continue;
 
-		if (!Color::match(_color, { buffer[ind], buffer[ind + 1], buffer[ind + 2], prevAlpha })) {
+			BlendSpanResult result;
+			__blendSpan(pixelPtrWrite(span.x, span.y), (const u8*)source.data(), span.count, _blendMode, nullptr, result, __columnCountsAt(span.x));
 
-			buffer[ind] = _color.r;
-			buffer[ind + 1] = _color.g;
-			buffer[ind + 2] = _color.b;
-			buffer[ind + 3] = _color.a;
+			if (result.modified) markDirty(span.x, span.y, span.count, 1);
 
-			if (_color.a == 0 && prevAlpha != 0) {
+			pixelCount += result.pixelCountDelta;
+			if (__hasPixelCounts()) rowPixelCounts[span.y] += result.pixelCountDelta;
 
-				--pixelCount;
-				if (useBBox && _calculateBBox) calculateBBox(true);
+			if (result.removedPixels) calcBBox = true;
 
-			}
-			else if (_color.a != 0 && prevAlpha == 0) {
+			if (result.firstAddedIndex != -1 && _calculateBBox && useBBox) {
 
-				++pixelCount;
-				if (useBBox && _calculateBBox) checkBBoxIncrease(_x, _y);
+				checkBBoxIncrease(span.x + result.firstAddedIndex, span.y);
+				checkBBoxIncrease(span.x + result.lastAddedIndex, span.y);
 
 			}
 
-			return true;
-
 		}
 
-		return false;
+		if (calcBBox && _calculateBBox && useBBox) calculateBBox(true);
 
 	}
 
-	void PixelBuffer::writeLine(s32 _x1, s32 _y1, s32 _x2, s32 _y2, Color4 _color, BlendMode _blendMode, bool _writeFirstPixel, bool _calculateBBox) {
+	bool PixelBuffer::writeSpan(s32 _x, s32 _y, s32 _count, const u8* _data, BlendMode _blendMode, bool _calculateBBox) {
 
-		s32 deltaX = Math::absInt(_x2 - _x1);
-		s32 deltaY = Math::absInt(_y2 - _y1);
+		s32 x = _x, y = _y, count = _count, rows = 1;
+		if (!clipRect(x, y, count, rows)) return false;
 
-		s32 signedX = (_x1 < _x2) ? 1 : -1;
-		s32 signedY = (_y1 < _y2) ? 1 : -1;
+		_data += (size_t)(x - _x) * 4;
 
-		s32 err = deltaX - deltaY;
+		std::vector<PixelBufferBand> bands(1);
+		__prepareBands(bands);
 
-		bool hasAlpha = (_color.a > 0);
+		PixelBufferBand& band = bands[0];
 
-		if (_writeFirstPixel) writePixel(_x1, _y1, _color, _blendMode, hasAlpha && _calculateBBox); //This could break if we add some sort of blend mode that somehow changes the alpha.
+		RowSpan span;
+		RowSpanIterator it = rowSpans(x, y, count, 1);
 
-		while (_x1 != _x2 || _y1 != _y2) {
+		while (it.next(span)) {
 
-			s32 err2 = err << 1;
+			const u8* source = _data + ((size_t)(span.x - x) * 4);
 
-			if (err2 > -deltaY) {
+			//Null tiles only need to be touched if the span would change them.
+			if (span.nullTile) {
 
-				err -= deltaY;
-				_x1 += signedX;
+				if (_blendMode == BlendMode::Overwrite && PixelBuffer_isZero(source, (size_t)span.count * 4)) continue;
 
-			}
+				if (_blendMode != BlendMode::Overwrite) {
 
-			if (err2 < deltaX) {
+					bool hasAlpha = false;
+					for (s32 i = 0; i < span.count && !hasAlpha; ++i) hasAlpha = (source[((size_t)i * 4) + 3] != 0);
 
-				err += deltaX;
-				_y1 += signedY;
+					if (!hasAlpha) continue;
+
+				}
 
 			}
 
-			if (_x1 < 0 || _y1 < 0 || _x1 >= width || _y1 >= height) continue;
+			BlendSpanResult result;
+			__blendSpan(pixelPtrWrite(span.x, span.y), source, span.count, _blendMode, nullptr, result, (band.columnCountsPtr != nullptr) ? (band.columnCountsPtr + span.x) : nullptr);
 
-			writePixel(_x1, _y1, _color, _blendMode, hasAlpha && _calculateBBox);
+			__applyBlendSpanResult(result, span.x, span.y, span.count, band);
 
 		}
 
-		if (useBBox && _calculateBBox && !hasAlpha) {
-			calculateBBox(true);
+		if (!_calculateBBox) {
+
+			band.calcBBox = false;
+			band.bBoxLeft = -1;
+
 		}
 
+		__reduceBands(bands);
+
+		return band.modified;
+
 	}
 
-	bool PixelBuffer::writeLineCheckModified(s32 _x1, s32 _y1, s32 _x2, s32 _y2, Color4 _color, BlendMode _blendMode, bool _writeFirstPixel, bool _calculateBBox) {
+	bool PixelBuffer::writeTiles(const std::vector<s32>& _tiles, const std::function<bool(s32, s32, u8*)>& _drawTile) {
 
-		s32 deltaX = Math::absInt(_x2 - _x1);
-		s32 deltaY = Math::absInt(_y2 - _y1);
+		//Tiles are drawn into scratch memory, since writes update counts shared by the whole buffer and have to happen one after another.
+		const size_t tileSize = (size_t)ZIXEL_CHUNK_SIZE * ZIXEL_CHUNK_SIZE * 4;
+		const s32 batchSize = Math::maxInt(JobSystem::getThreadCount() * 8, 16);
+		const s32 columns = (width + ZIXEL_CHUNK_SIZE - 1) / ZIXEL_CHUNK_SIZE; //Contiguous buffers don't set tileColumns.
 
-		s32 signedX = (_x1 < _x2) ? 1 : -1;
-		s32 signedY = (_y1 < _y2) ? 1 : -1;
+		std::vector<u8> scratch((size_t)Math::minInt(batchSize, (s32)_tiles.size()) * tileSize);
+		std::vector<u8> drawn((size_t)batchSize, 0);
+		bool changed = false;
 
-		s32 err = deltaX - deltaY;
+		for (s32 batchStart = 0; batchStart < (s32)_tiles.size(); batchStart += batchSize) {
 
-		bool hasAlpha = (_color.a > 0);
+			s32 batchCount = Math::minInt(batchSize, (s32)_tiles.size() - batchStart);
 
-		bool modified = _writeFirstPixel ? writePixelCheckModified(_x1, _y1, _color, _blendMode, hasAlpha && _calculateBBox) : false; //This could break if we add some sort of blend mode that somehow changes the alpha.
+			JobSystem::parallelFor(0, batchCount, 1, [&](s32 _first, s32 _last) {
 
-		while (_x1 != _x2 || _y1 != _y2) {
+				for (s32 i = _first; i < _last; ++i) {
 
-			s32 err2 = err << 1;
+					s32 tile = _tiles[(size_t)(batchStart + i)];
+					drawn[i] = _drawTile(tile % columns, tile / columns, scratch.data() + ((size_t)i * tileSize));
 
-			if (err2 > -deltaY) {
+				}
 
-				err -= deltaY;
-				_x1 += signedX;
+			});
 
-			}
+			for (s32 i = 0; i < batchCount; ++i) {
 
-			if (err2 < deltaX) {
+				s32 tile = _tiles[(size_t)(batchStart + i)];
 
-				err += deltaX;
-				_y1 += signedY;
+				s32 x = (tile % columns) * ZIXEL_CHUNK_SIZE;
+				s32 y = (tile / columns) * ZIXEL_CHUNK_SIZE;
+				s32 w = Math::minInt(ZIXEL_CHUNK_SIZE, width - x);
+				s32 h = Math::minInt(ZIXEL_CHUNK_SIZE, height - y);
 
-			}
+				u8* data = scratch.data() + ((size_t)i * tileSize);
 
-			if (_x1 < 0 || _y1 < 0 || _x1 >= width || _y1 >= height) continue;
+				if (!drawn[i]) {
 
-			if (writePixelCheckModified(_x1, _y1, _color, _blendMode, hasAlpha && _calculateBBox)) {
-				modified = true;
-			}
+					if (isNullTileAt(x, y)) continue;
+					memset(data, 0, tileSize);
 
-		}
+				}
 
-		if (modified) {
+				for (s32 row = 0; row < h; ++row) {
+					if (writeSpan(x, y + row, w, data + ((size_t)row * ZIXEL_CHUNK_SIZE * 4))) changed = true;
+				}
+
+				//Keeps the buffer sparse where the drawn tiles are empty.
+				if (isTiled() && !isNullTileAt(x, y) && PixelBuffer_isZero(data, tileSize)) __releaseTile(__tileIndex(x, y));
 
-			if (useBBox && _calculateBBox && !hasAlpha) {
-				calculateBBox(true);
 			}
 
 		}
 
-		return modified;
+		return changed;
 
 	}
 
-	void PixelBuffer::writeRect(s32 _x, s32 _y, s32 _width, s32 _height, Color4 _color, BlendMode _blendMode, bool _calculateBBox) {
-
-		if (_x >= width || _y >= height || _x + _width - 1 < 0 || _y + _height - 1 < 0) {
-			return;
-		}
+	bool PixelBuffer::markTiles(std::vector<u8>& _grid, s32 _width, s32 _height, s32 _x, s32 _y, s32 _areaWidth, s32 _areaHeight) {
 
-		bool calcBBox = false;
+		s32 right = Math::minInt(_x + _areaWidth, _width) - 1;
+		s32 bottom = Math::minInt(_y + _areaHeight, _height) - 1;
 
-		for (s32 pixelX = Math::maxInt(_x, 0); pixelX < Math::minInt(_x + _width, width); ++pixelX) {
-			for (s32 pixelY = Math::maxInt(_y, 0); pixelY < Math::minInt(_y + _height, height); ++pixelY) {
+		_x = Math::maxInt(_x, 0);
+		_y = Math::maxInt(_y, 0);
 
-				Color4 dest = readPixel(pixelX, pixelY);
-				Color4 blended = Color::blendColor(_color, dest, _blendMode);
+		if (_x > right || _y > bottom) return false;
 
-				writePixel(pixelX, pixelY, blended, BlendMode::Overwrite, false);
+		const s32 columns = (_width + ZIXEL_CHUNK_SIZE - 1) / ZIXEL_CHUNK_SIZE;
 
-				if (blended.a == 0 && dest.a > 0) calcBBox = true;
-				else if (blended.a > 0 && dest.a == 0 && _calculateBBox) checkBBoxIncrease(pixelX, pixelY);
+		for (s32 tileY = _y / ZIXEL_CHUNK_SIZE; tileY <= bottom / ZIXEL_CHUNK_SIZE; ++tileY) {
 
+			for (s32 tileX = _x / ZIXEL_CHUNK_SIZE; tileX <= right / ZIXEL_CHUNK_SIZE; ++tileX) {
+				_grid[((size_t)tileY * (size_t)columns) + (size_t)tileX] = 1;
 			}
+
 		}
 
-		if (calcBBox && _calculateBBox) calculateBBox(true);
+		return true;
 
 	}
 
@@ -479,10 +1553,23 @@ namespace Zixel {
 
 		}
 
-		s32 ind = ((_y * width) + _x) * 4;
+		if (isPremultiplied()) {
+
+			Color4 color = readPixel(_x, _y);
+			color.r = _red;
+
+			writePixel(_x, _y, color);
+			return;
+
+		}
+
+		u8* pixel = pixelPtr(_x, _y);
 
-		if (makeEmptyPixelsBlack && buffer[ind + 3] == 0) _red = 0;
-		buffer[ind] = _red;
+		if (makeEmptyPixelsBlack && pixel[3] == 0) _red = 0;
+		if (pixel[0] == _red) return;
+
+		pixelPtrWrite(_x, _y)[0] = _red;
+		__markDirty(_x, _y);
 
 	}
 
@@ -495,10 +1582,23 @@ namespace Zixel {
 
 		}
 
-		s32 ind = ((_y * width) + _x) * 4;
+		if (isPremultiplied()) {
+
+			Color4 color = readPixel(_x, _y);
+			color.g = _green;
+
+			writePixel(_x, _y, color);
+			return;
+
+		}
+
+		u8* pixel = pixelPtr(_x, _y);
+
+		if (makeEmptyPixelsBlack && pixel[3] == 0) _green = 0;
+		if (pixel[1] == _green) return;
 
-		if (makeEmptyPixelsBlack && buffer[ind + 3] == 0) _green = 0;
-		buffer[ind + 1] = _green;
+		pixelPtrWrite(_x, _y)[1] = _green;
+		__markDirty(_x, _y);
 
 	}
 
@@ -511,10 +1611,23 @@ namespace Zixel {
 
 		}
 
-		s32 ind = ((_y * width) + _x) * 4;
+		if (isPremultiplied()) {
+
+			Color4 color = readPixel(_x, _y);
+			color.b = _blue;
+
+			writePixel(_x, _y, color);
+			return;
+
+		}
+
+		u8* pixel = pixelPtr(_x, _y);
 
-		if (makeEmptyPixelsBlack && buffer[ind + 3] == 0) _blue = 0;
-		buffer[ind + 2] = _blue;
+		if (makeEmptyPixelsBlack && pixel[3] == 0) _blue = 0;
+		if (pixel[2] == _blue) return;
+
+		pixelPtrWrite(_x, _y)[2] = _blue;
+		__markDirty(_x, _y);
 
 	}
 
@@ -534,20 +1647,36 @@ namespace Zixel {
 
 		}
 
-		s32 ind = ((_y * width) + _x) * 4;
+		//Colors have to be scaled to the new alpha.
+		if (isPremultiplied()) {
+
+			Color4 color = readPixel(_x, _y);
+			color.a = _alpha;
+
+			writePixel(_x, _y, color, BlendMode::Overwrite, _calculateBBox);
+			return;
+
+		}
+
+		u8 prevAlpha = pixelPtr(_x, _y)[3];
+		if (prevAlpha == _alpha) return;
 
-		u8 prevAlpha = buffer[ind + 3];
-		buffer[ind + 3] = _alpha;
+		pixelPtrWrite(_x, _y)[3] = _alpha;
+		__markDirty(_x, _y);
 
 		if (_alpha == 0 && prevAlpha != 0) {
 
 			--pixelCount;
+			__countPixel(_x, _y, -1);
+
 			if (useBBox && _calculateBBox) calculateBBox(true);
 
 		}
 		else if (_alpha != 0 && prevAlpha == 0) {
 
 			++pixelCount;
+			__countPixel(_x, _y, 1);
+
 			if (useBBox && _calculateBBox) checkBBoxIncrease(_x, _y);
 
 		}
@@ -563,8 +1692,7 @@ namespace Zixel {
 
 		}
 
-		s32 ind = ((_y * width) + _x) * 4;
-		u8 prevAlpha = buffer[ind + 3];
+		u8 prevAlpha = pixelPtr(_x, _y)[3];
 
 		if (prevAlpha == _alpha) return false;
 
@@ -575,17 +1703,31 @@ namespace Zixel {
 
 		}
 
-		buffer[ind + 3] = _alpha;
+		if (isPremultiplied()) {
+
+			Color4 color = readPixel(_x, _y);
+			color.a = _alpha;
+
+			return writePixelCheckModified(_x, _y, color, BlendMode::Overwrite, _calculateBBox);
+
+		}
+
+		pixelPtrWrite(_x, _y)[3] = _alpha;
+		__markDirty(_x, _y);
 
 		if (_alpha == 0 && prevAlpha != 0) {
 
 			--pixelCount;
+			__countPixel(_x, _y, -1);
+
 			if (useBBox && _calculateBBox) calculateBBox(true);
 
 		}
 		else if (_alpha != 0 && prevAlpha == 0) {
 
 			++pixelCount;
+			__countPixel(_x, _y, 1);
+
 			if (useBBox && _calculateBBox) checkBBoxIncrease(_x, _y);
 
 		}
@@ -603,9 +1745,9 @@ namespace Zixel {
 
 		}
 
-		s32 ind = ((_y * width) + _x) * 4;
+		const u8* pixel = pixelPtr(_x, _y);
 
-		return { buffer[ind], buffer[ind + 1], buffer[ind + 2], buffer[ind + 3] };
+		return __fromStored({ pixel[0], pixel[1], pixel[2], pixel[3] });
 
 	}
 
@@ -618,9 +1760,8 @@ namespace Zixel {
 
 		}
 
-		s32 ind = ((_y * width) + _x) * 4;
-
-		return buffer[ind];
+		if (isPremultiplied()) return readPixel(_x, _y).r;
+		return pixelPtr(_x, _y)[0];
 
 	}
 
@@ -633,9 +1774,8 @@ namespace Zixel {
 
 		}
 
-		s32 ind = ((_y * width) + _x) * 4;
-
-		return buffer[ind + 1];
+		if (isPremultiplied()) return readPixel(_x, _y).g;
+		return pixelPtr(_x, _y)[1];
 
 	}
 
@@ -648,9 +1788,8 @@ namespace Zixel {
 
 		}
 
-		s32 ind = ((_y * width) + _x) * 4;
-
-		return buffer[ind + 2];
+		if (isPremultiplied()) return readPixel(_x, _y).b;
+		return pixelPtr(_x, _y)[2];
 
 	}
 
@@ -663,9 +1802,7 @@ namespace Zixel {
 
 		}
 
-		s32 ind = ((_y * width) + _x) * 4;
-
-		return buffer[ind + 3];
+		return pixelPtr(_x, _y)[3];
 
 	}
 
@@ -678,10 +1815,109 @@ namespace Zixel {
 
 		}
 
-		memcpy_s(buffer, ((size_t)width * (size_t)height * 4), _sourceBuffer->buffer, ((size_t)_sourceBuffer->width * (size_t)_sourceBuffer->height * 4));
+		if (alphaMode != _sourceBuffer->alphaMode) {
+
+			//Pixels are converted on the way, so tiles can't be shared. Tiled buffers split the spans the same way, contiguous ones don't split them.
+			PixelBuffer* spanBuffer = (_sourceBuffer->storage == PixelStorage::Tiled) ? _sourceBuffer : this;
+
+			__forEachBand(0, height, __getBandRows(0, height, width), [&](s32, s32 _top, s32 _bottom) {
+
+				RowSpan span;
+				RowSpanIterator it = spanBuffer->rowSpans(0, _top, width, _bottom - _top);
+
+				while (it.next(span)) {
+
+					const u8* source = _sourceBuffer->pixelPtr(span.x, span.y);
+					if (isNullTileAt(span.x, span.y) && PixelBuffer_isZero(source, (size_t)span.count * 4)) continue;
+
+					__convertSpan(pixelPtrWrite(span.x, span.y), source, span.count, _sourceBuffer->alphaMode);
+
+				}
+
+			});
+
+			if (storage == PixelStorage::Tiled) releaseEmptyTiles();
+			markAllDirty();
+
+		}
+		else if (storage == PixelStorage::Contiguous && _sourceBuffer->storage == PixelStorage::Contiguous) {
+
+			__forEachBand(0, height, __getBandRows(0, height, width), [&](s32, s32 _top, s32 _bottom) {
+
+				size_t offset = (size_t)_top * (size_t)width * 4;
+				size_t size = (size_t)(_bottom - _top) * (size_t)width * 4;
+
+				memcpy_s(buffer + offset, size, _sourceBuffer->buffer + offset, size);
+
+			});
+
+			markAllDirty();
+
+		}
+		else if (storage == PixelStorage::Tiled && _sourceBuffer->storage == PixelStorage::Tiled) {
+
+			//Tiles are shared instead of copied, they're only duplicated once either buffer writes to them.
+			for (size_t i = 0; i < tiles.size(); ++i) {
+
+				if (tiles[i] == _sourceBuffer->tiles[i]) continue;
+
+				__releaseTile(i);
+				tiles[i] = PixelTile::retain(_sourceBuffer->tiles[i]);
+
+				s32 tileX = (s32)(i % (size_t)tileColumns) * ZIXEL_CHUNK_SIZE;
+				s32 tileY = (s32)(i / (size_t)tileColumns) * ZIXEL_CHUNK_SIZE;
+				markDirty(tileX, tileY, ZIXEL_CHUNK_SIZE, ZIXEL_CHUNK_SIZE);
+
+			}
+
+		}
+		else {
+
+			//Mixed storage, the tiled buffer decides where the spans are split.
+			PixelBuffer* tiledBuffer = (storage == PixelStorage::Tiled) ? this : _sourceBuffer;
+
+			__forEachBand(0, height, __getBandRows(0, height, width), [&](s32, s32 _top, s32 _bottom) {
+
+				RowSpan span;
+				RowSpanIterator it = tiledBuffer->rowSpans(0, _top, width, _bottom - _top);
+
+				while (it.next(span)) {
+
+					size_t size = (size_t)span.count * 4;
+
+					if (tiledBuffer == this) {
+
+						const u8* source = _sourceBuffer->pixelPtr(span.x, span.y);
+						if (span.nullTile && PixelBuffer_isZero(source, size)) continue;
+
+						memcpy(pixelPtrWrite(span.x, span.y), source, size);
+
+					}
+					else memcpy(pixelPtrWrite(span.x, span.y), span.data, size);
+
+				}
+
+			});
+
+			if (tiledBuffer == this) releaseEmptyTiles();
+			markAllDirty();
+
+		}
 		
 		pixelCount = _sourceBuffer->pixelCount;
 
+		if (__hasPixelCounts()) {
+
+			if (_sourceBuffer->__hasPixelCounts()) {
+
+				rowPixelCounts = _sourceBuffer->rowPixelCounts;
+				columnPixelCounts = _sourceBuffer->columnPixelCounts;
+
+			}
+			else __recountPixels();
+
+		}
+
 		//This just copies the bbox directly from the source buffer.
 		//If the source buffer's bbox hasn't been calculated properly, the destination buffer's bbox will be incorrect too.
 		if (useBBox) __setBBox(_sourceBuffer->bBoxLeft, _sourceBuffer->bBoxTop, _sourceBuffer->bBoxRight, _sourceBuffer->bBoxBottom);
@@ -697,84 +1933,163 @@ namespace Zixel {
 
 		}
 
+		return merge(_sourceBuffer, 0, 0, _blendMode, _sourceOpacity);
+
+	}
+
+	bool PixelBuffer::merge(PixelBuffer* _sourceBuffer, s32 _destX, s32 _destY, BlendMode _blendMode, f32 _sourceOpacity, MaskBuffer* _maskBuffer) {
+
+		if (!wrap) return __merge(_sourceBuffer, _destX, _destY, _blendMode, _sourceOpacity, _maskBuffer);
+
+		//The source is merged at every offset of the buffer size that overlaps the buffer, at most 4 for sources that fit inside it.
+		//Larger sources overlap themselves.
+		s32 startX = __wrapX(_destX);
+		s32 startY = __wrapY(_destY);
+
 		bool modified = false;
-		bool calcBBox = false;
 
-		for (s32 x = 0; x < width; ++x) {
+		for (s32 y = startY; y > -_sourceBuffer->height; y -= height) {
 
-			for (s32 y = 0; y < height; ++y) {
+			for (s32 x = startX; x > -_sourceBuffer->width; x -= width) {
+				if (__merge(_sourceBuffer, x, y, _blendMode, _sourceOpacity, _maskBuffer)) modified = true;
+			}
 
-				Color4 source = _sourceBuffer->readPixel(x, y);
-				source.a = (u8)roundf(source.a * _sourceOpacity);
+		}
 
-				Color4 dest = readPixel(x, y);
-				
-				Color4 blended = Color::blendColor(source, dest, _blendMode);
-				if (!Color::match(dest, blended)) {
+		return modified;
 
-					writePixel(x, y, blended, BlendMode::Overwrite, false);
-					modified = true;
+	}
 
-				}
+	bool PixelBuffer::__merge(PixelBuffer* _sourceBuffer, s32 _destX, s32 _destY, BlendMode _blendMode, f32 _sourceOpacity, MaskBuffer* _maskBuffer) {
 
-				if (useBBox) {
+		//Area of the source to merge, only the selected part of it if there's a mask.
+		s32 sourceLeft = 0, sourceTop = 0, sourceRight = _sourceBuffer->width - 1, sourceBottom = _sourceBuffer->height - 1;
 
-					if (dest.a == 0 && blended.a > 0) checkBBoxIncrease(x, y);
-					else if (dest.a > 0 && blended.a == 0) calcBBox = true;
+		if (_maskBuffer != nullptr) {
 
-				}
+			s32 maskLeft, maskTop, maskRight, maskBottom;
+			if (!_maskBuffer->getBBox(maskLeft, maskTop, maskRight, maskBottom)) return false;
 
-			}
+			sourceLeft = maskLeft;
+			sourceTop = maskTop;
+			sourceRight = Math::minInt(sourceRight, maskRight);
+			sourceBottom = Math::minInt(sourceBottom, maskBottom);
 
 		}
 
-		if (calcBBox) calculateBBox(true);
-		
-		return modified;
+		s32 left = Math::maxInt(_destX + sourceLeft, 0);
+		s32 top = Math::maxInt(_destY + sourceTop, 0);
+		s32 right = Math::minInt(_destX + sourceRight + 1, width);
+		s32 bottom = Math::minInt(_destY + sourceBottom + 1, height);
 
-	}
+		if (left >= right || top >= bottom) return false;
 
-	bool PixelBuffer::merge(PixelBuffer* _sourceBuffer, s32 _destX, s32 _destY, BlendMode _blendMode, f32 _sourceOpacity, MaskBuffer* _maskBuffer) {
+		u8 opacityTable[256];
+		if (_sourceOpacity != 1.0f) BlendKernel::createOpacityTable(_sourceOpacity, opacityTable);
 
-		if (_destX >= width || _destY >= height || _destX + _sourceBuffer->width - 1 < 0 || _destY + _sourceBuffer->height - 1 < 0) return false;
+		const u8* table = (_sourceOpacity != 1.0f) ? opacityTable : nullptr;
 
-		bool modified = false;
-		bool calcBBox = false;
+		s32 columns = right - left;
 
-		s32 endX = Math::minInt(_destX + _sourceBuffer->width - 1, width - 1);
-		s32 endY = Math::minInt(_destY + _sourceBuffer->height - 1, height - 1);
+		s32 bandRows = __getBandRows(top, bottom, columns);
+		std::vector<PixelBufferBand> bands((size_t)__getBandCount(top, bottom, bandRows));
+		__prepareBands(bands);
 
-		for (s32 x = Math::maxInt(_destX, 0); x <= endX; ++x) {
+		__forEachBand(top, bottom, bandRows, [&](s32 _band, s32 _top, s32 _bottom) {
 
-			for (s32 y = Math::maxInt(_destY, 0); y <= endY; ++y) {
+			PixelBufferBand& band = bands[_band];
+			s32* columnCounts = band.columnCountsPtr;
 
-				if (_maskBuffer != nullptr && !_maskBuffer->read(x - _destX, y - _destY)) continue;
+			std::vector<u8> converted; //Source pixels converted to the alpha mode of this buffer.
 
-				Color4 source = _sourceBuffer->readPixel(x - _destX, y - _destY);
-				source.a = (u8)roundf(source.a * _sourceOpacity);
+			RowSpan span;
+			RowSpanIterator it = rowSpans(left, _top, columns, _bottom - _top);
 
-				Color4 dest = readPixel(x, y);
+			while (it.next(span)) {
 
-				Color4 blended = Color::blendColor(source, dest, _blendMode);
-				if (!Color::match(dest, blended)) {
+				//The source may be split into more spans than the destination if it's tiled.
+				RowSpan sourceSpan;
+				RowSpanIterator sourceIt = _sourceBuffer->rowSpans(span.x - _destX, span.y - _destY, span.count, 1);
 
-					writePixel(x, y, blended, BlendMode::Overwrite, false);
-					modified = true;
+				while (sourceIt.next(sourceSpan)) {
 
-				}
+					s32 x = sourceSpan.x + _destX;
+					const u8* source = sourceSpan.data;
+
+					//Mask bits of the span, runs of unselected pixels are skipped a word at a time.
+					const u64* maskRow = nullptr;
+					s32 maskRight = 0, runStart = 0, runEnd = 0;
+
+					if (_maskBuffer != nullptr) {
+
+						if (sourceSpan.y >= _maskBuffer->height) continue;
 
-				if (useBBox) {
+						maskRow = _maskBuffer->rowPtr(sourceSpan.y);
+						maskRight = Math::minInt(sourceSpan.x + sourceSpan.count, _maskBuffer->width);
 
-					if (dest.a == 0 && blended.a > 0) checkBBoxIncrease(x, y);
-					else if (dest.a > 0 && blended.a == 0) calcBBox = true;
+						runStart = sourceSpan.x;
+						if (!MaskBuffer::findRun(maskRow, runStart, maskRight, runEnd)) continue;
+
+					}
+
+					if (_sourceBuffer->alphaMode != alphaMode && !sourceSpan.nullTile) {
+
+						converted.resize((size_t)sourceSpan.count * 4);
+						__convertSpan(converted.data(), source, sourceSpan.count, _sourceBuffer->alphaMode);
+
+						source = converted.data();
+
+					}
+
+					//Transparent source pixels leave the destination as is, unless they overwrite it.
+					if (_blendMode != BlendMode::Overwrite) {
+
+						if (sourceSpan.nullTile) continue;
+						if (isNullTileAt(x, span.y) && !_sourceBuffer->spanHasAlpha(sourceSpan.x, sourceSpan.y, sourceSpan.count)) continue;
+
+					}
+					else if (sourceSpan.nullTile && isNullTileAt(x, span.y)) continue;
+
+					u8* dest = pixelPtrWrite(x, span.y);
+
+					if (_maskBuffer == nullptr) {
+
+						BlendSpanResult result;
+						__blendSpan(dest, source, sourceSpan.count, _blendMode, table, result, (columnCounts != nullptr) ? (columnCounts + x) : nullptr);
+
+						__applyBlendSpanResult(result, x, span.y, sourceSpan.count, band);
+
+						continue;
+
+					}
+
+					//Blend each run of selected pixels as one span, fully selected spans end up as a single run.
+					do {
+
+						s32 i = runStart - sourceSpan.x;
+						s32 count = runEnd - runStart;
+
+						BlendSpanResult result;
+						__blendSpan(dest + ((size_t)i * 4), source + ((size_t)i * 4), count, _blendMode, table, result, (columnCounts != nullptr) ? (columnCounts + x + i) : nullptr);
+
+						__applyBlendSpanResult(result, x + i, span.y, count, band);
+
+						runStart = runEnd;
+
+					} while (MaskBuffer::findRun(maskRow, runStart, maskRight, runEnd));
 
 				}
 
 			}
 
-		}
+		});
 
-		if (calcBBox) calculateBBox(true);
+		__reduceBands(bands);
+
+		bool modified = false;
+		for (PixelBufferBand& band : bands) {
+			if (band.modified) modified = true;
+		}
 
 		return modified;
 
@@ -790,26 +2105,99 @@ namespace Zixel {
 			return false;
 		}
 
-		return (memcmp(buffer, _buffer->buffer, ((size_t)width * (size_t)height) * 4) == 0);
+		//Bands stop early once any band finds a difference.
+		std::atomic<bool> different = false;
 
-	}
+		if (alphaMode != _buffer->alphaMode) {
 
-	PixelBuffer* PixelBuffer::clone() {
+			//Compared as straight colors, since premultiplying loses information.
+			PixelBuffer* straightBuffer = (alphaMode == AlphaMode::Straight) ? this : _buffer;
+			PixelBuffer* premultipliedBuffer = (straightBuffer == this) ? _buffer : this;
+			PixelBuffer* spanBuffer = (_buffer->storage == PixelStorage::Tiled) ? _buffer : this;
+
+			__forEachBand(0, height, __getBandRows(0, height, width), [&](s32, s32 _top, s32 _bottom) {
+
+				std::vector<u8> converted;
+
+				RowSpan span;
+				RowSpanIterator it = spanBuffer->rowSpans(0, _top, width, _bottom - _top);
+
+				while (!different && it.next(span)) {
+
+					converted.resize((size_t)span.count * 4);
+					straightBuffer->__convertSpan(converted.data(), premultipliedBuffer->pixelPtr(span.x, span.y), span.count, AlphaMode::Premultiplied);
 
-		PixelBuffer* cloned = new PixelBuffer(width, height);
+					if (memcmp(converted.data(), straightBuffer->pixelPtr(span.x, span.y), (size_t)span.count * 4) != 0) different = true;
 
-		cloned->pixelCount = pixelCount;
-		if (useBBox) cloned->__setBBox(bBoxLeft, bBoxTop, bBoxRight, bBoxBottom);
+				}
+
+			});
+
+			return !different;
+
+		}
+
+		if (storage == PixelStorage::Contiguous && _buffer->storage == PixelStorage::Contiguous) {
+
+			__forEachBand(0, height, __getBandRows(0, height, width), [&](s32, s32 _top, s32 _bottom) {
+
+				if (different) return;
+
+				size_t offset = (size_t)_top * (size_t)width * 4;
+				if (memcmp(buffer + offset, _buffer->buffer + offset, (size_t)(_bottom - _top) * (size_t)width * 4) != 0) different = true;
+
+			});
+
+			return !different;
+
+		}
+
+		if (storage == PixelStorage::Tiled && _buffer->storage == PixelStorage::Tiled) {
+
+			//Unused pixels at the right and bottom edge of tiles are always zero, so whole tiles can be compared.
+			__forEachBand(0, height, __getBandRows(0, height, width), [&](s32, s32 _top, s32 _bottom) {
+
+				size_t first = (size_t)(_top / ZIXEL_CHUNK_SIZE) * (size_t)tileColumns;
+				size_t last = (size_t)((_bottom + ZIXEL_CHUNK_SIZE - 1) / ZIXEL_CHUNK_SIZE) * (size_t)tileColumns;
 
-		cloned->useBBox = useBBox;
-		cloned->makeEmptyPixelsBlack = makeEmptyPixelsBlack;
+				for (size_t i = first; i < last && !different; ++i) {
 
-		s32 size = (width * height * 4);
+					if (tiles[i] == _buffer->tiles[i]) continue;
+					if (memcmp(tiles[i]->data, _buffer->tiles[i]->data, sizeof(PixelTile::data)) != 0) different = true;
+
+				}
+
+			});
+
+			return !different;
 
-		for (s32 i = 0; i < size; ++i) {
-			cloned->buffer[i] = buffer[i];
 		}
 
+		PixelBuffer* tiledBuffer = (storage == PixelStorage::Tiled) ? this : _buffer;
+		PixelBuffer* otherBuffer = (tiledBuffer == this) ? _buffer : this;
+
+		__forEachBand(0, height, __getBandRows(0, height, width), [&](s32, s32 _top, s32 _bottom) {
+
+			RowSpan span;
+			RowSpanIterator it = tiledBuffer->rowSpans(0, _top, width, _bottom - _top);
+
+			while (!different && it.next(span)) {
+				if (memcmp(span.data, otherBuffer->pixelPtr(span.x, span.y), (size_t)span.count * 4) != 0) different = true;
+			}
+
+		});
+
+		return !different;
+
+	}
+
+	PixelBuffer* PixelBuffer::clone() {
+
+		PixelBuffer* cloned = new PixelBuffer(width, height, { 0, 0, 0, 0 }, useBBox, makeEmptyPixelsBlack, storage);
+		cloned->alphaMode = alphaMode;
+		cloned->wrap = wrap;
+		cloned->copy(this);
+
 		return cloned;
 
 	}
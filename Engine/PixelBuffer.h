@@ -6,11 +6,106 @@
 
 #pragma once
 
+#include <vector>
+#include <atomic>
+#include <functional>
+
 #include "Engine/Color.h"
+#include "Engine/Math.h"
+#include "Engine/ZixelMacros.h"
 
 namespace Zixel {
 
 	struct MaskBuffer;
+	struct BlendSpanResult;
+	struct PixelBuffer;
+
+	enum class PixelStorage : u8 {
+
+		Contiguous, //One allocation for the whole buffer.
+		Tiled, //ZIXEL_CHUNK_SIZE x ZIXEL_CHUNK_SIZE tiles, allocated on first write.
+
+	};
+
+	enum class AlphaMode : u8 {
+
+		Straight,
+		Premultiplied, //Red, green and blue are stored multiplied by alpha, which lets blending skip the per pixel division.
+
+	};
+
+	//Transparent tiles of tiled buffers all point to the shared null tile, which must never be written to.
+	//Other tiles can be shared between buffers after clone or copy, they get copied by the first owner that writes to them.
+	struct PixelTile {
+
+		u8 data[ZIXEL_CHUNK_SIZE * ZIXEL_CHUNK_SIZE * 4] = {};
+		std::atomic<s32> refCount = 1; //Not used by the null tile.
+
+		static PixelTile* getNull();
+
+		static PixelTile* retain(PixelTile* _tile);
+		static void release(PixelTile* _tile);
+
+		inline bool isShared() { return (refCount.load(std::memory_order_acquire) > 1); }
+
+	};
+
+	//A horizontal run of pixels inside a PixelBuffer, data points at the first pixel of the run.
+	//Spans never cross a tile boundary in tiled buffers.
+	struct RowSpan {
+
+		s32 x = 0, y = 0, count = 0;
+		u8* data = nullptr;
+		bool nullTile = false; //Span lies in the shared null tile. Only set when the span isn't writable.
+
+	};
+
+	//Walks a rect that has already been clipped to the buffer, one span at a time from top to bottom.
+	struct RowSpanIterator {
+
+		PixelBuffer* buffer = nullptr;
+		s32 left = 0, top = 0, right = -1, bottom = -1;
+		s32 x = 0, y = 0;
+		bool writable = false;
+
+		bool next(RowSpan& _span);
+
+	};
+
+	//Changed area inside one ZIXEL_CHUNK_SIZE block of a PixelBuffer, left is -1 if the block is clean.
+	struct DirtyBlock {
+
+		s32 left = -1, top = -1, right = -1, bottom = -1;
+		u32 changeCount = 0; //Not reset by clearDirty.
+
+	};
+
+	//Change counts of a PixelBuffer and its dirty blocks when a user last looked at it, so it can find what changed since without clearing the dirty state.
+	struct SeenChanges {
+
+		u64 changeCount = 0;
+		std::vector<u32> blockChanges;
+
+		void record(PixelBuffer* _buffer);
+		bool collect(PixelBuffer* _buffer, const std::function<void(s32)>& _changedBlock); //Calls _changedBlock with the index of every dirty block that changed since the last look and records them. Returns true if any did.
+
+	};
+
+	//Partial results of one horizontal band of a multithreaded operation, combined into the buffer once every band is done.
+	struct PixelBufferBand {
+
+		bool modified = false;
+		bool calcBBox = false;
+
+		s32 pixelCountDelta = 0;
+		s32 bBoxLeft = -1, bBoxTop = -1, bBoxRight = -1, bBoxBottom = -1; //Bounds of the pixels that became visible.
+
+		std::vector<s32> columnCounts; //Only used if the buffer has pixel counts and there's more than one band.
+		s32* columnCountsPtr = nullptr;
+
+		void checkBBoxIncrease(s32 _x, s32 _y);
+
+	};
 
 	struct PixelBuffer {
 
@@ -20,18 +115,146 @@ namespace Zixel {
 
 		bool useBBox = true;
 		bool makeEmptyPixelsBlack = false; //Replaces red, green and blue channels to 0 if alpha is 0.
+		bool wrap = false; //Tiled mode. writePixel, writeLine, writeRect and merge wrap positions outside the buffer around to the opposite edge.
+
+		PixelStorage storage = PixelStorage::Contiguous;
+
+		//Colors passed to and returned from the pixel functions are always straight, they're converted on the way in and out.
+		//Raw access (buffer, tiles, pixelPtr, rowSpans, writeSpan) sees the stored values. Surfaces upload them as is, so premultiplied surfaces need premultiplied blending when drawn.
+		AlphaMode alphaMode = AlphaMode::Straight;
+
+		u8* buffer = nullptr; //Contiguous storage.
+
+		s32 tileColumns = 0, tileRows = 0; //Tiled storage.
+		std::vector<PixelTile*> tiles;
 
-		u8* buffer = nullptr;
+		//Visible pixels per row and column. Only kept when useBBox is set, lets the bbox shrink without rescanning the buffer.
+		std::vector<s32> rowPixelCounts;
+		std::vector<s32> columnPixelCounts;
 
-		PixelBuffer(s32 _width, s32 _height, Color4 _fillColor = { 0, 0, 0, 0 }, bool _useBBox = true, bool _makeEmptyPixelsBlack = false);
+		//Areas written to since the last clearDirty, used for partial texture uploads.
+		//The change counts only ever go up, so other users can find what changed since they last looked without clearing the dirty state the uploads rely on.
+		s32 dirtyColumns = 0, dirtyRows = 0;
+		std::vector<DirtyBlock> dirtyBlocks;
+		std::atomic<bool> dirty = false;
+		std::atomic<u64> changeCount = 0; //Sum of the block change counts.
+
+		PixelBuffer(s32 _width, s32 _height, Color4 _fillColor = { 0, 0, 0, 0 }, bool _useBBox = true, bool _makeEmptyPixelsBlack = false, PixelStorage _storage = PixelStorage::Contiguous);
 		~PixelBuffer();
 
 		void __setBBox(s32 _left, s32 _top, s32 _right, s32 _bottom);
+		void __blendSpan(u8* _dest, const u8* _source, s32 _count, BlendMode _blendMode, const u8* _opacityTable, BlendSpanResult& _result, s32* _columnCounts); //Picks the blend kernel for the alpha mode.
+		void __convertSpan(u8* _dest, const u8* _source, s32 _count, AlphaMode _sourceAlphaMode); //Converts from _sourceAlphaMode to the alpha mode of this buffer.
+		void __applyBlendSpanResult(BlendSpanResult& _result, s32 _x, s32 _y, s32 _count, PixelBufferBand& _band);
+		void __recountPixels();
+		void __setPixelCounts(s32 _rowCount, s32 _columnCount);
+
+		inline bool __hasPixelCounts() { return !rowPixelCounts.empty(); }
+		inline s32* __columnCountsAt(s32 _x) { return __hasPixelCounts() ? &columnPixelCounts[_x] : nullptr; }
+		inline void __countPixel(s32 _x, s32 _y, s32 _delta) {
+
+			if (!__hasPixelCounts()) return;
+
+			rowPixelCounts[_y] += _delta;
+			columnPixelCounts[_x] += _delta;
+
+		}
+
+		inline void __markDirty(s32 _x, s32 _y) {
+
+			DirtyBlock& block = dirtyBlocks[((size_t)((u32)_y / ZIXEL_CHUNK_SIZE) * (size_t)dirtyColumns) + (size_t)((u32)_x / ZIXEL_CHUNK_SIZE)];
+
+			++block.changeCount;
+			changeCount.fetch_add(1, std::memory_order_relaxed);
+
+			if (block.left == -1) {
+
+				block.left = block.right = _x;
+				block.top = block.bottom = _y;
+				dirty = true;
+
+			}
+			else {
+
+				if (_x < block.left) block.left = _x;
+				if (_y < block.top) block.top = _y;
+				if (_x > block.right) block.right = _x;
+				if (_y > block.bottom) block.bottom = _y;
+
+			}
+
+		}
+
+		//Rows are split into bands aligned to ZIXEL_CHUNK_SIZE, so bands never share a tile or dirty block.
+		//Areas smaller than ZIXEL_PARALLEL_MIN_PIXELS stay in one band on the calling thread.
+		s32 __getBandRows(s32 _top, s32 _bottom, s32 _pixelsPerRow);
+		s32 __getBandCount(s32 _top, s32 _bottom, s32 _bandRows);
+		void __forEachBand(s32 _top, s32 _bottom, s32 _bandRows, const std::function<void(s32, s32, s32)>& _func); //Band index, first row, one past the last row.
+		void __prepareBands(std::vector<PixelBufferBand>& _bands);
+		void __reduceBands(std::vector<PixelBufferBand>& _bands);
+
+		void markDirty(s32 _x, s32 _y, s32 _width, s32 _height);
+		void markAllDirty();
+		inline bool isDirty() { return dirty; }
+		void getDirtyRects(std::vector<Rect>& _rects); //Adjacent blocks are merged into larger rects where possible.
+		void clearDirty();
+
 		void checkBBoxIncrease(s32 _x, s32 _y);
 		void calculateBBox(bool _startFromCurrentBBox = false);
 
 		bool isEmpty();
 
+		void setAlphaMode(AlphaMode _alphaMode); //Converts the stored pixels.
+		inline bool isPremultiplied() { return (alphaMode == AlphaMode::Premultiplied); }
+
+		inline Color4 __toStored(Color4 _color) { return isPremultiplied() ? Color::premultiply(_color) : _color; }
+		inline Color4 __fromStored(Color4 _color) { return isPremultiplied() ? Color::unpremultiply(_color) : _color; }
+		inline Color4 __blendColor(Color4 _source, Color4 _destination, BlendMode _blendMode) { return isPremultiplied() ? Color::blendColorPremultiplied(_source, _destination, _blendMode) : Color::blendColor(_source, _destination, _blendMode); }
+
+		//Unchecked access, the caller has to make sure the position is inside the buffer.
+		//pixelPtr is for reading only, in tiled buffers it may point into the shared null tile. Use pixelPtrWrite to modify pixels.
+		//rowPtr only works with contiguous storage.
+		inline u8* rowPtr(s32 _y) { return buffer + ((size_t)_y * (size_t)width * 4); }
+
+		inline u8* pixelPtr(s32 _x, s32 _y) {
+
+			if (storage == PixelStorage::Contiguous) return buffer + (((size_t)_y * (size_t)width) + (size_t)_x) * 4;
+			return tiles[__tileIndex(_x, _y)]->data + __tileOffset(_x, _y);
+
+		}
+
+		inline u8* pixelPtrWrite(s32 _x, s32 _y) {
+
+			if (storage == PixelStorage::Contiguous) return buffer + (((size_t)_y * (size_t)width) + (size_t)_x) * 4;
+			return __acquireTile(__tileIndex(_x, _y))->data + __tileOffset(_x, _y);
+
+		}
+
+		inline bool isTiled() { return (storage == PixelStorage::Tiled); }
+		inline bool isNullTileAt(s32 _x, s32 _y) { return (storage == PixelStorage::Tiled && tiles[__tileIndex(_x, _y)] == PixelTile::getNull()); }
+
+		inline size_t __tileIndex(s32 _x, s32 _y) { return ((size_t)((u32)_y / ZIXEL_CHUNK_SIZE) * (size_t)tileColumns) + (size_t)((u32)_x / ZIXEL_CHUNK_SIZE); }
+		inline size_t __tileOffset(s32 _x, s32 _y) { return ((((size_t)((u32)_y % ZIXEL_CHUNK_SIZE) * ZIXEL_CHUNK_SIZE) + (size_t)((u32)_x % ZIXEL_CHUNK_SIZE)) * 4); }
+
+		PixelTile* __acquireTile(size_t _index);
+		void __releaseTile(size_t _index);
+		bool __writeIsNoop(s32 _x, s32 _y, Color4 _color);
+		bool __canSkipNullTiles(Color4 _color, BlendMode _blendMode); //True if blending the color onto empty pixels leaves them empty, so writes can skip null tiles.
+
+		PixelTile* getTile(s32 _tileX, s32 _tileY);
+		s32 releaseEmptyTiles();
+		size_t getMemoryUsage(); //Shared tiles are counted by every buffer using them.
+		s32 getSharedTileCount();
+
+		bool clipRect(s32& _x, s32& _y, s32& _width, s32& _height);
+
+		inline s32 __wrapX(s32 _x) { return ((_x % width) + width) % width; }
+		inline s32 __wrapY(s32 _y) { return ((_y % height) + height) % height; }
+		s32 __wrapRect(s32 _x, s32 _y, s32 _width, s32 _height, Rect* _pieces); //Splits a rect into at most 4 in range pieces that don't overlap. Returns the piece count.
+		RowSpanIterator rowSpans(bool _writable = false);
+		RowSpanIterator rowSpans(s32 _x, s32 _y, s32 _width, s32 _height, bool _writable = false);
+		bool spanHasAlpha(s32 _x, s32 _y, s32 _count);
+
 		void fill(Color4 _color);
 		bool fillCheckModified(Color4 _color);
 		void writePixel(s32 _x, s32 _y, Color4 _color, BlendMode _blendMode = BlendMode::Overwrite, bool _calculateBBox = true);
@@ -39,6 +262,16 @@ namespace Zixel {
 		void writeLine(s32 _x1, s32 _y1, s32 _x2, s32 _y2, Color4 _color, BlendMode _blendMode = BlendMode::Overwrite, bool _writeFirstPixel = true, bool _calculateBBox = true);
 		bool writeLineCheckModified(s32 _x1, s32 _y1, s32 _x2, s32 _y2, Color4 _color, BlendMode _blendMode = BlendMode::Overwrite, bool _writeFirstPixel = true, bool _calculateBBox = true);
 		void writeRect(s32 _x, s32 _y, s32 _width, s32 _height, Color4 _color, BlendMode _blendMode = BlendMode::Overwrite, bool _calculateBBox = true);
+		void __writeRect(s32 _x, s32 _y, s32 _width, s32 _height, Color4 _color, BlendMode _blendMode, bool _calculateBBox); //Ignores wrap.
+		bool writeSpan(s32 _x, s32 _y, s32 _count, const u8* _data, BlendMode _blendMode = BlendMode::Overwrite, bool _calculateBBox = true); //_data holds _count RGBA pixels in the alpha mode of this buffer.
+
+		//Replaces whole ZIXEL_CHUNK_SIZE tiles, given as indices into the tile grid. _drawTile gets the tile column and row and draws the tile into a block with ZIXEL_CHUNK_SIZE pixel rows,
+		//or returns false if the tile is empty without touching the block. Tiles are drawn in parallel, then written in order. Tiles left empty go back to the null tile. Returns true if a pixel changed.
+		bool writeTiles(const std::vector<s32>& _tiles, const std::function<bool(s32, s32, u8*)>& _drawTile);
+
+		//Sets the entries of a tile grid, indexed like the tiles of writeTiles, that the area covers. The area is clipped to a _width x _height buffer. Returns false if nothing is left.
+		static bool markTiles(std::vector<u8>& _grid, s32 _width, s32 _height, s32 _x, s32 _y, s32 _areaWidth, s32 _areaHeight);
+
 		void writeRed(s32 _x, s32 _y, u8 _red);
 		void writeGreen(s32 _x, s32 _y, u8 _green);
 		void writeBlue(s32 _x, s32 _y, u8 _blue);
@@ -54,6 +287,7 @@ namespace Zixel {
 		void copy(PixelBuffer* _sourceBuffer);
 		bool merge(PixelBuffer* _sourceBuffer, BlendMode _blendMode, f32 _sourceOpacity = 1.0f);
 		bool merge(PixelBuffer* _sourceBuffer, s32 _destX, s32 _destY, BlendMode _blendMode, f32 _sourceOpacity = 1.0f, MaskBuffer* _maskBuffer = nullptr);
+		bool __merge(PixelBuffer* _sourceBuffer, s32 _destX, s32 _destY, BlendMode _blendMode, f32 _sourceOpacity, MaskBuffer* _maskBuffer); //Ignores wrap.
 		bool compare(PixelBuffer* _buffer);
 
 		PixelBuffer* clone();
@@ -0,0 +1,384 @@
+/*
+    Playback.cpp
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#include "Engine/ZixelPCH.h"
+#include "Engine/Playback.h"
+#include "Engine/PixelBuffer.h"
+#include "Engine/Math.h"
+
+namespace Zixel {
+
+	Playback::Playback(s32 _width, s32 _height, s32 _frameCount, std::function<void(s32, PixelBuffer*)> _compositeFrame) {
+
+		if (_width < 1 || _height < 1) {
+
+			ZIXEL_WARN("Error in Playback::Playback. Size cannot be less than 1: {}x{}", _width, _height);
+			return;
+
+		}
+
+		width = _width;
+		height = _height;
+		frameCount = Math::clampInt(_frameCount, 0, ZIXEL_ANIM_MAX_FRAME_COUNT);
+		compositeFrame = _compositeFrame;
+
+	}
+
+	Playback::~Playback() {
+
+		for (auto& it : cache) {
+
+			JobSystem::wait(it.second->job);
+			__deleteFrame(it.second);
+
+		}
+
+		for (PlaybackFrame* entry : retired) {
+
+			JobSystem::wait(entry->job);
+			__deleteFrame(entry);
+
+		}
+
+	}
+
+	void Playback::play() {
+
+		if (frameCount == 0) return;
+
+		playing = true;
+		elapsed = 0.0;
+
+		__prefetch();
+
+	}
+
+	void Playback::pause() {
+		playing = false;
+	}
+
+	void Playback::seek(s32 _frame) {
+
+		if (frameCount == 0) return;
+
+		timelineFrame = Math::clampInt(_frame, 0, frameCount - 1);
+		elapsed = 0.0;
+
+		__prefetch();
+		if (__isReady(timelineFrame)) __show(timelineFrame);
+
+	}
+
+	void Playback::setFps(s32 _fps) {
+		fps = Math::clampInt(_fps, 1, ZIXEL_ANIM_MAX_FPS);
+	}
+
+	void Playback::setMode(PlaybackMode _mode) {
+
+		mode = _mode;
+		direction = (mode == PlaybackMode::Backward) ? -1 : 1;
+
+		__prefetch();
+
+	}
+
+	void Playback::setFrameCount(s32 _frameCount) {
+
+		frameCount = Math::clampInt(_frameCount, 0, ZIXEL_ANIM_MAX_FRAME_COUNT);
+
+		std::vector<PlaybackFrame*> removed;
+
+		for (auto& it : cache) {
+			if (it.first >= frameCount) removed.push_back(it.second);
+		}
+
+		for (PlaybackFrame* entry : removed) __removeFrame(entry);
+
+		timelineFrame = Math::clampInt(timelineFrame, 0, Math::maxInt(frameCount - 1, 0));
+		__prefetch();
+
+	}
+
+	void Playback::setByteBudget(size_t _byteBudget) {
+
+		byteBudget = _byteBudget;
+		while (cacheBytes > byteBudget && __evict({}));
+
+	}
+
+	void Playback::invalidateFrame(s32 _frame) {
+
+		auto found = cache.find(_frame);
+		if (found == cache.end()) return;
+
+		//The old frame stays on screen until the new one is ready.
+		__removeFrame(found->second);
+		__prefetch();
+
+	}
+
+	void Playback::invalidateAll() {
+
+		std::vector<PlaybackFrame*> removed;
+		for (auto& it : cache) removed.push_back(it.second);
+
+		for (PlaybackFrame* entry : removed) __removeFrame(entry);
+
+		__prefetch();
+
+	}
+
+	bool Playback::update(f64 _deltaTime) {
+
+		__collect();
+
+		if (frameCount == 0) return false;
+
+		if (playing) {
+
+			elapsed += _deltaTime;
+
+			f64 frameTime = 1.0 / (f64)fps;
+			s64 steps = (s64)(elapsed / frameTime);
+
+			if (steps > 0) {
+
+				elapsed -= (f64)steps * frameTime;
+
+				//Frames the timeline passes without them being shown are dropped.
+				if (shownFrame != timelineFrame) ++droppedFrames;
+				droppedFrames += steps - 1;
+
+				__advance(steps);
+				__prefetch();
+
+			}
+
+		}
+
+		if (!__isReady(timelineFrame)) {
+
+			//Without workers nothing composites in the background, so the timeline frame is composited here.
+			if (JobSystem::getThreadCount() > 1 || !compositeFrame || cache.find(timelineFrame) != cache.end()) return false;
+
+			size_t frameBytes = (size_t)width * (size_t)height * 4;
+			while (cacheBytes + frameBytes > byteBudget && __evict({ timelineFrame }));
+
+			__schedule(timelineFrame);
+			__collect();
+
+		}
+
+		return __show(timelineFrame);
+
+	}
+
+	PixelBuffer* Playback::getFrame() {
+		return (shownEntry != nullptr) ? shownEntry->buffer : nullptr;
+	}
+
+	s32 Playback::__step(s32 _frame, s32& _direction) {
+
+		switch (mode) {
+
+			case PlaybackMode::Backward: return (_frame + frameCount - 1) % frameCount;
+
+			case PlaybackMode::PingPong: {
+
+				if (frameCount == 1) return 0;
+
+				s32 next = _frame + _direction;
+
+				if (next < 0 || next >= frameCount) {
+
+					_direction = -_direction;
+					next = _frame + _direction;
+
+				}
+
+				return next;
+
+			}
+
+			default: return (_frame + 1) % frameCount;
+
+		}
+
+	}
+
+	void Playback::__advance(s64 _steps) {
+
+		if (frameCount <= 1) return;
+
+		//Long hitches only need the position within one cycle.
+		s64 cycle = (mode == PlaybackMode::PingPong) ? (s64)(frameCount - 1) * 2 : (s64)frameCount;
+		_steps %= cycle;
+
+		for (s64 i = 0; i < _steps; ++i) timelineFrame = __step(timelineFrame, direction);
+
+	}
+
+	bool Playback::__isReady(s32 _frame) {
+
+		auto found = cache.find(_frame);
+		return (found != cache.end() && JobSystem::isDone(found->second->job));
+
+	}
+
+	bool Playback::__show(s32 _frame) {
+
+		auto found = cache.find(_frame);
+		if (found == cache.end()) return false;
+
+		PlaybackFrame* entry = found->second;
+		entry->lastUsed = ++useCounter;
+
+		if (entry == shownEntry) return false;
+
+		shownEntry = entry;
+		shownFrame = _frame;
+
+		__collect();
+
+		return true;
+
+	}
+
+	void Playback::__prefetch() {
+
+		if (frameCount == 0 || !compositeFrame) return;
+
+		//Without workers update composites the timeline frame instead.
+		if (JobSystem::getThreadCount() == 1) return;
+
+		//Frames in the order they'll be shown, starting at the timeline.
+		std::vector<s32> window;
+
+		s32 frame = timelineFrame;
+		s32 frameDirection = direction;
+		s32 count = Math::clampInt(prefetchCount, 1, frameCount);
+
+		for (s32 i = 0; i < count; ++i) {
+
+			if (std::find(window.begin(), window.end(), frame) == window.end()) window.push_back(frame);
+			frame = __step(frame, frameDirection);
+
+		}
+
+		size_t frameBytes = (size_t)width * (size_t)height * 4;
+
+		for (s32 windowFrame : window) {
+
+			if (cache.find(windowFrame) != cache.end()) continue;
+
+			//Frames further ahead are skipped if the budget is used up by nearer ones.
+			while (cacheBytes + frameBytes > byteBudget) {
+				if (!__evict(window)) return;
+			}
+
+			__schedule(windowFrame);
+
+		}
+
+	}
+
+	void Playback::__schedule(s32 _frame) {
+
+		PlaybackFrame* entry = new PlaybackFrame();
+		entry->frame = _frame;
+		entry->buffer = new PixelBuffer(width, height, { 0, 0, 0, 0 }, true, false, PixelStorage::Tiled);
+		entry->bytes = (size_t)width * (size_t)height * 4;
+
+		cacheBytes += entry->bytes;
+		cache[_frame] = entry;
+
+		std::function<void(s32, PixelBuffer*)> composite = compositeFrame;
+		PixelBuffer* buffer = entry->buffer;
+
+		//Kept out of the regular queues, so waits on the main thread never end up compositing a frame.
+		entry->job = JobSystem::scheduleBackground([composite, _frame, buffer]() {
+			composite(_frame, buffer);
+		});
+
+	}
+
+	bool Playback::__evict(const std::vector<s32>& _keep) {
+
+		PlaybackFrame* oldest = nullptr;
+
+		for (auto& it : cache) {
+
+			PlaybackFrame* entry = it.second;
+
+			if (entry == shownEntry || !JobSystem::isDone(entry->job)) continue;
+			if (std::find(_keep.begin(), _keep.end(), entry->frame) != _keep.end()) continue;
+
+			if (oldest == nullptr || entry->lastUsed < oldest->lastUsed) oldest = entry;
+
+		}
+
+		if (oldest == nullptr) return false;
+
+		__removeFrame(oldest);
+		return true;
+
+	}
+
+	void Playback::__collect() {
+
+		for (auto& it : cache) {
+
+			PlaybackFrame* entry = it.second;
+			if (entry->measured || !JobSystem::isDone(entry->job)) continue;
+
+			//Tiled buffers only use memory where the frame has pixels.
+			cacheBytes -= entry->bytes;
+			entry->bytes = entry->buffer->getMemoryUsage();
+			cacheBytes += entry->bytes;
+
+			entry->measured = true;
+
+		}
+
+		for (size_t i = 0; i < retired.size();) {
+
+			PlaybackFrame* entry = retired[i];
+
+			if (entry == shownEntry || !JobSystem::isDone(entry->job)) {
+
+				++i;
+				continue;
+
+			}
+
+			__deleteFrame(entry);
+
+			retired[i] = retired.back();
+			retired.pop_back();
+
+		}
+
+	}
+
+	void Playback::__removeFrame(PlaybackFrame* _entry) {
+
+		cache.erase(_entry->frame);
+
+		if (_entry != shownEntry && JobSystem::isDone(_entry->job)) __deleteFrame(_entry);
+		else retired.push_back(_entry);
+
+	}
+
+	void Playback::__deleteFrame(PlaybackFrame* _entry) {
+
+		cacheBytes -= _entry->bytes;
+
+		delete _entry->buffer;
+		delete _entry;
+
+	}
+
+}
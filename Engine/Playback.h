@@ -0,0 +1,100 @@
+/*
+    Playback.h
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+#include "Engine/JobSystem.h"
+#include "Engine/ZixelMacros.h"
+
+namespace Zixel {
+
+	struct PixelBuffer;
+
+	//A composited frame in the playback cache.
+	struct PlaybackFrame {
+
+		s32 frame = 0;
+		PixelBuffer* buffer = nullptr;
+		JobHandle job; //Compositing job, the buffer can't be touched until it's done.
+
+		size_t bytes = 0; //Full size while compositing, actual size once done.
+		u64 lastUsed = 0;
+
+		bool measured = false; //bytes has been updated to the actual size.
+
+	};
+
+	//Plays an animation from pre-composited frames.
+	//Frames coming up in playback order are composited ahead of time as background jobs into a cache, which drops the least recently used frames to stay within its byte budget.
+	//Without workers only the frame the timeline is at gets composited, one per update, so play and seek never block on compositing.
+	//The timeline always advances in real time. If the frame it reaches isn't ready, the previous frame stays on screen and the missing frame counts as dropped.
+	struct Playback {
+
+		s32 width = 0, height = 0;
+		s32 frameCount = 0;
+
+		//Composites a frame into the buffer, which is cleared and the size of the animation. Called on worker threads, so it may only read the animation.
+		std::function<void(s32, PixelBuffer*)> compositeFrame;
+
+		s32 fps = ZIXEL_ANIM_DEFAULT_FPS;
+		PlaybackMode mode = PlaybackMode::Forward;
+
+		size_t byteBudget = ZIXEL_ANIM_PLAYBACK_BYTE_BUDGET;
+		s32 prefetchCount = ZIXEL_ANIM_PLAYBACK_PREFETCH_COUNT;
+
+		bool playing = false;
+		s32 timelineFrame = 0; //Frame the timeline is at.
+		s32 direction = 1; //Only changes in ping pong mode.
+		f64 elapsed = 0.0; //Seconds since the timeline reached its frame.
+
+		s32 shownFrame = -1;
+		PlaybackFrame* shownEntry = nullptr;
+		s64 droppedFrames = 0;
+
+		std::unordered_map<s32, PlaybackFrame*> cache;
+		std::vector<PlaybackFrame*> retired; //Out of the cache, deleted once their job is done and they aren't shown anymore.
+		size_t cacheBytes = 0;
+		u64 useCounter = 0;
+
+		Playback(s32 _width, s32 _height, s32 _frameCount, std::function<void(s32, PixelBuffer*)> _compositeFrame);
+		~Playback();
+
+		void play();
+		void pause();
+		void seek(s32 _frame); //Moves the timeline to the frame, it's shown as soon as it's composited.
+
+		void setFps(s32 _fps);
+		void setMode(PlaybackMode _mode);
+		void setFrameCount(s32 _frameCount); //Frames past the new count are dropped from the cache.
+		void setByteBudget(size_t _byteBudget);
+
+		void invalidateFrame(s32 _frame); //Call after a frame changes.
+		void invalidateAll();
+
+		bool update(f64 _deltaTime); //Advances the timeline by _deltaTime seconds. Returns true if the shown frame changed.
+
+		PixelBuffer* getFrame(); //Buffer of the shown frame, nullptr if nothing has been shown yet.
+		inline s32 getShownFrame() { return shownFrame; }
+		inline s64 getDroppedFrameCount() { return droppedFrames; }
+
+		s32 __step(s32 _frame, s32& _direction); //Frame after _frame in playback order.
+		void __advance(s64 _steps);
+		bool __isReady(s32 _frame);
+		bool __show(s32 _frame);
+		void __prefetch();
+		void __schedule(s32 _frame);
+		bool __evict(const std::vector<s32>& _keep); //Frees the least recently used finished frame outside _keep. Returns false if none could be freed.
+		void __collect(); //Measures finished frames and deletes retired ones that can go.
+		void __removeFrame(PlaybackFrame* _entry);
+		void __deleteFrame(PlaybackFrame* _entry);
+
+	};
+
+}
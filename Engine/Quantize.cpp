@@ -0,0 +1,784 @@
+/*
+    Quantize.cpp
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#include "Engine/ZixelPCH.h"
+#include "Engine/Quantize.h"
+#include "Engine/PixelBuffer.h"
+#include "Engine/IndexedBuffer.h"
+#include "Engine/JobSystem.h"
+#include "Engine/CPU.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+#ifdef ZIXEL_SIMD_X86
+	#include <immintrin.h>
+#endif
+
+#define ZIXEL_QUANTIZE_CELLS_PER_CHANNEL (1 << ZIXEL_QUANTIZE_CELL_BITS)
+#define ZIXEL_QUANTIZE_CELL_COUNT (ZIXEL_QUANTIZE_CELLS_PER_CHANNEL * ZIXEL_QUANTIZE_CELLS_PER_CHANNEL * ZIXEL_QUANTIZE_CELLS_PER_CHANNEL)
+#define ZIXEL_QUANTIZE_BIN_BITS 5 //Median cut histogram precision per channel.
+#define ZIXEL_QUANTIZE_BINS_PER_CHANNEL (1 << ZIXEL_QUANTIZE_BIN_BITS)
+
+namespace Zixel {
+
+	//Histogram bin of the median cut, sums are used for the average color of a box.
+	struct QuantizeBin {
+
+		u32 count = 0;
+		u64 red = 0, green = 0, blue = 0;
+
+	};
+
+	//Range of histogram bins per channel, inclusive.
+	struct QuantizeBox {
+
+		s32 min[3] = {};
+		s32 max[3] = {};
+		u64 count = 0;
+
+	};
+
+	static u32 Quantize_pack(Color4 _color) {
+		return (u32)_color.r | ((u32)_color.g << 8) | ((u32)_color.b << 16) | ((u32)_color.a << 24);
+	}
+
+	static u32 Quantize_readPixel(PixelBuffer* _buffer, const u8* _pixel) {
+
+		u32 color = (u32)_pixel[0] | ((u32)_pixel[1] << 8) | ((u32)_pixel[2] << 16) | ((u32)_pixel[3] << 24);
+		if (!_buffer->isPremultiplied() || (color >> 24) == 0 || (color >> 24) == 255) return color;
+
+		return Quantize_pack(Color::unpremultiply({ _pixel[0], _pixel[1], _pixel[2], _pixel[3] }));
+
+	}
+
+	static s32 Quantize_distance(u32 _a, u32 _b) {
+
+		s32 red = (s32)(_a & 0xFF) - (s32)(_b & 0xFF);
+		s32 green = (s32)((_a >> 8) & 0xFF) - (s32)((_b >> 8) & 0xFF);
+		s32 blue = (s32)((_a >> 16) & 0xFF) - (s32)((_b >> 16) & 0xFF);
+
+		return (red * red) + (green * green) + (blue * blue);
+
+	}
+
+	static inline s32 Quantize_binIndex(s32 _red, s32 _green, s32 _blue) {
+		return _red | (_green << ZIXEL_QUANTIZE_BIN_BITS) | (_blue << (ZIXEL_QUANTIZE_BIN_BITS * 2));
+	}
+
+	//Shrinks the box to the bins that have pixels.
+	static void Quantize_shrinkBox(const std::vector<QuantizeBin>& _bins, QuantizeBox& _box) {
+
+		s32 min[3] = { ZIXEL_QUANTIZE_BINS_PER_CHANNEL, ZIXEL_QUANTIZE_BINS_PER_CHANNEL, ZIXEL_QUANTIZE_BINS_PER_CHANNEL };
+		s32 max[3] = { -1, -1, -1 };
+
+		_box.count = 0;
+
+		for (s32 b = _box.min[2]; b <= _box.max[2]; ++b) {
+
+			for (s32 g = _box.min[1]; g <= _box.max[1]; ++g) {
+
+				for (s32 r = _box.min[0]; r <= _box.max[0]; ++r) {
+
+					u32 count = _bins[Quantize_binIndex(r, g, b)].count;
+					if (count == 0) continue;
+
+					_box.count += count;
+
+					if (r < min[0]) min[0] = r;
+					if (r > max[0]) max[0] = r;
+					if (g < min[1]) min[1] = g;
+					if (g > max[1]) max[1] = g;
+					if (b < min[2]) min[2] = b;
+					if (b > max[2]) max[2] = b;
+
+				}
+
+			}
+
+		}
+
+		for (s32 i = 0; i < 3; ++i) {
+
+			_box.min[i] = min[i];
+			_box.max[i] = max[i];
+
+		}
+
+	}
+
+	//Splits the box along its longest side where half of its pixels are on each side.
+	static QuantizeBox Quantize_splitBox(const std::vector<QuantizeBin>& _bins, QuantizeBox& _box) {
+
+		s32 axis = 0;
+
+		for (s32 i = 1; i < 3; ++i) {
+			if ((_box.max[i] - _box.min[i]) > (_box.max[axis] - _box.min[axis])) axis = i;
+		}
+
+		u64 total = 0;
+		s32 split = _box.min[axis];
+
+		for (; split < _box.max[axis]; ++split) {
+
+			s32 min[3] = { _box.min[0], _box.min[1], _box.min[2] };
+			s32 max[3] = { _box.max[0], _box.max[1], _box.max[2] };
+			min[axis] = split;
+			max[axis] = split;
+
+			for (s32 b = min[2]; b <= max[2]; ++b) {
+				for (s32 g = min[1]; g <= max[1]; ++g) {
+					for (s32 r = min[0]; r <= max[0]; ++r) total += _bins[Quantize_binIndex(r, g, b)].count;
+				}
+			}
+
+			if (total * 2 >= _box.count) break;
+
+		}
+
+		//The upper box must keep at least one plane.
+		if (split >= _box.max[axis]) split = _box.max[axis] - 1;
+
+		QuantizeBox upper = _box;
+		upper.min[axis] = split + 1;
+		_box.max[axis] = split;
+
+		Quantize_shrinkBox(_bins, _box);
+		Quantize_shrinkBox(_bins, upper);
+
+		return upper;
+
+	}
+
+	static Color4 Quantize_boxColor(const std::vector<QuantizeBin>& _bins, const QuantizeBox& _box) {
+
+		u64 red = 0, green = 0, blue = 0, count = 0;
+
+		for (s32 b = _box.min[2]; b <= _box.max[2]; ++b) {
+
+			for (s32 g = _box.min[1]; g <= _box.max[1]; ++g) {
+
+				for (s32 r = _box.min[0]; r <= _box.max[0]; ++r) {
+
+					const QuantizeBin& bin = _bins[Quantize_binIndex(r, g, b)];
+
+					red += bin.red;
+					green += bin.green;
+					blue += bin.blue;
+					count += bin.count;
+
+				}
+
+			}
+
+		}
+
+		if (count == 0) return { 0, 0, 0, 255 };
+		return { (u8)((red + (count / 2)) / count), (u8)((green + (count / 2)) / count), (u8)((blue + (count / 2)) / count), 255 };
+
+	}
+
+#ifdef ZIXEL_SIMD_X86
+	//Nearest of _count candidates, 4 at a time. Returns the position of the first candidate with the smallest distance.
+	static s32 Quantize_nearestSSE2(const u32* _colors, s32 _count, u32 _color) {
+
+		__m128i zero = _mm_setzero_si128();
+		__m128i pixel = _mm_unpacklo_epi8(_mm_set1_epi32((int)(_color & 0xFFFFFF)), zero);
+
+		__m128i bestDistance = _mm_set1_epi32(0x7FFFFFFF);
+		__m128i bestPosition = _mm_setzero_si128();
+		__m128i position = _mm_setr_epi32(0, 1, 2, 3);
+		__m128i four = _mm_set1_epi32(4);
+		__m128i rgbMask = _mm_set1_epi32(0xFFFFFF);
+
+		s32 i = 0;
+
+		for (; i + 4 <= _count; i += 4) {
+
+			__m128i colors = _mm_and_si128(_mm_loadu_si128((const __m128i*)(_colors + i)), rgbMask);
+
+			__m128i low = _mm_sub_epi16(_mm_unpacklo_epi8(colors, zero), pixel);
+			__m128i high = _mm_sub_epi16(_mm_unpackhi_epi8(colors, zero), pixel);
+			low = _mm_madd_epi16(low, low); //Red + green and blue of candidates 0 and 1.
+			high = _mm_madd_epi16(high, high); //Same for candidates 2 and 3.
+
+			__m128i even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(low), _mm_castsi128_ps(high), _MM_SHUFFLE(2, 0, 2, 0)));
+			__m128i odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(low), _mm_castsi128_ps(high), _MM_SHUFFLE(3, 1, 3, 1)));
+			__m128i distance = _mm_add_epi32(even, odd);
+
+			__m128i closer = _mm_cmplt_epi32(distance, bestDistance);
+			bestDistance = _mm_or_si128(_mm_and_si128(closer, distance), _mm_andnot_si128(closer, bestDistance));
+			bestPosition = _mm_or_si128(_mm_and_si128(closer, position), _mm_andnot_si128(closer, bestPosition));
+
+			position = _mm_add_epi32(position, four);
+
+		}
+
+		alignas(16) s32 distances[4];
+		alignas(16) s32 positions[4];
+		_mm_store_si128((__m128i*)distances, bestDistance);
+		_mm_store_si128((__m128i*)positions, bestPosition);
+
+		s32 best = -1, bestDist = 0x7FFFFFFF;
+
+		for (s32 lane = 0; lane < 4; ++lane) {
+
+			if (distances[lane] < bestDist || (distances[lane] == bestDist && positions[lane] < best)) {
+
+				bestDist = distances[lane];
+				best = positions[lane];
+
+			}
+
+		}
+
+		for (; i < _count; ++i) {
+
+			s32 distance = Quantize_distance(_colors[i], _color);
+
+			if (distance < bestDist) {
+
+				bestDist = distance;
+				best = i;
+
+			}
+
+		}
+
+		return best;
+
+	}
+#endif
+
+	bool PaletteLookup::build(Palette* _palette) {
+
+		palette = _palette;
+		transparentIndex = -1;
+
+		cellStarts.clear();
+		candidateIndices.clear();
+		candidateColors.clear();
+		translucentColors.clear();
+
+		if (palette == nullptr || palette->getCount() == 0) return false;
+
+		//Indices are stored as 16 bits.
+		s32 count = Math::minInt(palette->getCount(), 65536);
+
+		bool hasOpaque = false;
+
+		for (s32 i = 0; i < count; ++i) {
+
+			u8 alpha = palette->colors[i].a;
+
+			if (alpha == 255) hasOpaque = true;
+			else if (alpha == 0) {
+				if (transparentIndex == -1) transparentIndex = i;
+			}
+			else translucentColors.push_back({ Quantize_pack(palette->colors[i]), i });
+
+		}
+
+		std::stable_sort(translucentColors.begin(), translucentColors.end(), [](const std::pair<u32, s32>& _a, const std::pair<u32, s32>& _b) { return _a.first < _b.first; });
+		translucentColors.erase(std::unique(translucentColors.begin(), translucentColors.end(), [](const std::pair<u32, s32>& _a, const std::pair<u32, s32>& _b) { return _a.first == _b.first; }), translucentColors.end());
+
+		std::vector<u16> searched;
+		std::vector<u32> searchedColors;
+
+		for (s32 i = 0; i < count; ++i) {
+
+			Color4 color = palette->colors[i];
+			if (color.a == 0 || (hasOpaque && color.a != 255)) continue;
+
+			searched.push_back((u16)i);
+			searchedColors.push_back(Quantize_pack(color) & 0xFFFFFF);
+
+		}
+
+		cellStarts.assign(ZIXEL_QUANTIZE_CELL_COUNT + 1, 0);
+		if (searched.empty()) return true;
+
+		//A color can only be nearest to something in the cell if its closest possible distance to the cell is within the smallest farthest distance of any color.
+		std::vector<std::vector<u16>> cells(ZIXEL_QUANTIZE_CELL_COUNT);
+		const s32 cellSize = 256 / ZIXEL_QUANTIZE_CELLS_PER_CHANNEL;
+
+		JobSystem::parallelFor(0, ZIXEL_QUANTIZE_CELL_COUNT, 64, [&](s32 _first, s32 _last) {
+
+			std::vector<s32> minDistances(searched.size());
+
+			for (s32 cell = _first; cell < _last; ++cell) {
+
+				s32 low[3], high[3];
+
+				for (s32 channel = 0; channel < 3; ++channel) {
+
+					low[channel] = ((cell >> (channel * ZIXEL_QUANTIZE_CELL_BITS)) & (ZIXEL_QUANTIZE_CELLS_PER_CHANNEL - 1)) * cellSize;
+					high[channel] = low[channel] + cellSize - 1;
+
+				}
+
+				s32 bound = 0x7FFFFFFF;
+
+				for (size_t i = 0; i < searched.size(); ++i) {
+
+					s32 minDistance = 0, maxDistance = 0;
+
+					for (s32 channel = 0; channel < 3; ++channel) {
+
+						s32 value = (s32)((searchedColors[i] >> (channel * 8)) & 0xFF);
+
+						s32 inside = (value < low[channel]) ? low[channel] - value : ((value > high[channel]) ? value - high[channel] : 0);
+						s32 farthest = Math::maxInt(value - low[channel], high[channel] - value);
+
+						minDistance += inside * inside;
+						maxDistance += farthest * farthest;
+
+					}
+
+					minDistances[i] = minDistance;
+					if (maxDistance < bound) bound = maxDistance;
+
+				}
+
+				for (size_t i = 0; i < searched.size(); ++i) {
+					if (minDistances[i] <= bound) cells[cell].push_back((u16)i);
+				}
+
+			}
+
+		});
+
+		for (s32 cell = 0; cell < ZIXEL_QUANTIZE_CELL_COUNT; ++cell) {
+
+			cellStarts[cell] = (u32)candidateIndices.size();
+
+			for (u16 i : cells[cell]) {
+
+				candidateIndices.push_back(searched[i]);
+				candidateColors.push_back(searchedColors[i]);
+
+			}
+
+		}
+
+		cellStarts[ZIXEL_QUANTIZE_CELL_COUNT] = (u32)candidateIndices.size();
+
+		return true;
+
+	}
+
+	s32 PaletteLookup::find(Color4 _color) {
+
+		if (cellStarts.empty()) return -1;
+		return __findPacked(Quantize_pack(_color));
+
+	}
+
+	s32 PaletteLookup::__findPacked(u32 _color) {
+
+		u32 alpha = _color >> 24;
+
+		if (alpha == 0 && transparentIndex != -1) return transparentIndex;
+
+		if (alpha != 0 && alpha != 255 && !translucentColors.empty()) {
+
+			auto found = std::lower_bound(translucentColors.begin(), translucentColors.end(), _color, [](const std::pair<u32, s32>& _entry, u32 _value) { return _entry.first < _value; });
+			if (found != translucentColors.end() && found->first == _color) return found->second;
+
+		}
+
+		const s32 shift = 8 - ZIXEL_QUANTIZE_CELL_BITS;
+		u32 cell = ((_color & 0xFF) >> shift) | ((((_color >> 8) & 0xFF) >> shift) << ZIXEL_QUANTIZE_CELL_BITS) | ((((_color >> 16) & 0xFF) >> shift) << (ZIXEL_QUANTIZE_CELL_BITS * 2));
+
+		u32 start = cellStarts[cell];
+		s32 count = (s32)(cellStarts[cell + 1] - start);
+
+		if (count == 0) return Math::maxInt(transparentIndex, 0);
+		if (count == 1) return candidateIndices[start];
+
+#ifdef ZIXEL_SIMD_X86
+		return candidateIndices[start + Quantize_nearestSSE2(candidateColors.data() + start, count, _color)];
+#else
+		s32 best = 0, bestDistance = 0x7FFFFFFF;
+
+		for (s32 i = 0; i < count; ++i) {
+
+			s32 distance = Quantize_distance(candidateColors[start + i], _color);
+
+			if (distance < bestDistance) {
+
+				bestDistance = distance;
+				best = i;
+
+			}
+
+		}
+
+		return candidateIndices[start + best];
+#endif
+
+	}
+
+	bool Quantize::buildPalette(PixelBuffer* _source, s32 _maxColors, Palette* _palette) {
+
+		if (_maxColors < 1) {
+
+			ZIXEL_WARN("Error in Quantize::buildPalette. Max colors must be at least 1, got {}.", _maxColors);
+			return false;
+
+		}
+
+		_maxColors = Math::minInt(_maxColors, 65536);
+
+		//Pixel art rarely has more colors than the palette can hold, keep them exactly if so.
+		std::vector<u32> exactColors;
+		std::unordered_set<u32> seen;
+		bool hasTransparent = false, exact = true;
+
+		{
+
+			u32 lastColor = 0;
+			bool hasLast = false;
+
+			RowSpan span;
+			RowSpanIterator it = _source->rowSpans();
+
+			while (exact && it.next(span)) {
+
+				if (span.nullTile) {
+
+					hasTransparent = true;
+					continue;
+
+				}
+
+				for (s32 i = 0; i < span.count; ++i) {
+
+					u32 color = Quantize_readPixel(_source, span.data + ((size_t)i * 4));
+
+					if (hasLast && color == lastColor) continue;
+
+					hasLast = true;
+					lastColor = color;
+
+					if ((color >> 24) == 0) {
+
+						hasTransparent = true;
+						continue;
+
+					}
+
+					if (!seen.insert(color).second) continue;
+
+					exactColors.push_back(color);
+
+					if ((s32)exactColors.size() > _maxColors) {
+
+						exact = false;
+						break;
+
+					}
+
+				}
+
+			}
+
+		}
+
+		if (exact && (s32)exactColors.size() + (hasTransparent ? 1 : 0) <= _maxColors) {
+
+			_palette->colors.clear();
+			if (hasTransparent) _palette->colors.push_back({ 0, 0, 0, 0 });
+
+			for (u32 color : exactColors) _palette->colors.push_back({ (u8)color, (u8)(color >> 8), (u8)(color >> 16), (u8)(color >> 24) });
+
+			return true;
+
+		}
+
+		//Histogram of the visible pixels, one per job so jobs don't share bins.
+		s32 jobCount = Math::maxInt(Math::minInt(JobSystem::getThreadCount(), _source->height), 1);
+		std::vector<std::vector<QuantizeBin>> histograms((size_t)jobCount);
+		std::vector<u8> jobHasTransparent((size_t)jobCount, 0);
+
+		const s32 binShift = 8 - ZIXEL_QUANTIZE_BIN_BITS;
+
+		JobSystem::parallelFor(0, jobCount, 1, [&](s32 _first, s32 _last) {
+
+			for (s32 job = _first; job < _last; ++job) {
+
+				std::vector<QuantizeBin>& bins = histograms[job];
+				bins.resize(ZIXEL_QUANTIZE_BINS_PER_CHANNEL * ZIXEL_QUANTIZE_BINS_PER_CHANNEL * ZIXEL_QUANTIZE_BINS_PER_CHANNEL);
+
+				s32 top = (s32)(((s64)_source->height * job) / jobCount);
+				s32 bottom = (s32)(((s64)_source->height * (job + 1)) / jobCount);
+
+				RowSpan span;
+				RowSpanIterator it = _source->rowSpans(0, top, _source->width, bottom - top);
+
+				while (it.next(span)) {
+
+					if (span.nullTile) {
+
+						jobHasTransparent[job] = 1;
+						continue;
+
+					}
+
+					for (s32 i = 0; i < span.count; ++i) {
+
+						u32 color = Quantize_readPixel(_source, span.data + ((size_t)i * 4));
+
+						if ((color >> 24) == 0) {
+
+							jobHasTransparent[job] = 1;
+							continue;
+
+						}
+
+						u32 red = color & 0xFF, green = (color >> 8) & 0xFF, blue = (color >> 16) & 0xFF;
+						QuantizeBin& bin = bins[Quantize_binIndex(red >> binShift, green >> binShift, blue >> binShift)];
+
+						++bin.count;
+						bin.red += red;
+						bin.green += green;
+						bin.blue += blue;
+
+					}
+
+				}
+
+			}
+
+		});
+
+		std::vector<QuantizeBin>& bins = histograms[0];
+
+		for (s32 job = 1; job < jobCount; ++job) {
+
+			for (size_t i = 0; i < bins.size(); ++i) {
+
+				const QuantizeBin& bin = histograms[job][i];
+
+				bins[i].count += bin.count;
+				bins[i].red += bin.red;
+				bins[i].green += bin.green;
+				bins[i].blue += bin.blue;
+
+			}
+
+		}
+
+		hasTransparent = false;
+		for (u8 value : jobHasTransparent) if (value) hasTransparent = true;
+
+		_palette->colors.clear();
+		if (hasTransparent) _palette->colors.push_back({ 0, 0, 0, 0 });
+
+		s32 boxLimit = _maxColors - (hasTransparent ? 1 : 0);
+
+		QuantizeBox first;
+		for (s32 i = 0; i < 3; ++i) first.max[i] = ZIXEL_QUANTIZE_BINS_PER_CHANNEL - 1;
+
+		Quantize_shrinkBox(bins, first);
+		if (first.count == 0 || boxLimit < 1) return true;
+
+		std::vector<QuantizeBox> boxes;
+		boxes.push_back(first);
+
+		while ((s32)boxes.size() < boxLimit) {
+
+			//Split the box with the most pixels spread over the largest range.
+			s32 best = -1;
+			u64 bestScore = 0;
+
+			for (s32 i = 0; i < (s32)boxes.size(); ++i) {
+
+				const QuantizeBox& box = boxes[i];
+				s32 size = Math::maxInt(box.max[0] - box.min[0], box.max[1] - box.min[1], box.max[2] - box.min[2]);
+				if (size == 0) continue;
+
+				u64 score = box.count * (u64)size;
+
+				if (score > bestScore) {
+
+					bestScore = score;
+					best = i;
+
+				}
+
+			}
+
+			if (best == -1) break;
+
+			QuantizeBox upper = Quantize_splitBox(bins, boxes[best]);
+			boxes.push_back(upper);
+
+		}
+
+		for (const QuantizeBox& box : boxes) _palette->colors.push_back(Quantize_boxColor(bins, box));
+
+		return true;
+
+	}
+
+	bool Quantize::remap(PixelBuffer* _source, IndexedBuffer* _dest, PaletteLookup& _lookup) {
+
+		if (_source->width != _dest->width || _source->height != _dest->height) {
+
+			ZIXEL_WARN("Error in Quantize::remap. Destination buffer size ({}x{}) doesn't match ({}x{}).", _dest->width, _dest->height, _source->width, _source->height);
+			return false;
+
+		}
+
+		if (_lookup.cellStarts.empty()) {
+
+			ZIXEL_WARN("Error in Quantize::remap. Palette lookup hasn't been built.");
+			return false;
+
+		}
+
+		if (_lookup.palette->getCount() > _dest->getMaxColorCount()) {
+
+			ZIXEL_WARN("Error in Quantize::remap. Palette has {} colors, destination buffer can only index {}.", _lookup.palette->getCount(), _dest->getMaxColorCount());
+			return false;
+
+		}
+
+		bool wide = (_dest->format == IndexFormat::Index16);
+		size_t indexSize = wide ? 2 : 1;
+		s32 emptyIndex = _lookup.__findPacked(0);
+
+		JobSystem::parallelForRows(_source->height, ZIXEL_CHUNK_SIZE, [&](s32 _first, s32 _last) {
+
+			u32 lastColor = 0;
+			s32 lastIndex = emptyIndex;
+
+			RowSpan span;
+			RowSpanIterator it = _source->rowSpans(0, _first, _source->width, _last - _first);
+
+			while (it.next(span)) {
+
+				u8* indices = _dest->data.data() + ((((size_t)span.y * (size_t)_dest->width) + (size_t)span.x) * indexSize);
+
+				if (span.nullTile) {
+
+					if (wide) std::fill((u16*)indices, (u16*)indices + span.count, (u16)emptyIndex);
+					else memset(indices, emptyIndex, (size_t)span.count);
+
+					continue;
+
+				}
+
+				for (s32 i = 0; i < span.count; ++i) {
+
+					u32 color = Quantize_readPixel(_source, span.data + ((size_t)i * 4));
+
+					//Neighbouring pixels often share a color.
+					if (color != lastColor) {
+
+						lastColor = color;
+						lastIndex = _lookup.__findPacked(color);
+
+					}
+
+					if (wide) ((u16*)indices)[i] = (u16)lastIndex;
+					else indices[i] = (u8)lastIndex;
+
+				}
+
+			}
+
+		});
+
+		return true;
+
+	}
+
+	bool Quantize::reduceColors(PixelBuffer* _buffer, s32 _maxColors, Palette* _palette) {
+
+		if (!buildPalette(_buffer, _maxColors, _palette)) return false;
+
+		PaletteLookup lookup;
+		if (!lookup.build(_palette)) return false;
+
+		std::vector<u32> colors((size_t)_palette->getCount());
+		for (size_t i = 0; i < colors.size(); ++i) colors[i] = Quantize_pack(_palette->colors[i]);
+
+		//Only RGB is reduced and every pixel keeps its own alpha, the same way for exact and median cut palettes.
+		//Median cut colors are opaque, remapping alpha as well would turn semi transparent pixels opaque.
+		//Pixels stay visible or transparent, so the pixel counts and bbox don't change.
+		std::atomic<bool> modified = false;
+
+		JobSystem::parallelForRows(_buffer->height, ZIXEL_CHUNK_SIZE, [&](s32 _first, s32 _last) {
+
+			u32 lastColor = 0, lastStored = 0;
+			bool lastKeep = false, changed = false;
+
+			RowSpan span;
+			RowSpanIterator it = _buffer->rowSpans(0, _first, _buffer->width, _last - _first);
+
+			while (it.next(span)) {
+
+				if (span.nullTile) continue;
+
+				u8* dest = nullptr;
+
+				for (s32 i = 0; i < span.count; ++i) {
+
+					u32 stored;
+					memcpy(&stored, span.data + ((size_t)i * 4), 4);
+
+					u32 color = Quantize_readPixel(_buffer, span.data + ((size_t)i * 4));
+					u32 alpha = color >> 24;
+
+					u32 result = 0;
+
+					if (alpha != 0) {
+
+						//Neighbouring pixels often share a color.
+						if (color != lastColor) {
+
+							lastColor = color;
+
+							u32 rgb = colors[lookup.__findPacked(color)] & 0xFFFFFF;
+							u32 straight = rgb | (alpha << 24);
+
+							lastKeep = (rgb == (color & 0xFFFFFF)); //Kept as stored, so premultiplied pixels aren't rounded.
+
+							if (lastKeep) lastStored = 0;
+							else if (!_buffer->isPremultiplied() || alpha == 255) lastStored = straight;
+							else lastStored = Quantize_pack(Color::premultiply({ (u8)straight, (u8)(straight >> 8), (u8)(straight >> 16), (u8)alpha }));
+
+						}
+
+						result = lastKeep ? stored : lastStored;
+
+					}
+
+					if (result == stored) continue;
+
+					//Shared tiles are only copied once a pixel actually changes.
+					if (dest == nullptr) dest = _buffer->pixelPtrWrite(span.x, span.y);
+
+					memcpy(dest + ((size_t)i * 4), &result, 4);
+					changed = true;
+
+				}
+
+			}
+
+			if (changed) modified = true;
+
+		});
+
+		if (modified) _buffer->markAllDirty();
+
+		return true;
+
+	}
+
+}
@@ -0,0 +1,60 @@
+/*
+    Quantize.h
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "Engine/Color.h"
+#include "Engine/ZixelMacros.h"
+
+#define ZIXEL_QUANTIZE_CELL_BITS 4 //Cells per channel in PaletteLookup is 1 << this.
+
+namespace Zixel {
+
+	struct PixelBuffer;
+	struct Palette;
+	struct IndexedBuffer;
+
+	//Nearest palette color for any color, by distance in RGB.
+	//The RGB cube is split into cells, and each cell lists the palette colors that can be nearest to some color inside it, so a search only compares against a few colors.
+	//Opaque palette colors are preferred, other visible colors are only used if the palette has no opaque ones. Semi transparent colors that are in the palette map to themselves.
+	struct PaletteLookup {
+
+		Palette* palette = nullptr; //Not owned.
+		s32 transparentIndex = -1; //Used for fully transparent colors, the nearest color is used if the palette has no transparent color.
+
+		std::vector<u32> cellStarts; //Start of each cell in candidates, plus one past the last candidate.
+		std::vector<u16> candidateIndices; //Palette indices, in palette order within a cell.
+		std::vector<u32> candidateColors; //Packed RGB of each candidate.
+
+		std::vector<std::pair<u32, s32>> translucentColors; //Packed semi transparent palette colors and their indices, sorted.
+
+		//Has to be rebuilt after the palette changes. Returns false if the palette is empty.
+		bool build(Palette* _palette);
+
+		s32 find(Color4 _color); //Straight color. Returns -1 if the lookup hasn't been built.
+		s32 __findPacked(u32 _color); //Packed straight color, lookup must be built.
+
+	};
+
+	//Median cut palettes and nearest color remapping, for importing images with too many colors and keeping layers to a palette.
+	struct Quantize {
+
+		//Replaces the palette with at most _maxColors colors representing the visible pixels of _source.
+		//Images with few enough colors keep their exact colors. Otherwise colors are opaque averages of median cut boxes.
+		//Index 0 is a transparent color if the source has transparent pixels. Returns false if _maxColors is below 1.
+		static bool buildPalette(PixelBuffer* _source, s32 _maxColors, Palette* _palette);
+
+		//Writes the nearest palette index of every pixel. _dest must be the size of _source and able to hold every palette index.
+		static bool remap(PixelBuffer* _source, IndexedBuffer* _dest, PaletteLookup& _lookup);
+
+		//Builds a palette for _buffer and replaces the RGB of every pixel with its nearest palette color. Pixels keep their alpha.
+		static bool reduceColors(PixelBuffer* _buffer, s32 _maxColors, Palette* _palette);
+
+	};
+
+}
@@ -1965,6 +1965,38 @@ namespace Zixel {
 
 	}
 
+	void Renderer::renderSurfaceTiled(Surface* _surface, s32 _x, s32 _y, s32 _width, s32 _height, s32 _tileWidth, s32 _tileHeight, f32 _alpha) {
+
+		if (_surface == nullptr) {
+
+			ZIXEL_WARN("Error in Renderer::renderSurfaceTiled. '_surface' is null.");
+			return;
+
+		}
+
+		if (!_surface->created) {
+
+			ZIXEL_WARN("Error in Renderer::renderSurfaceTiled. Surface has not been initialized properly.");
+			return;
+
+		}
+
+		if (_width <= 0 || _height <= 0 || _tileWidth <= 0 || _tileHeight <= 0) {
+			return;
+		}
+
+		//Surface textures use GL_REPEAT, so UVs past 1 repeat the surface instead of drawing it once per tile.
+		currentShader->setUniformBool(currentShader->uniformHasTexture, true);
+		currentShader->setUniform4f(currentShader->uniformQuadPos, (f32)_x, (f32)_y, (f32)_width, (f32)_height);
+		currentShader->setUniform4f(currentShader->uniformAtlasUV, 0.0f, 0.0f, (f32)_width / (f32)_tileWidth, (f32)_height / (f32)_tileHeight);
+		currentShader->setUniform4f(currentShader->uniformBlend, 1.0f, 1.0f, 1.0f, _alpha);
+
+		glBindTexture(GL_TEXTURE_2D, _surface->tex);
+		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+		glBindTexture(GL_TEXTURE_2D, (ResourceManager::getTextureAtlas() != nullptr) ? ResourceManager::getTextureAtlas()->getTexture()->getId() : 0);
+
+	}
+
 	void Renderer::renderRect(s32 _x, s32 _y, s32 _width, s32 _height, Color4f color) {
 
 		if (_width <= 0 || _height <= 0) {
@@ -205,6 +205,7 @@ namespace Zixel {
 
 		void renderSurface(Surface* _surface, s32 _x, s32 _y, f32 _alpha = 1.0f);
 		void renderSurfaceStretched(Surface* _surface, s32 _x, s32 _y, s32 _width, s32 _height, f32 _alpha = 1.0f);
+		void renderSurfaceTiled(Surface* _surface, s32 _x, s32 _y, s32 _width, s32 _height, s32 _tileWidth, s32 _tileHeight, f32 _alpha = 1.0f); //Repeats the surface across the rect as a single quad, starting at the top left corner.
 
 		void renderRect(s32 _x, s32 _y, s32 _width, s32 _height, Color4f color = { 1.0f, 1.0f, 1.0f, 1.0f });
 		void renderRectOutline(s32 _x, s32 _y, s32 _width, s32 _height, s32 _outlineWidth = 1, Color4f color = { 1.0f, 1.0f, 1.0f, 1.0f });
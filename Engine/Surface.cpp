@@ -36,7 +36,8 @@ namespace Zixel {
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, (_pixelBuffer != nullptr) ? _pixelBuffer->buffer : NULL);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, (_pixelBuffer != nullptr && !_pixelBuffer->isTiled()) ? _pixelBuffer->buffer : NULL);
+		if (_pixelBuffer != nullptr && _pixelBuffer->isTiled()) __uploadTiles(_pixelBuffer);
 		
 		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
 
@@ -76,6 +77,8 @@ namespace Zixel {
 
 		}
 
+		__deleteUploadBuffers();
+
 	}
 
 	void Surface::clear(Color4f _color) {
@@ -105,12 +108,301 @@ namespace Zixel {
 
 		if (created) {
 
+			//The texture already has the right size, so streaming can replace its contents without reallocating it.
+			if (streamUploads && _pixelBuffer->width == (s32)width && _pixelBuffer->height == (s32)height) {
+				if (__streamRects(_pixelBuffer, { { 0, 0, (s32)width, (s32)height } })) return;
+			}
+
 			glBindTexture(GL_TEXTURE_2D, tex);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, _pixelBuffer->buffer);
+
+			if (_pixelBuffer->isTiled()) {
+
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+				__uploadTiles(_pixelBuffer);
+
+			}
+			else glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, _pixelBuffer->buffer);
+
 			glBindTexture(GL_TEXTURE_2D, (renderer->getTextureAtlas() != nullptr) ? renderer->getTextureAtlas()->getTexture()->getId() : 0);
 
 		}
 
 	}
 
+	void Surface::updateRegion(PixelBuffer* _pixelBuffer, const std::vector<Rect>& _rects) {
+
+		if (!created || _rects.empty()) return;
+		if (streamUploads && __streamRects(_pixelBuffer, _rects)) return;
+
+		glBindTexture(GL_TEXTURE_2D, tex);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, _pixelBuffer->isTiled() ? ZIXEL_CHUNK_SIZE : _pixelBuffer->width);
+
+		for (const Rect& rect : _rects) {
+			__uploadRect(_pixelBuffer, rect);
+		}
+
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		glBindTexture(GL_TEXTURE_2D, (renderer->getTextureAtlas() != nullptr) ? renderer->getTextureAtlas()->getTexture()->getId() : 0);
+
+	}
+
+	void Surface::updateRegion(PixelBuffer* _pixelBuffer) {
+
+		if (!_pixelBuffer->isDirty()) return;
+
+		std::vector<Rect> rects;
+		_pixelBuffer->getDirtyRects(rects);
+
+		updateRegion(_pixelBuffer, rects);
+		_pixelBuffer->clearDirty();
+
+	}
+
+	//Expects the texture to be bound and GL_UNPACK_ROW_LENGTH to be set to the row length of the buffer, or of a tile in tiled buffers.
+	void Surface::__uploadRect(PixelBuffer* _pixelBuffer, Rect _rect) {
+
+		if (!__clipRect(_pixelBuffer, _rect)) return;
+
+		if (!_pixelBuffer->isTiled()) {
+
+			glTexSubImage2D(GL_TEXTURE_2D, 0, _rect.x, _rect.y, _rect.width, _rect.height, GL_RGBA, GL_UNSIGNED_BYTE, _pixelBuffer->pixelPtr(_rect.x, _rect.y));
+			return;
+
+		}
+
+		s32 right = _rect.x + _rect.width;
+		s32 bottom = _rect.y + _rect.height;
+
+		//Tiles aren't next to each other in memory, so each tile the rect touches is uploaded on its own.
+		for (s32 y = _rect.y; y < bottom; y = ((y / ZIXEL_CHUNK_SIZE) + 1) * ZIXEL_CHUNK_SIZE) {
+
+			s32 h = Math::minInt(bottom, ((y / ZIXEL_CHUNK_SIZE) + 1) * ZIXEL_CHUNK_SIZE) - y;
+
+			for (s32 x = _rect.x; x < right; x = ((x / ZIXEL_CHUNK_SIZE) + 1) * ZIXEL_CHUNK_SIZE) {
+
+				s32 w = Math::minInt(right, ((x / ZIXEL_CHUNK_SIZE) + 1) * ZIXEL_CHUNK_SIZE) - x;
+				glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, _pixelBuffer->pixelPtr(x, y));
+
+			}
+
+		}
+
+	}
+
+	void Surface::setStreamUploads(bool _streamUploads) {
+
+		streamUploads = _streamUploads;
+		if (!streamUploads) __deleteUploadBuffers();
+
+	}
+
+	//Packs the rects into the next free upload buffer and updates the texture from it, the copy into the texture happens asynchronously.
+	//Returns false if no upload buffer could be mapped, the caller should upload directly instead.
+	bool Surface::__streamRects(PixelBuffer* _pixelBuffer, const std::vector<Rect>& _rects) {
+
+		std::vector<Rect> clipped;
+		clipped.reserve(_rects.size());
+
+		size_t size = 0;
+
+		for (Rect rect : _rects) {
+
+			if (!__clipRect(_pixelBuffer, rect)) continue;
+
+			clipped.push_back(rect);
+			size += (size_t)rect.width * (size_t)rect.height * 4;
+
+		}
+
+		if (clipped.empty()) return true;
+
+		SurfaceUploadBuffer* uploadBuffer = __acquireUploadBuffer(size);
+		if (uploadBuffer == nullptr) return false;
+
+		//Previous contents are orphaned, the fence already guarantees the GPU is done reading them.
+		u8* mapped = (u8*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+
+		if (mapped == nullptr) {
+
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+			ZIXEL_WARN("Error in Surface::__streamRects. Unable to map upload buffer.");
+			return false;
+
+		}
+
+		size_t offset = 0;
+
+		for (const Rect& rect : clipped) {
+
+			size_t rowSize = (size_t)rect.width * 4;
+
+			RowSpan span;
+			RowSpanIterator it = _pixelBuffer->rowSpans(rect.x, rect.y, rect.width, rect.height);
+
+			//Spans are split at tile boundaries, place each one at its position inside the packed rect.
+			while (it.next(span)) {
+				memcpy(mapped + offset + ((size_t)(span.y - rect.y) * rowSize) + ((size_t)(span.x - rect.x) * 4), span.data, (size_t)span.count * 4);
+			}
+
+			offset += rowSize * (size_t)rect.height;
+
+		}
+
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		glBindTexture(GL_TEXTURE_2D, tex);
+
+		offset = 0;
+
+		for (const Rect& rect : clipped) {
+
+			glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.width, rect.height, GL_RGBA, GL_UNSIGNED_BYTE, (const void*)offset);
+			offset += (size_t)rect.width * (size_t)rect.height * 4;
+
+		}
+
+		uploadBuffer->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glBindTexture(GL_TEXTURE_2D, (renderer->getTextureAtlas() != nullptr) ? renderer->getTextureAtlas()->getTexture()->getId() : 0);
+
+		return true;
+
+	}
+
+	//Returns a bound upload buffer with room for _size bytes that the GPU isn't reading from anymore.
+	SurfaceUploadBuffer* Surface::__acquireUploadBuffer(size_t _size) {
+
+		if (uploadBuffers.empty()) {
+
+			uploadBuffers.resize(ZIXEL_SURFACE_UPLOAD_BUFFER_COUNT);
+
+			for (SurfaceUploadBuffer& uploadBuffer : uploadBuffers) {
+				glGenBuffers(1, &uploadBuffer.pbo);
+			}
+
+		}
+
+		//Take the first buffer that is already free, only wait if all of them are still in flight.
+		SurfaceUploadBuffer* uploadBuffer = nullptr;
+
+		for (size_t i = 0; i < uploadBuffers.size(); ++i) {
+
+			SurfaceUploadBuffer& candidate = uploadBuffers[(uploadIndex + i) % uploadBuffers.size()];
+
+			if (candidate.fence == nullptr) {
+
+				uploadBuffer = &candidate;
+				uploadIndex = (u32)((uploadIndex + i + 1) % uploadBuffers.size());
+
+				break;
+
+			}
+
+			GLenum status = glClientWaitSync(candidate.fence, 0, 0);
+
+			if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+
+				uploadBuffer = &candidate;
+				uploadIndex = (u32)((uploadIndex + i + 1) % uploadBuffers.size());
+
+				break;
+
+			}
+
+		}
+
+		if (uploadBuffer == nullptr) {
+
+			uploadBuffer = &uploadBuffers[uploadIndex];
+			uploadIndex = (uploadIndex + 1) % (u32)uploadBuffers.size();
+
+			GLenum status = GL_TIMEOUT_EXPIRED;
+			while (status == GL_TIMEOUT_EXPIRED) {
+				status = glClientWaitSync(uploadBuffer->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			}
+
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+
+				ZIXEL_WARN("Error in Surface::__acquireUploadBuffer. Waiting for upload buffer failed.");
+				return nullptr;
+
+			}
+
+		}
+
+		if (uploadBuffer->fence != nullptr) {
+
+			glDeleteSync(uploadBuffer->fence);
+			uploadBuffer->fence = nullptr;
+
+		}
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer->pbo);
+
+		if (uploadBuffer->size < _size) {
+
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)_size, NULL, GL_STREAM_DRAW);
+			uploadBuffer->size = _size;
+
+		}
+
+		return uploadBuffer;
+
+	}
+
+	void Surface::__deleteUploadBuffers() {
+
+		for (SurfaceUploadBuffer& uploadBuffer : uploadBuffers) {
+
+			if (uploadBuffer.fence != nullptr) glDeleteSync(uploadBuffer.fence);
+			glDeleteBuffers(1, &uploadBuffer.pbo);
+
+		}
+
+		uploadBuffers.clear();
+		uploadIndex = 0;
+
+	}
+
+	bool Surface::__clipRect(PixelBuffer* _pixelBuffer, Rect& _rect) {
+
+		s32 right = Math::minInt(_rect.x + _rect.width, Math::minInt(_pixelBuffer->width, (s32)width));
+		s32 bottom = Math::minInt(_rect.y + _rect.height, Math::minInt(_pixelBuffer->height, (s32)height));
+
+		_rect.x = Math::maxInt(_rect.x, 0);
+		_rect.y = Math::maxInt(_rect.y, 0);
+		_rect.width = right - _rect.x;
+		_rect.height = bottom - _rect.y;
+
+		return (_rect.width > 0 && _rect.height > 0);
+
+	}
+
+	//Expects the texture to be bound already.
+	void Surface::__uploadTiles(PixelBuffer* _pixelBuffer) {
+
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, ZIXEL_CHUNK_SIZE);
+
+		for (s32 ty = 0; ty < _pixelBuffer->tileRows; ++ty) {
+
+			for (s32 tx = 0; tx < _pixelBuffer->tileColumns; ++tx) {
+
+				s32 x = tx * ZIXEL_CHUNK_SIZE;
+				s32 y = ty * ZIXEL_CHUNK_SIZE;
+
+				s32 w = std::min(ZIXEL_CHUNK_SIZE, _pixelBuffer->width - x);
+				s32 h = std::min(ZIXEL_CHUNK_SIZE, _pixelBuffer->height - y);
+
+				glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, _pixelBuffer->getTile(tx, ty)->data);
+
+			}
+
+		}
+
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	}
+
 }
\ No newline at end of file
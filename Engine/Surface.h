@@ -6,13 +6,25 @@
 
 #pragma once
 
+#include <vector>
+
 #include "Engine/Color.h"
+#include "Engine/Math.h"
 
 namespace Zixel {
 
 	struct Renderer;
 	struct PixelBuffer;
 
+	//Pixel buffer object used to stream texture data, the fence is signaled once the GPU is done reading from it.
+	struct SurfaceUploadBuffer {
+
+		u32 pbo = 0;
+		size_t size = 0;
+		GLsync fence = nullptr;
+
+	};
+
 	struct Surface {
 
 		Renderer* renderer;
@@ -25,11 +37,27 @@ namespace Zixel {
 
 		bool created = false;
 
+		//Uploads go through a ring of pixel buffer objects instead of straight from client memory, so the driver copy doesn't block.
+		bool streamUploads = false;
+		std::vector<SurfaceUploadBuffer> uploadBuffers;
+		u32 uploadIndex = 0;
+
 		Surface(Renderer* _renderer, u32 _width, u32 _height, PixelBuffer* _pixelBuffer = nullptr);
 		~Surface();
 
 		void clear(Color4f _color);
 		void setData(PixelBuffer* _pixelBuffer);
+		void updateRegion(PixelBuffer* _pixelBuffer, const std::vector<Rect>& _rects);
+		void updateRegion(PixelBuffer* _pixelBuffer); //Uploads the dirty rects of the buffer and clears them.
+
+		void __uploadTiles(PixelBuffer* _pixelBuffer);
+		void __uploadRect(PixelBuffer* _pixelBuffer, Rect _rect);
+
+		void setStreamUploads(bool _streamUploads);
+		bool __streamRects(PixelBuffer* _pixelBuffer, const std::vector<Rect>& _rects);
+		SurfaceUploadBuffer* __acquireUploadBuffer(size_t _size);
+		void __deleteUploadBuffers();
+		bool __clipRect(PixelBuffer* _pixelBuffer, Rect& _rect);
 
 	};
 
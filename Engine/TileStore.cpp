@@ -0,0 +1,192 @@
+/*
+    TileStore.cpp
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#include "Engine/ZixelPCH.h"
+#include "Engine/TileStore.h"
+#include "Engine/PixelBuffer.h"
+#include "Engine/JobSystem.h"
+
+namespace Zixel {
+
+	static inline u64 TileStore_mix(u64 _hash, u64 _value) {
+
+		_hash ^= _value * 0x9E3779B97F4A7C15ull;
+		_hash = (_hash << 31) | (_hash >> 33);
+
+		return _hash * 0xC2B2AE3D27D4EB4Full;
+
+	}
+
+	TileStore::~TileStore() {
+		clear();
+	}
+
+	s32 TileStore::deduplicate(PixelBuffer* _buffer) {
+
+		if (!_buffer->isTiled()) return 0;
+
+		std::vector<PixelTile*>& bufferTiles = _buffer->tiles;
+		s32 tileTotal = (s32)bufferTiles.size();
+
+		//Hashing reads every byte of every tile, so it's split across threads. Sharing tiles happens afterwards on this thread.
+		std::vector<u64> hashes((size_t)tileTotal, 0);
+		std::vector<u8> empty((size_t)tileTotal, 0);
+
+		JobSystem::parallelFor(0, tileTotal, 16, [&](s32 _first, s32 _last) {
+
+			for (s32 i = _first; i < _last; ++i) {
+
+				PixelTile* tile = bufferTiles[i];
+				if (tile == PixelTile::getNull()) continue;
+
+				hashes[i] = hashTile(tile);
+
+				bool zero = true;
+				for (size_t j = 0; j < sizeof(PixelTile::data) && zero; j += 8) {
+
+					u64 value;
+					memcpy(&value, tile->data + j, 8);
+
+					zero = (value == 0);
+
+				}
+
+				empty[i] = zero;
+
+			}
+
+		});
+
+		s32 freed = 0;
+
+		for (s32 i = 0; i < tileTotal; ++i) {
+
+			PixelTile* tile = bufferTiles[i];
+			if (tile == PixelTile::getNull()) continue;
+
+			if (empty[i]) {
+
+				_buffer->__releaseTile((size_t)i);
+				++freed;
+
+				continue;
+
+			}
+
+			std::vector<PixelTile*>& bucket = tiles[hashes[i]];
+			PixelTile* match = nullptr;
+
+			for (PixelTile* stored : bucket) {
+
+				if (stored == tile || memcmp(stored->data, tile->data, sizeof(PixelTile::data)) == 0) {
+
+					match = stored;
+					break;
+
+				}
+
+			}
+
+			if (match == nullptr) {
+
+				bucket.push_back(PixelTile::retain(tile));
+				++tileCount;
+
+				continue;
+
+			}
+
+			if (match == tile) continue;
+
+			bufferTiles[i] = PixelTile::retain(match);
+			PixelTile::release(tile);
+
+			++freed;
+
+		}
+
+		return freed;
+
+	}
+
+	s32 TileStore::prune() {
+
+		s32 dropped = 0;
+
+		for (auto it = tiles.begin(); it != tiles.end();) {
+
+			std::vector<PixelTile*>& bucket = it->second;
+
+			for (size_t i = 0; i < bucket.size();) {
+
+				//Only the store's own reference is left.
+				if (bucket[i]->refCount.load(std::memory_order_acquire) == 1) {
+
+					PixelTile::release(bucket[i]);
+
+					bucket[i] = bucket.back();
+					bucket.pop_back();
+
+					--tileCount;
+					++dropped;
+
+				}
+				else ++i;
+
+			}
+
+			if (bucket.empty()) it = tiles.erase(it);
+			else ++it;
+
+		}
+
+		return dropped;
+
+	}
+
+	void TileStore::clear() {
+
+		for (auto& it : tiles) {
+			for (PixelTile* tile : it.second) PixelTile::release(tile);
+		}
+
+		tiles.clear();
+		tileCount = 0;
+
+	}
+
+	size_t TileStore::getMemoryUsage() {
+		return (size_t)tileCount * sizeof(PixelTile);
+	}
+
+	u64 TileStore::hashTile(const PixelTile* _tile) {
+
+		//Four independent lanes keep the multiplies from waiting on each other.
+		u64 lanes[4] = { 0x243F6A8885A308D3ull, 0x13198A2E03707344ull, 0xA4093822299F31D0ull, 0x082EFA98EC4E6C89ull };
+
+		const u8* data = _tile->data;
+
+		for (size_t i = 0; i < sizeof(PixelTile::data); i += 32) {
+
+			for (s32 lane = 0; lane < 4; ++lane) {
+
+				u64 value;
+				memcpy(&value, data + i + ((size_t)lane * 8), 8);
+
+				lanes[lane] = TileStore_mix(lanes[lane], value);
+
+			}
+
+		}
+
+		u64 hash = 0;
+		for (s32 lane = 0; lane < 4; ++lane) hash = TileStore_mix(hash, lanes[lane]);
+
+		return hash ^ (hash >> 29);
+
+	}
+
+}
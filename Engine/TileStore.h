@@ -0,0 +1,43 @@
+/*
+    TileStore.h
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+
+#include "Engine/ZixelMacros.h"
+
+namespace Zixel {
+
+	struct PixelTile;
+	struct PixelBuffer;
+
+	//Shares identical tiles between tiled buffers, like the cels of an animation that hold, loop or repeat a background.
+	//Tiles are looked up by a hash of their content and compared byte for byte before being shared, so a hash collision never merges different tiles.
+	//Shared tiles are copied on the first write like tiles shared by clone, so buffers work the same whether they went through the store or not.
+	//The store's reference counts too, so a stored tile is copied on its first write even if only one buffer uses it.
+	struct TileStore {
+
+		std::unordered_map<u64, std::vector<PixelTile*>> tiles; //Content hash to the tiles with that hash. The store holds a reference to each.
+		s32 tileCount = 0;
+
+		~TileStore();
+
+		//Points tiles of the buffer with the same content as a stored tile at the stored tile, and stores the rest.
+		//Allocated tiles that are fully transparent go back to the null tile. Returns the number of tiles freed. Contiguous buffers are left alone.
+		s32 deduplicate(PixelBuffer* _buffer);
+
+		s32 prune(); //Drops tiles no buffer uses anymore. Returns the number of tiles dropped.
+		void clear();
+
+		size_t getMemoryUsage(); //Each stored tile counted once.
+
+		static u64 hashTile(const PixelTile* _tile);
+
+	};
+
+}
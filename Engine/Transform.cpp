@@ -0,0 +1,467 @@
+/*
+    Transform.cpp
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#include "Engine/ZixelPCH.h"
+#include "Engine/Transform.h"
+#include "Engine/PixelBuffer.h"
+#include "Engine/MaskBuffer.h"
+#include "Engine/BlendKernel.h"
+#include "Engine/JobSystem.h"
+#include "Engine/CPU.h"
+
+#ifdef ZIXEL_SIMD_X86
+	#include <immintrin.h>
+#endif
+
+namespace Zixel {
+
+	static s64 Transform_floorDiv(s64 _a, s64 _b) {
+
+		s64 quotient = _a / _b;
+		if ((_a % _b) != 0 && ((_a < 0) != (_b < 0))) --quotient;
+
+		return quotient;
+
+	}
+
+	static s64 Transform_ceilDiv(s64 _a, s64 _b) {
+		return -Transform_floorDiv(-_a, _b);
+	}
+
+	//Narrows _first and _last down to the steps i where 0 <= _start + (i * _step) < _limit.
+	static void Transform_clipRange(s64 _start, s64 _step, s64 _limit, s64& _first, s64& _last) {
+
+		if (_step == 0) {
+
+			if (_start < 0 || _start >= _limit) _last = _first;
+			return;
+
+		}
+
+		if (_step > 0) {
+
+			_first = std::max(_first, Transform_ceilDiv(-_start, _step));
+			_last = std::min(_last, Transform_floorDiv(_limit - 1 - _start, _step) + 1);
+
+		}
+		else {
+
+			_first = std::max(_first, Transform_ceilDiv(_limit - 1 - _start, _step));
+			_last = std::min(_last, Transform_floorDiv(-_start, _step) + 1);
+
+		}
+
+	}
+
+	//Exact for multiples of 90 degrees, so turns don't pick up rounding errors.
+	static void Transform_sinCos(f64 _angle, f64& _sin, f64& _cos) {
+
+		f64 turns = _angle / 90.0;
+
+		if (turns == floor(turns)) {
+
+			static const f64 sines[4] = { 0.0, 1.0, 0.0, -1.0 };
+			s32 index = (s32)(((s64)turns % 4 + 4) % 4);
+
+			_sin = sines[index];
+			_cos = sines[(index + 1) % 4];
+
+			return;
+
+		}
+
+		_sin = sin(_angle * (PI_D / 180.0));
+		_cos = cos(_angle * (PI_D / 180.0));
+
+	}
+
+	#ifdef ZIXEL_SIMD_X86
+
+	//Gathers eight pixels at a time from contiguous storage. Positions have already been clipped to the source, so they fit in 32 bits.
+	ZIXEL_TARGET_AVX2 static s32 Transform_sampleAVX2(const u8* _buffer, s32 _width, s32 _u, s32 _v, s32 _stepU, s32 _stepV, s32 _count, u8* _out) {
+
+		const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+		const __m256i width = _mm256_set1_epi32(_width);
+
+		__m256i u = _mm256_add_epi32(_mm256_set1_epi32(_u), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(_stepU)));
+		__m256i v = _mm256_add_epi32(_mm256_set1_epi32(_v), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(_stepV)));
+
+		//Wraps after the last pixel of the row, which is never sampled.
+		const __m256i stepU = _mm256_set1_epi32((s32)((u32)_stepU * 8u));
+		const __m256i stepV = _mm256_set1_epi32((s32)((u32)_stepV * 8u));
+
+		s32 i = 0;
+
+		for (; i + 8 <= _count; i += 8) {
+
+			__m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srai_epi32(v, 16), width), _mm256_srai_epi32(u, 16));
+			__m256i pixels = _mm256_i32gather_epi32((const int*)_buffer, index, 4);
+
+			_mm256_storeu_si256((__m256i*)(_out + ((size_t)i * 4)), pixels);
+
+			u = _mm256_add_epi32(u, stepU);
+			v = _mm256_add_epi32(v, stepV);
+
+		}
+
+		return i;
+
+	}
+
+	#endif
+
+	//Samples _count source pixels for the destination row _y, starting at _x. The whole run has to map inside the source.
+	static void Transform_sampleRow(PixelBuffer* _source, TransformMapping& _mapping, s32 _x, s32 _y, s32 _count, u8* _out) {
+
+		s64 u = _mapping.u + ((s64)_y * _mapping.stepUY) + ((s64)_x * _mapping.stepUX);
+		s64 v = _mapping.v + ((s64)_y * _mapping.stepVY) + ((s64)_x * _mapping.stepVX);
+
+		//Steps only matter if there's more than one pixel, and then they fit in 32 bits.
+		s32 stepU = (_count > 1) ? (s32)_mapping.stepUX : 0;
+		s32 stepV = (_count > 1) ? (s32)_mapping.stepVX : 0;
+
+		s32 sourceX = (s32)(u >> 16);
+		s32 sourceY = (s32)(v >> 16);
+
+		//Straight runs of the source, forwards or backwards.
+		if (stepV == 0 && (stepU == 65536 || stepU == -65536 || _count == 1)) {
+
+			s32 left = (stepU < 0) ? (sourceX - _count + 1) : sourceX;
+
+			RowSpan span;
+			RowSpanIterator it = _source->rowSpans(left, sourceY, _count, 1);
+
+			while (it.next(span)) {
+				memcpy(_out + ((size_t)(span.x - left) * 4), span.data, (size_t)span.count * 4);
+			}
+
+			if (stepU < 0) std::reverse((u32*)_out, (u32*)_out + _count);
+
+			return;
+
+		}
+
+		//Columns of the source, after turning by 90 degrees.
+		if (stepU == 0 && (stepV == 65536 || stepV == -65536)) {
+
+			s32 direction = (stepV > 0) ? 1 : -1;
+
+			if (!_source->isTiled()) {
+
+				const u8* pixel = _source->pixelPtr(sourceX, sourceY);
+				ptrdiff_t stride = (ptrdiff_t)_source->width * 4 * direction;
+
+				for (s32 i = 0; i < _count; ++i, pixel += stride) {
+					memcpy(_out + ((size_t)i * 4), pixel, 4);
+				}
+
+				return;
+
+			}
+
+			for (s32 i = 0; i < _count; ++i) {
+				memcpy(_out + ((size_t)i * 4), _source->pixelPtr(sourceX, sourceY + (i * direction)), 4);
+			}
+
+			return;
+
+		}
+
+		s32 i = 0;
+
+		#ifdef ZIXEL_SIMD_X86
+
+		static const bool useAVX2 = CPU::hasAVX2();
+		if (useAVX2 && !_source->isTiled()) i = Transform_sampleAVX2(_source->buffer, _source->width, (s32)u, (s32)v, stepU, stepV, _count, _out);
+
+		#endif
+
+		for (; i < _count; ++i) {
+
+			s32 x = (s32)((u + ((s64)i * stepU)) >> 16);
+			s32 y = (s32)((v + ((s64)i * stepV)) >> 16);
+
+			memcpy(_out + ((size_t)i * 4), _source->pixelPtr(x, y), 4);
+
+		}
+
+	}
+
+	static void Transform_sampleMask(MaskBuffer* _mask, TransformMapping& _mapping, s32 _x, s32 _y, s32 _count, u8* _out) {
+
+		s64 u = _mapping.u + ((s64)_y * _mapping.stepUY) + ((s64)_x * _mapping.stepUX);
+		s64 v = _mapping.v + ((s64)_y * _mapping.stepVY) + ((s64)_x * _mapping.stepVX);
+
+		s64 stepU = (_count > 1) ? _mapping.stepUX : 0;
+		s64 stepV = (_count > 1) ? _mapping.stepVX : 0;
+
+		for (s32 i = 0; i < _count; ++i) {
+
+			s32 x = (s32)((u + (i * stepU)) >> 16);
+			s32 y = (s32)((v + (i * stepV)) >> 16);
+
+			_out[i] = (u8)((_mask->rowPtr(y)[x >> 6] >> (x & 63)) & 0x01);
+
+		}
+
+	}
+
+	bool TransformMapping::init(const PixelTransform& _transform, s32 _sourceWidth, s32 _sourceHeight) {
+
+		if (_transform.width == 0.0f || _transform.height == 0.0f || _sourceWidth < 1 || _sourceHeight < 1) return false;
+
+		sourceWidth = _sourceWidth;
+		sourceHeight = _sourceHeight;
+
+		f64 sine, cosine;
+		Transform_sinCos((f64)_transform.angle, sine, cosine);
+
+		f64 centerX = (f64)_transform.x + ((f64)_transform.width / 2.0);
+		f64 centerY = (f64)_transform.y + ((f64)_transform.height / 2.0);
+
+		f64 scaleX = ((f64)_sourceWidth / (f64)_transform.width) * (_transform.flipX ? -1.0 : 1.0);
+		f64 scaleY = ((f64)_sourceHeight / (f64)_transform.height) * (_transform.flipY ? -1.0 : 1.0);
+
+		//Rotates back around the center, undoes the flip and scales to the source. Source = (a, b; c, d) * destination + (tx, ty).
+		f64 a = scaleX * cosine;
+		f64 b = scaleX * sine;
+		f64 c = -scaleY * sine;
+		f64 d = scaleY * cosine;
+
+		f64 tx = ((f64)_sourceWidth / 2.0) - (a * centerX) - (b * centerY);
+		f64 ty = ((f64)_sourceHeight / 2.0) - (c * centerX) - (d * centerY);
+
+		//Sampled at pixel centers.
+		u = llround(((a * 0.5) + (b * 0.5) + tx) * 65536.0);
+		v = llround(((c * 0.5) + (d * 0.5) + ty) * 65536.0);
+
+		stepUX = llround(a * 65536.0);
+		stepUY = llround(b * 65536.0);
+		stepVX = llround(c * 65536.0);
+		stepVY = llround(d * 65536.0);
+
+		bounds = Transform::getBounds(_transform);
+
+		return (bounds.width > 0 && bounds.height > 0);
+
+	}
+
+	bool TransformMapping::getRowRange(s32 _y, s32& _first, s32& _last) {
+
+		s64 first = bounds.x;
+		s64 last = (s64)bounds.x + bounds.width;
+
+		Transform_clipRange(u + ((s64)_y * stepUY), stepUX, (s64)sourceWidth << 16, first, last);
+		Transform_clipRange(v + ((s64)_y * stepVY), stepVX, (s64)sourceHeight << 16, first, last);
+
+		if (first >= last) return false;
+
+		_first = (s32)first;
+		_last = (s32)last;
+
+		return true;
+
+	}
+
+	Rect Transform::getBounds(const PixelTransform& _transform) {
+
+		f64 sine, cosine;
+		Transform_sinCos((f64)_transform.angle, sine, cosine);
+
+		f64 halfWidth = (f64)_transform.width / 2.0;
+		f64 halfHeight = (f64)_transform.height / 2.0;
+
+		f64 centerX = (f64)_transform.x + halfWidth;
+		f64 centerY = (f64)_transform.y + halfHeight;
+
+		f64 left = centerX, top = centerY, right = centerX, bottom = centerY;
+
+		for (s32 i = 0; i < 4; ++i) {
+
+			f64 cornerX = (i & 1) ? halfWidth : -halfWidth;
+			f64 cornerY = (i & 2) ? halfHeight : -halfHeight;
+
+			f64 x = centerX + (cornerX * cosine) - (cornerY * sine);
+			f64 y = centerY + (cornerX * sine) + (cornerY * cosine);
+
+			left = std::min(left, x);
+			top = std::min(top, y);
+			right = std::max(right, x);
+			bottom = std::max(bottom, y);
+
+		}
+
+		s32 boundsLeft = (s32)floor(left);
+		s32 boundsTop = (s32)floor(top);
+
+		return { boundsLeft, boundsTop, (s32)ceil(right) - boundsLeft, (s32)ceil(bottom) - boundsTop };
+
+	}
+
+	bool Transform::apply(PixelBuffer* _source, PixelBuffer* _dest, const PixelTransform& _transform, BlendMode _blendMode, MaskBuffer* _sourceMask) {
+
+		if (_source == _dest) {
+
+			ZIXEL_WARN("Error in Transform::apply. Source and destination can't be the same buffer.");
+			return false;
+
+		}
+
+		if (_sourceMask != nullptr && (_sourceMask->width != _source->width || _sourceMask->height != _source->height)) {
+
+			ZIXEL_WARN("Error in Transform::apply. Mask size ({}x{}) doesn't match the source size ({}x{}).", _sourceMask->width, _sourceMask->height, _source->width, _source->height);
+			return false;
+
+		}
+
+		TransformMapping mapping;
+		if (!mapping.init(_transform, _source->width, _source->height)) return false;
+
+		s32 left = Math::maxInt(mapping.bounds.x, 0);
+		s32 top = Math::maxInt(mapping.bounds.y, 0);
+		s32 right = Math::minInt(mapping.bounds.x + mapping.bounds.width, _dest->width);
+		s32 bottom = Math::minInt(mapping.bounds.y + mapping.bounds.height, _dest->height);
+
+		if (left >= right || top >= bottom) return false;
+
+		s32 bandRows = _dest->__getBandRows(top, bottom, right - left);
+
+		std::vector<PixelBufferBand> bands((size_t)_dest->__getBandCount(top, bottom, bandRows));
+		_dest->__prepareBands(bands);
+
+		_dest->__forEachBand(top, bottom, bandRows, [&](s32 _band, s32 _top, s32 _bottom) {
+
+			PixelBufferBand& band = bands[_band];
+			s32* columnCounts = band.columnCountsPtr;
+
+			std::vector<u8> row((size_t)(right - left) * 4);
+			std::vector<u8> selected((_sourceMask != nullptr) ? (size_t)(right - left) : 0);
+
+			for (s32 y = _top; y < _bottom; ++y) {
+
+				s32 first, last;
+				if (!mapping.getRowRange(y, first, last)) continue;
+
+				first = Math::maxInt(first, left);
+				last = Math::minInt(last, right);
+
+				if (first >= last) continue;
+
+				s32 count = last - first;
+
+				Transform_sampleRow(_source, mapping, first, y, count, row.data());
+				if (_sourceMask != nullptr) Transform_sampleMask(_sourceMask, mapping, first, y, count, selected.data());
+
+				if (_source->alphaMode != _dest->alphaMode) _dest->__convertSpan(row.data(), row.data(), count, _source->alphaMode);
+
+				RowSpan span;
+				RowSpanIterator it = _dest->rowSpans(first, y, count, 1);
+
+				while (it.next(span)) {
+
+					s32 offset = span.x - first;
+					const u8* source = row.data() + ((size_t)offset * 4);
+
+					//Null tiles only need to be touched if the span would change them, same as PixelBuffer::merge.
+					if (span.nullTile) {
+
+						bool hasAlpha = false;
+						bool hasData = false;
+
+						for (s32 i = 0; i < span.count && !hasData; ++i) {
+
+							u32 pixel;
+							memcpy(&pixel, source + ((size_t)i * 4), 4);
+
+							if ((pixel & 0xFF000000) != 0) hasAlpha = true;
+							if (pixel != 0) hasData = true;
+
+						}
+
+						if (_blendMode == BlendMode::Overwrite ? !hasData : !hasAlpha) continue;
+
+					}
+
+					u8* dest = _dest->pixelPtrWrite(span.x, span.y);
+
+					s32 i = 0;
+
+					while (i < span.count) {
+
+						//Blend each run of selected pixels as one span.
+						s32 runStart = i;
+
+						if (_sourceMask != nullptr) {
+
+							while (runStart < span.count && !selected[offset + runStart]) ++runStart;
+
+							i = runStart;
+							while (i < span.count && selected[offset + i]) ++i;
+
+						}
+						else i = span.count;
+
+						if (runStart >= i) break;
+
+						BlendSpanResult result;
+						_dest->__blendSpan(dest + ((size_t)runStart * 4), source + ((size_t)runStart * 4), i - runStart, _blendMode, nullptr, result, (columnCounts != nullptr) ? (columnCounts + span.x + runStart) : nullptr);
+
+						_dest->__applyBlendSpanResult(result, span.x + runStart, span.y, i - runStart, band);
+
+					}
+
+				}
+
+			}
+
+		});
+
+		_dest->__reduceBands(bands);
+
+		bool modified = false;
+		for (PixelBufferBand& band : bands) {
+			if (band.modified) modified = true;
+		}
+
+		return modified;
+
+	}
+
+	void Transform::applyMask(MaskBuffer* _source, MaskBuffer* _dest, const PixelTransform& _transform) {
+
+		TransformMapping mapping;
+		bool hasArea = mapping.init(_transform, _source->width, _source->height);
+
+		JobSystem::parallelFor(0, _dest->height, 64, [&](s32 _first, s32 _last) {
+
+			std::vector<u8> selected((size_t)_dest->width);
+
+			for (s32 y = _first; y < _last; ++y) {
+
+				u64* row = _dest->rowPtr(y);
+				std::fill(row, row + _dest->wordsPerRow, (u64)0);
+
+				s32 first, last;
+				if (!hasArea || !mapping.getRowRange(y, first, last)) continue;
+
+				first = Math::maxInt(first, 0);
+				last = Math::minInt(last, _dest->width);
+
+				if (first >= last) continue;
+
+				Transform_sampleMask(_source, mapping, first, y, last - first, selected.data());
+
+				for (s32 x = first; x < last; ++x) {
+					row[x >> 6] |= (u64)selected[x - first] << (x & 63);
+				}
+
+			}
+
+		});
+
+	}
+
+}
@@ -0,0 +1,61 @@
+/*
+    Transform.h
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "Engine/Color.h"
+#include "Engine/Math.h"
+#include "Engine/ZixelMacros.h"
+
+namespace Zixel {
+
+	struct PixelBuffer;
+	struct MaskBuffer;
+
+	//Where a source buffer ends up in the destination.
+	//The source is scaled to width x height with its top left corner at x, y, flipped, then rotated clockwise by angle degrees around the center of that rect.
+	struct PixelTransform {
+
+		f32 x = 0.0f, y = 0.0f;
+		f32 width = 0.0f, height = 0.0f;
+		f32 angle = 0.0f;
+		bool flipX = false, flipY = false;
+
+	};
+
+	//Destination to source mapping of a transform, in 16.16 fixed point.
+	//Pixel dx, dy samples the source pixel at ((u + (dx * stepUX) + (dy * stepUY)) >> 16, (v + (dx * stepVX) + (dy * stepVY)) >> 16).
+	struct TransformMapping {
+
+		s64 u = 0, v = 0;
+		s64 stepUX = 0, stepUY = 0;
+		s64 stepVX = 0, stepVY = 0;
+
+		s32 sourceWidth = 0, sourceHeight = 0;
+		Rect bounds; //Destination pixels that can map inside the source.
+
+		bool init(const PixelTransform& _transform, s32 _sourceWidth, s32 _sourceHeight); //Returns false if the transform has no area.
+		bool getRowRange(s32 _y, s32& _first, s32& _last); //Pixels of row _y that map inside the source, _last is exclusive.
+
+	};
+
+	//Nearest neighbour transforms, inverse mapped so every destination pixel is written once.
+	//Rows are split across the job system. Turns by multiples of 90 degrees and flips at the original size read whole source rows or columns instead of sampling pixel by pixel.
+	struct Transform {
+
+		static Rect getBounds(const PixelTransform& _transform); //Destination area the transformed rectangle covers.
+
+		//Only source pixels selected in _sourceMask are transformed if it's set, it must be the size of the source. Returns true if the destination changed.
+		static bool apply(PixelBuffer* _source, PixelBuffer* _dest, const PixelTransform& _transform, BlendMode _blendMode = BlendMode::Normal, MaskBuffer* _sourceMask = nullptr);
+
+		//Replaces the destination mask with the transformed source mask.
+		static void applyMask(MaskBuffer* _source, MaskBuffer* _dest, const PixelTransform& _transform);
+
+	};
+
+}
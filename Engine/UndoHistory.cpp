@@ -0,0 +1,622 @@
+/*
+    UndoHistory.cpp
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#include "Engine/ZixelPCH.h"
+#include "Engine/UndoHistory.h"
+#include "Engine/PixelBuffer.h"
+
+namespace Zixel {
+
+	static void UndoHistory_writeVarInt(std::vector<u8>& _out, size_t _value) {
+
+		while (_value >= 0x80) {
+
+			_out.push_back((u8)(_value | 0x80));
+			_value >>= 7;
+
+		}
+
+		_out.push_back((u8)_value);
+
+	}
+
+	static size_t UndoHistory_readVarInt(const std::vector<u8>& _data, size_t& _pos) {
+
+		size_t value = 0;
+		u32 shift = 0;
+
+		while (_pos < _data.size()) {
+
+			u8 byte = _data[_pos++];
+			value |= ((size_t)(byte & 0x7F) << shift);
+
+			if ((byte & 0x80) == 0) break;
+			shift += 7;
+
+		}
+
+		return value;
+
+	}
+
+	UndoHistory::UndoHistory(size_t _byteBudget) {
+		byteBudget = _byteBudget;
+	}
+
+	UndoHistory::~UndoHistory() {
+
+		cancel();
+		clear();
+
+	}
+
+	void UndoHistory::begin() {
+
+		if (recording != nullptr) {
+
+			ZIXEL_WARN("Error in UndoHistory::begin. Already recording.");
+			return;
+
+		}
+
+		recording = new UndoEntry();
+
+	}
+
+	void UndoHistory::track(PixelBuffer* _buffer) {
+		track(_buffer, 0, 0, _buffer->width, _buffer->height);
+	}
+
+	void UndoHistory::track(PixelBuffer* _buffer, s32 _x, s32 _y, s32 _width, s32 _height) {
+
+		if (recording == nullptr) {
+
+			ZIXEL_WARN("Error in UndoHistory::track. Not recording, call begin first.");
+			return;
+
+		}
+
+		UndoBufferRecord* record = nullptr;
+
+		for (UndoBufferRecord& existing : recording->records) {
+
+			if (existing.buffer == _buffer) {
+
+				record = &existing;
+				break;
+
+			}
+
+		}
+
+		if (record == nullptr) {
+
+			recording->records.emplace_back();
+
+			record = &recording->records.back();
+			record->buffer = _buffer;
+			record->width = _buffer->width;
+			record->height = _buffer->height;
+			record->changeCount = _buffer->changeCount.load(std::memory_order_relaxed);
+
+			record->bBoxBefore[0] = _buffer->bBoxLeft;
+			record->bBoxBefore[1] = _buffer->bBoxTop;
+			record->bBoxBefore[2] = _buffer->bBoxRight;
+			record->bBoxBefore[3] = _buffer->bBoxBottom;
+
+		}
+
+		if (_buffer->width != record->width || _buffer->height != record->height) return;
+		if (!_buffer->clipRect(_x, _y, _width, _height)) return;
+
+		s32 right = _x + _width - 1;
+		s32 bottom = _y + _height - 1;
+
+		//Blocks already tracked by an earlier call keep their first snapshot.
+		for (s32 blockY = _y / ZIXEL_CHUNK_SIZE; blockY <= bottom / ZIXEL_CHUNK_SIZE; ++blockY) {
+
+			for (s32 blockX = _x / ZIXEL_CHUNK_SIZE; blockX <= right / ZIXEL_CHUNK_SIZE; ++blockX) {
+
+				s32 block = (blockY * _buffer->dirtyColumns) + blockX;
+				if (record->snapshots.find(block) != record->snapshots.end()) continue;
+
+				UndoSnapshot& snapshot = record->snapshots[block];
+				snapshot.changeCount = _buffer->dirtyBlocks[block].changeCount;
+
+				//Dirty blocks line up with the tiles.
+				if (_buffer->isTiled()) {
+
+					snapshot.tile = PixelTile::retain(_buffer->tiles[block]);
+					continue;
+
+				}
+
+				s32 x = blockX * ZIXEL_CHUNK_SIZE;
+				s32 y = blockY * ZIXEL_CHUNK_SIZE;
+				s32 w = std::min(ZIXEL_CHUNK_SIZE, _buffer->width - x);
+				s32 h = std::min(ZIXEL_CHUNK_SIZE, _buffer->height - y);
+
+				size_t rowSize = (size_t)w * 4;
+				snapshot.pixels.resize(rowSize * (size_t)h);
+
+				for (s32 row = 0; row < h; ++row) {
+					memcpy(snapshot.pixels.data() + ((size_t)row * rowSize), _buffer->pixelPtr(x, y + row), rowSize);
+				}
+
+			}
+
+		}
+
+	}
+
+	bool UndoHistory::end() {
+
+		if (recording == nullptr) {
+
+			ZIXEL_WARN("Error in UndoHistory::end. Not recording, call begin first.");
+			return false;
+
+		}
+
+		UndoEntry* entry = recording;
+		recording = nullptr;
+
+		for (size_t i = 0; i < entry->records.size();) {
+
+			UndoBufferRecord& record = entry->records[i];
+			PixelBuffer* buffer = record.buffer;
+
+			if (buffer->width != record.width || buffer->height != record.height) {
+				ZIXEL_WARN("Error in UndoHistory::end. Buffer was resized while recording, changes to it can't be undone.");
+			}
+			else {
+
+				u64 trackedChanges = 0;
+
+				for (auto& it : record.snapshots) {
+
+					s32 block = it.first;
+					UndoSnapshot& snapshot = it.second;
+
+					//Blocks the buffer hasn't counted a change in are skipped without comparing them.
+					u32 changes = buffer->dirtyBlocks[block].changeCount - snapshot.changeCount;
+					if (changes == 0) continue;
+
+					trackedChanges += changes;
+
+					//Tiles that are still shared with the snapshot haven't been written to.
+					if (snapshot.tile != nullptr && snapshot.tile == buffer->tiles[block]) continue;
+
+					s32 x = (block % buffer->dirtyColumns) * ZIXEL_CHUNK_SIZE;
+					s32 y = (block / buffer->dirtyColumns) * ZIXEL_CHUNK_SIZE;
+					s32 w = std::min(ZIXEL_CHUNK_SIZE, buffer->width - x);
+					s32 h = std::min(ZIXEL_CHUNK_SIZE, buffer->height - y);
+
+					const u8* before = (snapshot.tile != nullptr) ? snapshot.tile->data : snapshot.pixels.data();
+					size_t beforeStride = (snapshot.tile != nullptr) ? ((size_t)ZIXEL_CHUNK_SIZE * 4) : ((size_t)w * 4);
+
+					UndoDelta delta;
+					if (__createDelta(before, beforeStride, buffer, x, y, w, h, delta)) {
+
+						entry->byteSize += sizeof(UndoDelta) + delta.data.size();
+						record.deltas.push_back(std::move(delta));
+
+					}
+
+				}
+
+				//The buffer's count is the sum of its block counts, so any difference was counted in an untracked block.
+				if (buffer->changeCount.load(std::memory_order_relaxed) - record.changeCount != trackedChanges) {
+					ZIXEL_WARN("Error in UndoHistory::end. Buffer was changed outside the tracked area, those changes can't be undone.");
+				}
+
+				record.bBoxAfter[0] = buffer->bBoxLeft;
+				record.bBoxAfter[1] = buffer->bBoxTop;
+				record.bBoxAfter[2] = buffer->bBoxRight;
+				record.bBoxAfter[3] = buffer->bBoxBottom;
+
+			}
+
+			__releaseSnapshots(record);
+
+			if (record.deltas.empty()) entry->records.erase(entry->records.begin() + i);
+			else ++i;
+
+		}
+
+		if (entry->records.empty()) {
+
+			__deleteEntry(entry);
+			return false;
+
+		}
+
+		entry->byteSize += sizeof(UndoEntry) + (entry->records.size() * sizeof(UndoBufferRecord));
+
+		__clearRedo();
+
+		undoEntries.push_back(entry);
+		byteSize += entry->byteSize;
+
+		__enforceBudget();
+
+		return true;
+
+	}
+
+	void UndoHistory::cancel() {
+
+		if (recording == nullptr) return;
+
+		__deleteEntry(recording);
+		recording = nullptr;
+
+	}
+
+	bool UndoHistory::undo() {
+
+		if (!canUndo()) return false;
+
+		UndoEntry* entry = undoEntries.back();
+		undoEntries.pop_back();
+
+		__apply(entry, true);
+		redoEntries.push_back(entry);
+
+		return true;
+
+	}
+
+	bool UndoHistory::redo() {
+
+		if (!canRedo()) return false;
+
+		UndoEntry* entry = redoEntries.back();
+		redoEntries.pop_back();
+
+		__apply(entry, false);
+		undoEntries.push_back(entry);
+
+		return true;
+
+	}
+
+	bool UndoHistory::canUndo() {
+		return (recording == nullptr && !undoEntries.empty());
+	}
+
+	bool UndoHistory::canRedo() {
+		return (recording == nullptr && !redoEntries.empty());
+	}
+
+	void UndoHistory::clear() {
+
+		for (UndoEntry* entry : undoEntries) {
+			__deleteEntry(entry);
+		}
+
+		undoEntries.clear();
+		__clearRedo();
+
+		byteSize = 0;
+
+	}
+
+	void UndoHistory::removeBuffer(PixelBuffer* _buffer) {
+
+		auto removeFromEntry = [&](UndoEntry* _entry) {
+
+			for (size_t i = 0; i < _entry->records.size();) {
+
+				UndoBufferRecord& record = _entry->records[i];
+
+				if (record.buffer != _buffer) {
+
+					++i;
+					continue;
+
+				}
+
+				__releaseSnapshots(record);
+
+				size_t recordSize = sizeof(UndoBufferRecord);
+				for (UndoDelta& delta : record.deltas) {
+					recordSize += sizeof(UndoDelta) + delta.data.size();
+				}
+
+				_entry->byteSize -= std::min(_entry->byteSize, recordSize);
+				if (_entry != recording) byteSize -= std::min(byteSize, recordSize);
+
+				_entry->records.erase(_entry->records.begin() + i);
+
+			}
+
+			return _entry->records.empty();
+
+		};
+
+		if (recording != nullptr) removeFromEntry(recording);
+
+		for (auto it = undoEntries.begin(); it != undoEntries.end();) {
+
+			if (removeFromEntry(*it)) {
+
+				byteSize -= std::min(byteSize, (*it)->byteSize);
+
+				__deleteEntry(*it);
+				it = undoEntries.erase(it);
+
+			}
+			else ++it;
+
+		}
+
+		for (auto it = redoEntries.begin(); it != redoEntries.end();) {
+
+			if (removeFromEntry(*it)) {
+
+				byteSize -= std::min(byteSize, (*it)->byteSize);
+
+				__deleteEntry(*it);
+				it = redoEntries.erase(it);
+
+			}
+			else ++it;
+
+		}
+
+	}
+
+	void UndoHistory::setByteBudget(size_t _byteBudget) {
+
+		byteBudget = _byteBudget;
+		__enforceBudget();
+
+	}
+
+	size_t UndoHistory::getMemoryUsage() {
+		return byteSize;
+	}
+
+	void UndoHistory::__apply(UndoEntry* _entry, bool _undo) {
+
+		for (UndoBufferRecord& record : _entry->records) {
+
+			PixelBuffer* buffer = record.buffer;
+
+			for (UndoDelta& delta : record.deltas) {
+				__applyDelta(buffer, delta);
+			}
+
+			if (buffer->isTiled()) buffer->releaseEmptyTiles();
+
+			if (buffer->useBBox) {
+
+				s32* bBox = (_undo ? record.bBoxBefore : record.bBoxAfter);
+				buffer->__setBBox(bBox[0], bBox[1], bBox[2], bBox[3]);
+
+			}
+
+		}
+
+	}
+
+	void UndoHistory::__enforceBudget() {
+
+		while (byteSize > byteBudget && !redoEntries.empty()) {
+
+			//Redo entries go first, oldest redo step is at the front.
+			UndoEntry* entry = redoEntries.front();
+			redoEntries.erase(redoEntries.begin());
+
+			byteSize -= std::min(byteSize, entry->byteSize);
+			__deleteEntry(entry);
+
+		}
+
+		while (byteSize > byteBudget && undoEntries.size() > 1) {
+
+			UndoEntry* entry = undoEntries.front();
+			undoEntries.pop_front();
+
+			byteSize -= std::min(byteSize, entry->byteSize);
+			__deleteEntry(entry);
+
+		}
+
+	}
+
+	void UndoHistory::__clearRedo() {
+
+		for (UndoEntry* entry : redoEntries) {
+
+			byteSize -= std::min(byteSize, entry->byteSize);
+			__deleteEntry(entry);
+
+		}
+
+		redoEntries.clear();
+
+	}
+
+	void UndoHistory::__deleteEntry(UndoEntry* _entry) {
+
+		for (UndoBufferRecord& record : _entry->records) {
+			__releaseSnapshots(record);
+		}
+
+		delete _entry;
+
+	}
+
+	void UndoHistory::__releaseSnapshots(UndoBufferRecord& _record) {
+
+		for (auto& it : _record.snapshots) {
+			if (it.second.tile != nullptr) PixelTile::release(it.second.tile);
+		}
+
+		_record.snapshots.clear();
+
+	}
+
+	bool UndoHistory::__createDelta(const u8* _before, size_t _beforeStride, PixelBuffer* _after, s32 _x, s32 _y, s32 _width, s32 _height, UndoDelta& _delta) {
+
+		size_t rowSize = (size_t)_width * 4;
+
+		std::vector<u8> xorData(rowSize * (size_t)_height);
+		bool changed = false;
+
+		//Blocks are aligned to tiles, so every row of the block is contiguous in both storage modes.
+		for (s32 row = 0; row < _height; ++row) {
+
+			const u8* before = _before + ((size_t)row * _beforeStride);
+			const u8* after = _after->pixelPtr(_x, _y + row);
+
+			if (memcmp(before, after, rowSize) == 0) continue;
+
+			u8* out = xorData.data() + ((size_t)row * rowSize);
+			for (size_t i = 0; i < rowSize; ++i) {
+				out[i] = (before[i] ^ after[i]);
+			}
+
+			changed = true;
+
+		}
+
+		if (!changed) return false;
+
+		_delta.x = _x;
+		_delta.y = _y;
+		_delta.width = _width;
+		_delta.height = _height;
+
+		__encode(xorData.data(), xorData.size(), _delta.data);
+
+		return true;
+
+	}
+
+	void UndoHistory::__applyDelta(PixelBuffer* _buffer, UndoDelta& _delta) {
+
+		size_t rowSize = (size_t)_delta.width * 4;
+
+		std::vector<u8> xorData(rowSize * (size_t)_delta.height);
+		__decode(_delta.data, xorData.data(), xorData.size());
+
+		for (s32 row = 0; row < _delta.height; ++row) {
+
+			const u8* in = xorData.data() + ((size_t)row * rowSize);
+
+			bool empty = true;
+			for (size_t i = 0; i < rowSize; ++i) {
+
+				if (in[i] != 0) {
+
+					empty = false;
+					break;
+
+				}
+
+			}
+
+			if (empty) continue;
+
+			s32 y = _delta.y + row;
+			u8* out = _buffer->pixelPtrWrite(_delta.x, y);
+
+			_buffer->markDirty(_delta.x, y, _delta.width, 1);
+
+			for (s32 i = 0; i < _delta.width; ++i) {
+
+				u8* pixel = out + ((size_t)i * 4);
+				const u8* pixelXor = in + ((size_t)i * 4);
+
+				bool wasVisible = (pixel[3] != 0);
+
+				pixel[0] ^= pixelXor[0];
+				pixel[1] ^= pixelXor[1];
+				pixel[2] ^= pixelXor[2];
+				pixel[3] ^= pixelXor[3];
+
+				bool isVisible = (pixel[3] != 0);
+
+				if (wasVisible != isVisible) {
+
+					s32 delta = (isVisible ? 1 : -1);
+
+					_buffer->pixelCount += delta;
+					_buffer->__countPixel(_delta.x + i, y, delta);
+
+				}
+
+			}
+
+		}
+
+	}
+
+	//Encoded as pairs of a zero run followed by a run of literal bytes, both lengths are stored as varints.
+	//Short zero runs are kept in the literals since they'd cost more to encode than to store.
+	void UndoHistory::__encode(const u8* _data, size_t _size, std::vector<u8>& _out) {
+
+		_out.clear();
+
+		size_t i = 0;
+		while (i < _size) {
+
+			size_t zeroStart = i;
+			while (i < _size && _data[i] == 0) ++i;
+
+			size_t literalStart = i;
+			while (i < _size) {
+
+				if (_data[i] != 0) {
+
+					++i;
+					continue;
+
+				}
+
+				size_t zeroEnd = i;
+				while (zeroEnd < _size && zeroEnd - i < 4 && _data[zeroEnd] == 0) ++zeroEnd;
+
+				if (zeroEnd - i >= 4 || zeroEnd == _size) break;
+				i = zeroEnd;
+
+			}
+
+			UndoHistory_writeVarInt(_out, literalStart - zeroStart);
+			UndoHistory_writeVarInt(_out, i - literalStart);
+			_out.insert(_out.end(), _data + literalStart, _data + i);
+
+		}
+
+		_out.shrink_to_fit();
+
+	}
+
+	void UndoHistory::__decode(const std::vector<u8>& _data, u8* _out, size_t _size) {
+
+		memset(_out, 0, _size);
+
+		size_t pos = 0, outPos = 0;
+		while (pos < _data.size() && outPos < _size) {
+
+			outPos += UndoHistory_readVarInt(_data, pos);
+
+			size_t literalCount = UndoHistory_readVarInt(_data, pos);
+			literalCount = std::min({ literalCount, _size - std::min(outPos, _size), _data.size() - pos });
+
+			memcpy(_out + outPos, _data.data() + pos, literalCount);
+
+			pos += literalCount;
+			outPos += literalCount;
+
+		}
+
+	}
+
+}
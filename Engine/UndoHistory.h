@@ -0,0 +1,108 @@
+/*
+    UndoHistory.h
+    Copyright (c) 2023-2023 Zekronz - MIT License
+    https://github.com/Zekronz/Zixel-Engine
+*/
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <unordered_map>
+
+#include "Engine/ZixelMacros.h"
+
+namespace Zixel {
+
+	struct PixelBuffer;
+	struct PixelTile;
+
+	//XOR of the pixels before and after an operation inside one ZIXEL_CHUNK_SIZE block, run-length encoded.
+	//Applying a delta flips the pixels between both states, so the same delta is used for undo and redo.
+	struct UndoDelta {
+
+		s32 x = 0, y = 0, width = 0, height = 0;
+		std::vector<u8> data;
+
+	};
+
+	//Pixels of one ZIXEL_CHUNK_SIZE block from when tracking started.
+	struct UndoSnapshot {
+
+		u32 changeCount = 0; //Change count of the dirty block, it hasn't been written to while this still matches.
+		PixelTile* tile = nullptr; //Tiled buffers share the tile, the buffer copies it on the first write.
+		std::vector<u8> pixels; //Contiguous buffers copy the rows of the block.
+
+	};
+
+	struct UndoBufferRecord {
+
+		PixelBuffer* buffer = nullptr;
+
+		//Only kept while recording.
+		s32 width = 0, height = 0;
+		u64 changeCount = 0; //Change count of the buffer when tracking started.
+		std::unordered_map<s32, UndoSnapshot> snapshots; //Tracked blocks, by dirty block index.
+
+		std::vector<UndoDelta> deltas;
+
+		s32 bBoxBefore[4] = { -1, -1, -1, -1 };
+		s32 bBoxAfter[4] = { -1, -1, -1, -1 };
+
+	};
+
+	struct UndoEntry {
+
+		std::vector<UndoBufferRecord> records;
+		size_t byteSize = 0;
+
+	};
+
+	//Records the blocks of pixel buffers an operation changed.
+	//Only the tracked blocks are copied, and only the ones the buffer's change counts say were written to are compared, so small edits on large canvases stay cheap.
+	//Old entries are dropped once the history grows past byteBudget, the newest entry is always kept.
+	struct UndoHistory {
+
+		size_t byteBudget = ZIXEL_UNDO_BYTE_BUDGET;
+		size_t byteSize = 0;
+
+		std::deque<UndoEntry*> undoEntries; //Oldest first.
+		std::vector<UndoEntry*> redoEntries; //Newest last.
+
+		UndoEntry* recording = nullptr;
+
+		UndoHistory(size_t _byteBudget = ZIXEL_UNDO_BYTE_BUDGET);
+		~UndoHistory();
+
+		//Call track for every buffer the operation is going to modify, before modifying it.
+		//Passing the area the operation can change keeps the other blocks from being copied. Changes outside the tracked area can't be undone.
+		void begin();
+		void track(PixelBuffer* _buffer);
+		void track(PixelBuffer* _buffer, s32 _x, s32 _y, s32 _width, s32 _height);
+		bool end(); //Returns false if nothing changed, no entry is added in that case.
+		void cancel();
+
+		bool undo();
+		bool redo();
+		bool canUndo();
+		bool canRedo();
+
+		void clear();
+		void removeBuffer(PixelBuffer* _buffer); //Must be called before a tracked buffer is deleted.
+		void setByteBudget(size_t _byteBudget);
+		size_t getMemoryUsage();
+
+		void __apply(UndoEntry* _entry, bool _undo);
+		void __enforceBudget();
+		void __clearRedo();
+
+		static void __deleteEntry(UndoEntry* _entry);
+		static void __releaseSnapshots(UndoBufferRecord& _record);
+		static bool __createDelta(const u8* _before, size_t _beforeStride, PixelBuffer* _after, s32 _x, s32 _y, s32 _width, s32 _height, UndoDelta& _delta);
+		static void __applyDelta(PixelBuffer* _buffer, UndoDelta& _delta);
+		static void __encode(const u8* _data, size_t _size, std::vector<u8>& _out);
+		static void __decode(const std::vector<u8>& _data, u8* _out, size_t _size);
+
+	};
+
+}
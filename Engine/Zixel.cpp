@@ -7,6 +7,7 @@
 #include "Engine/ZixelPCH.h"
 #include "Engine/Zixel.h"
 #include "Engine/ResourceManager.h"
+#include "Engine/JobSystem.h"
 #include "Engine/Texture.h"
 #include "Engine/Renderer.h"
 #include "Engine/GUI/GUI.h"
@@ -108,6 +109,8 @@ namespace Zixel {
 
 	ZixelApp::~ZixelApp() {
 
+		JobSystem::free();
+
 		delete gui;
 		delete renderer;
 
@@ -202,6 +205,12 @@ namespace Zixel {
 		Color3f clearCol = { 32.0f / 255.0f, 33.0f / 255.0f, 40.0f / 255.0f };
 		setClearColor(clearCol);
 
+		//Initialize job system.
+		if (!JobSystem::init()) {
+			glfwTerminate();
+			return false;
+		}
+
 		//Initialize resource mananger.
 		if (!ResourceManager::init()) {
 			glfwTerminate();
@@ -287,7 +296,10 @@ namespace Zixel {
 	}
 
 	void ZixelApp::update(f32 dt) {
+
+		JobSystem::drainMainThreadQueue();
 		gui->update(dt);
+
 	}
 
 	void ZixelApp::render() {
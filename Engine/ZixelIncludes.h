@@ -6,15 +6,26 @@
 
 #pragma once
 
+#include "Engine/BlendKernel.h"
+#include "Engine/Brush.h"
 #include "Engine/Clipboard.h"
 #include "Engine/Color.h"
+#include "Engine/Compositor.h"
+#include "Engine/CPU.h"
 #include "Engine/Types.h"
 #include "Engine/File.h"
+#include "Engine/FloodFill.h"
+#include "Engine/IndexedBuffer.h"
+#include "Engine/JobSystem.h"
 #include "Engine/KeyCodes.h"
 #include "Engine/Log.h"
 #include "Engine/MaskBuffer.h"
+#include "Engine/MaskOutline.h"
 #include "Engine/Math.h"
+#include "Engine/OnionSkin.h"
 #include "Engine/PixelBuffer.h"
+#include "Engine/Playback.h"
+#include "Engine/Quantize.h"
 #include "Engine/Renderer.h"
 #include "Engine/ResourceManager.h"
 #include "Engine/Shader.h"
@@ -22,6 +33,9 @@
 #include "Engine/Surface.h"
 #include "Engine/Texture.h"
 #include "Engine/TextureAtlas.h"
+#include "Engine/TileStore.h"
+#include "Engine/Transform.h"
+#include "Engine/UndoHistory.h"
 #include "Engine/Zixel.h"
 #include "Engine/ZixelMacros.h"
 #include "Engine/GUI/GUIIncludes.h"
\ No newline at end of file
@@ -23,6 +23,7 @@ namespace Zixel {
 	#define ZIXEL_FILE_MAGIC_NUMBER_B2 0xDE
 
 	#define ZIXEL_MAX_UNDO_COUNT 500
+	#define ZIXEL_UNDO_BYTE_BUDGET ((size_t)256 * 1024 * 1024)
 
 	#define ZIXEL_DEFAULT_CANVAS_WIDTH 64
 	#define ZIXEL_DEFAULT_CANVAS_HEIGHT 64
@@ -30,6 +31,9 @@ namespace Zixel {
 	#define ZIXEL_MAX_CANVAS_HEIGHT 8192
 
 	#define ZIXEL_CHUNK_SIZE 64
+	#define ZIXEL_PARALLEL_MIN_PIXELS (256 * 256) //Smallest area PixelBuffer operations split across threads.
+
+	#define ZIXEL_SURFACE_UPLOAD_BUFFER_COUNT 3
 
 	#define ZIXEL_DEFAULT_SHOW_TILED_MODE_GRID true
 	#define ZIXEL_DEFAULT_TILE_COUNT 3
@@ -49,6 +53,10 @@ namespace Zixel {
 	#define ZIXEL_ANIM_MAX_FPS 999
 	#define ZIXEL_ANIM_DEFAULT_FPS 10
 	#define ZIXEL_ANIM_MAX_FRAME_COUNT 9999
+	#define ZIXEL_ANIM_DEFAULT_ONION_SKIN_FRAMES 2
+	#define ZIXEL_ANIM_MAX_ONION_SKIN_FRAMES 16
+	#define ZIXEL_ANIM_PLAYBACK_PREFETCH_COUNT 8 //Frames composited ahead of the playhead.
+	#define ZIXEL_ANIM_PLAYBACK_BYTE_BUDGET ((size_t)256 * 1024 * 1024)
 
 	#define ZIXEL_MAX_BRUSH_SIZE 128
 	